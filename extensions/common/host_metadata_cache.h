@@ -0,0 +1,76 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+
+#include "absl/container/flat_hash_map.h"
+#include "envoy/config/core/v3/base.pb.h"
+#include "envoy/thread_local/thread_local_object.h"
+#include "envoy/upstream/host_description.h"
+
+namespace Istio {
+namespace Common {
+
+// Values derived from the metadata of upstream hosts. The metadata of a host
+// is immutable, so a value is computed once per metadata object. Values of
+// released metadata are dropped as the cache grows. Not thread safe, meant to
+// be kept per worker.
+template <class T> class HostMetadataCache : public Envoy::ThreadLocal::ThreadLocalObject {
+public:
+  using Metadata = envoy::config::core::v3::Metadata;
+
+  // Returns the value of the host metadata, computed by compute(const
+  // Metadata&) on first use. Hosts without metadata get a default value.
+  template <class F> T get(const Envoy::Upstream::HostDescription& host, F compute) {
+    const auto metadata = host.metadata();
+    if (!metadata) {
+      return {};
+    }
+    const auto it = entries_.find(metadata.get());
+    // A live metadata object at the same address is the same object.
+    if (it != entries_.end() && !it->second.metadata_.expired()) {
+      return it->second.value_;
+    }
+    if (entries_.size() >= prune_at_) {
+      prune();
+    }
+    T value = compute(*metadata);
+    entries_.insert_or_assign(metadata.get(), Entry{metadata, value});
+    return value;
+  }
+
+  size_t size() const { return entries_.size(); }
+
+private:
+  struct Entry {
+    std::weak_ptr<const Metadata> metadata_;
+    T value_;
+  };
+
+  // Drops the values of the released metadata.
+  void prune() {
+    absl::erase_if(entries_, [](const auto& entry) { return entry.second.metadata_.expired(); });
+    prune_at_ = std::max<size_t>(MinPruneSize, 2 * entries_.size());
+  }
+
+  static constexpr size_t MinPruneSize = 1024;
+  absl::flat_hash_map<const Metadata*, Entry> entries_;
+  size_t prune_at_{MinPruneSize};
+};
+
+} // namespace Common
+} // namespace Istio
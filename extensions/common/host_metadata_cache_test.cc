@@ -0,0 +1,67 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "extensions/common/host_metadata_cache.h"
+
+#include "test/mocks/upstream/host.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace Istio {
+namespace Common {
+
+using ::testing::NiceMock;
+using ::testing::Return;
+using Metadata = envoy::config::core::v3::Metadata;
+
+TEST(HostMetadataCacheTest, ComputesOncePerMetadata) {
+  HostMetadataCache<int> cache;
+  NiceMock<Envoy::Upstream::MockHostDescription> host;
+  auto metadata = std::make_shared<const Metadata>();
+  ON_CALL(host, metadata()).WillByDefault(Return(metadata));
+  int calls = 0;
+  auto compute = [&](const Metadata&) { return ++calls; };
+  EXPECT_EQ(1, cache.get(host, compute));
+  EXPECT_EQ(1, cache.get(host, compute));
+  EXPECT_EQ(1, calls);
+
+  // Updated metadata is a new object.
+  auto updated = std::make_shared<const Metadata>();
+  ON_CALL(host, metadata()).WillByDefault(Return(updated));
+  EXPECT_EQ(2, cache.get(host, compute));
+  EXPECT_EQ(2, calls);
+}
+
+TEST(HostMetadataCacheTest, NoMetadata) {
+  HostMetadataCache<int> cache;
+  NiceMock<Envoy::Upstream::MockHostDescription> host;
+  ON_CALL(host, metadata()).WillByDefault(Return(nullptr));
+  EXPECT_EQ(0, cache.get(host, [](const Metadata&) { return 1; }));
+  EXPECT_EQ(0, cache.size());
+}
+
+TEST(HostMetadataCacheTest, PrunesReleasedMetadata) {
+  HostMetadataCache<int> cache;
+  auto compute = [](const Metadata&) { return 1; };
+  for (int i = 0; i < 2048; i++) {
+    NiceMock<Envoy::Upstream::MockHostDescription> host;
+    ON_CALL(host, metadata()).WillByDefault(Return(std::make_shared<const Metadata>()));
+    cache.get(host, compute);
+  }
+  EXPECT_LE(cache.size(), 1024);
+}
+
+} // namespace Common
+} // namespace Istio
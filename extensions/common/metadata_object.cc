@@ -14,7 +14,9 @@
 
 #include "extensions/common/metadata_object.h"
 
-#include "absl/strings/str_join.h"
+#include <algorithm>
+#include <cstring>
+
 #include "flatbuffers/flatbuffers.h"
 #include "extensions/common/node_info_bfbs_generated.h"
 #include "source/common/common/hash.h"
@@ -22,19 +24,6 @@
 namespace Istio {
 namespace Common {
 
-static absl::flat_hash_map<absl::string_view, BaggageToken> ALL_BAGGAGE_TOKENS = {
-    {NamespaceNameToken, BaggageToken::NamespaceName},
-    {ClusterNameToken, BaggageToken::ClusterName},
-    {ServiceNameToken, BaggageToken::ServiceName},
-    {ServiceVersionToken, BaggageToken::ServiceVersion},
-    {PodNameToken, BaggageToken::PodName},
-    {DeploymentNameToken, BaggageToken::DeploymentName},
-    {JobNameToken, BaggageToken::JobName},
-    {CronJobNameToken, BaggageToken::CronJobName},
-    {AppNameToken, BaggageToken::AppName},
-    {AppVersionToken, BaggageToken::AppVersion},
-};
-
 static absl::flat_hash_map<absl::string_view, WorkloadType> ALL_WORKLOAD_TOKENS = {
     {PodSuffix, WorkloadType::Pod},
     {DeploymentSuffix, WorkloadType::Deployment},
@@ -42,9 +31,62 @@ static absl::flat_hash_map<absl::string_view, WorkloadType> ALL_WORKLOAD_TOKENS
     {CronJobSuffix, WorkloadType::CronJob},
 };
 
+namespace {
+// Matches the key of a baggage property without hashing it.
+absl::optional<BaggageToken> parseBaggageToken(absl::string_view key) {
+  switch (key.size()) {
+  case AppNameToken.size():
+    if (key == AppNameToken) {
+      return BaggageToken::AppName;
+    }
+    break;
+  case AppVersionToken.size():
+    if (key == AppVersionToken) {
+      return BaggageToken::AppVersion;
+    }
+    break;
+  case ServiceNameToken.size():
+    static_assert(ServiceNameToken.size() == PodNameToken.size());
+    static_assert(ServiceNameToken.size() == JobNameToken.size());
+    if (key == ServiceNameToken) {
+      return BaggageToken::ServiceName;
+    } else if (key == PodNameToken) {
+      return BaggageToken::PodName;
+    } else if (key == JobNameToken) {
+      return BaggageToken::JobName;
+    }
+    break;
+  case ServiceVersionToken.size():
+    if (key == ServiceVersionToken) {
+      return BaggageToken::ServiceVersion;
+    }
+    break;
+  case ClusterNameToken.size():
+    static_assert(ClusterNameToken.size() == CronJobNameToken.size());
+    if (key == ClusterNameToken) {
+      return BaggageToken::ClusterName;
+    } else if (key == CronJobNameToken) {
+      return BaggageToken::CronJobName;
+    }
+    break;
+  case NamespaceNameToken.size():
+    if (key == NamespaceNameToken) {
+      return BaggageToken::NamespaceName;
+    }
+    break;
+  case DeploymentNameToken.size():
+    if (key == DeploymentNameToken) {
+      return BaggageToken::DeploymentName;
+    }
+    break;
+  default:
+    break;
+  }
+  return {};
+}
+} // namespace
+
 WorkloadMetadataObject WorkloadMetadataObject::fromBaggage(absl::string_view baggage_header_value) {
-  // TODO: check for well-formed-ness of the baggage string: duplication,
-  // inconsistency
   absl::string_view instance;
   absl::string_view cluster;
   absl::string_view workload;
@@ -55,56 +97,69 @@ WorkloadMetadataObject WorkloadMetadataObject::fromBaggage(absl::string_view bag
   absl::string_view app_version;
   WorkloadType workload_type = WorkloadType::Pod;
 
-  std::vector<absl::string_view> properties = absl::StrSplit(baggage_header_value, ',');
-  for (absl::string_view property : properties) {
-    std::pair<absl::string_view, absl::string_view> parts = absl::StrSplit(property, "=");
-    const auto it = ALL_BAGGAGE_TOKENS.find(parts.first);
-    if (it != ALL_BAGGAGE_TOKENS.end()) {
-      switch (it->second) {
-      case BaggageToken::NamespaceName:
-        namespace_name = parts.second;
-        break;
-      case BaggageToken::ClusterName:
-        cluster = parts.second;
-        break;
-      case BaggageToken::ServiceName:
-        canonical_name = parts.second;
-        break;
-      case BaggageToken::ServiceVersion:
-        canonical_revision = parts.second;
-        break;
-      case BaggageToken::PodName:
-        workload_type = WorkloadType::Pod;
-        instance = parts.second;
-        workload = parts.second;
-        break;
-      case BaggageToken::DeploymentName:
-        workload_type = WorkloadType::Deployment;
-        workload = parts.second;
-        break;
-      case BaggageToken::JobName:
-        workload_type = WorkloadType::Job;
-        instance = parts.second;
-        workload = parts.second;
-        break;
-      case BaggageToken::CronJobName:
-        workload_type = WorkloadType::CronJob;
-        workload = parts.second;
-        break;
-      case BaggageToken::AppName:
-        app_name = parts.second;
-        break;
-      case BaggageToken::AppVersion:
-        app_version = parts.second;
-        break;
-      }
+  absl::string_view remaining = baggage_header_value;
+  while (!remaining.empty()) {
+    const size_t end = std::min(remaining.find(','), remaining.size());
+    const absl::string_view property = remaining.substr(0, end);
+    remaining.remove_prefix(std::min(end + 1, remaining.size()));
+
+    const size_t separator = property.find('=');
+    if (separator == absl::string_view::npos || separator == 0) {
+      continue;
+    }
+    const auto token = parseBaggageToken(property.substr(0, separator));
+    if (!token) {
+      continue;
+    }
+    const absl::string_view value = property.substr(separator + 1);
+    switch (*token) {
+    case BaggageToken::NamespaceName:
+      namespace_name = value;
+      break;
+    case BaggageToken::ClusterName:
+      cluster = value;
+      break;
+    case BaggageToken::ServiceName:
+      canonical_name = value;
+      break;
+    case BaggageToken::ServiceVersion:
+      canonical_revision = value;
+      break;
+    case BaggageToken::PodName:
+      workload_type = WorkloadType::Pod;
+      instance = value;
+      workload = value;
+      break;
+    case BaggageToken::DeploymentName:
+      workload_type = WorkloadType::Deployment;
+      workload = value;
+      break;
+    case BaggageToken::JobName:
+      workload_type = WorkloadType::Job;
+      instance = value;
+      workload = value;
+      break;
+    case BaggageToken::CronJobName:
+      workload_type = WorkloadType::CronJob;
+      workload = value;
+      break;
+    case BaggageToken::AppName:
+      app_name = value;
+      break;
+    case BaggageToken::AppVersion:
+      app_version = value;
+      break;
     }
   }
   return WorkloadMetadataObject(instance, cluster, namespace_name, workload, canonical_name,
                                 canonical_revision, app_name, app_version, workload_type, "");
 }
 
-std::string WorkloadMetadataObject::baggage() const {
+const std::string& WorkloadMetadataObject::baggage() const {
+  return baggage_.get([this]() { return serializeBaggage(); });
+}
+
+std::string WorkloadMetadataObject::serializeBaggage() const {
   absl::string_view workload_type = PodSuffix;
   switch (workload_type_) {
   case WorkloadType::Deployment:
@@ -122,48 +177,63 @@ std::string WorkloadMetadataObject::baggage() const {
   default:
     break;
   }
-  std::vector<absl::string_view> parts;
-  parts.push_back("k8s.");
-  parts.push_back(workload_type);
-  parts.push_back(".name=");
-  parts.push_back(workload_name_);
-  if (!cluster_name_.empty()) {
-    parts.push_back(",");
-    parts.push_back(ClusterNameToken);
-    parts.push_back("=");
-    parts.push_back(cluster_name_);
+  const std::array<std::pair<absl::string_view, absl::string_view>, 6> properties = {{
+      {ClusterNameToken, cluster_name_},
+      {NamespaceNameToken, namespace_name_},
+      {ServiceNameToken, canonical_name_},
+      {ServiceVersionToken, canonical_revision_},
+      {AppNameToken, app_name_},
+      {AppVersionToken, app_version_},
+  }};
+
+  // Sized once, so that appending never reallocates.
+  constexpr absl::string_view prefix = "k8s.";
+  constexpr absl::string_view suffix = ".name=";
+  size_t size = prefix.size() + workload_type.size() + suffix.size() + workload_name_.size();
+  for (const auto& [key, value] : properties) {
+    if (!value.empty()) {
+      size += key.size() + value.size() + 2;
+    }
   }
-  if (!namespace_name_.empty()) {
-    parts.push_back(",");
-    parts.push_back(NamespaceNameToken);
-    parts.push_back("=");
-    parts.push_back(namespace_name_);
+  std::string result;
+  result.reserve(size);
+  result.append(prefix.data(), prefix.size());
+  result.append(workload_type.data(), workload_type.size());
+  result.append(suffix.data(), suffix.size());
+  result.append(workload_name_.data(), workload_name_.size());
+  for (const auto& [key, value] : properties) {
+    if (!value.empty()) {
+      result.push_back(',');
+      result.append(key.data(), key.size());
+      result.push_back('=');
+      result.append(value.data(), value.size());
+    }
   }
-  if (!canonical_name_.empty()) {
-    parts.push_back(",");
-    parts.push_back(ServiceNameToken);
-    parts.push_back("=");
-    parts.push_back(canonical_name_);
+  return result;
+}
+
+WorkloadMetadataObject::CopiedStrings
+WorkloadMetadataObject::copyStrings(const WorkloadMetadataObject::Strings& strings) {
+  size_t size = 0;
+  for (const auto& value : strings) {
+    size += value.size();
   }
-  if (!canonical_revision_.empty()) {
-    parts.push_back(",");
-    parts.push_back(ServiceVersionToken);
-    parts.push_back("=");
-    parts.push_back(canonical_revision_);
+  CopiedStrings result;
+  if (size == 0) {
+    return result;
   }
-  if (!app_name_.empty()) {
-    parts.push_back(",");
-    parts.push_back(AppNameToken);
-    parts.push_back("=");
-    parts.push_back(app_name_);
+  auto buffer = std::make_shared<std::string>();
+  buffer->reserve(size);
+  for (const auto& value : strings) {
+    buffer->append(value.data(), value.size());
   }
-  if (!app_version_.empty()) {
-    parts.push_back(",");
-    parts.push_back(AppVersionToken);
-    parts.push_back("=");
-    parts.push_back(app_version_);
+  size_t offset = 0;
+  for (size_t i = 0; i < strings.size(); i++) {
+    result.views[i] = absl::string_view(buffer->data() + offset, strings[i].size());
+    offset += strings[i].size();
   }
-  return absl::StrJoin(parts, "");
+  result.buffer = std::move(buffer);
+  return result;
 }
 
 absl::optional<uint64_t> WorkloadMetadataObject::hash() const {
@@ -181,8 +251,29 @@ std::string_view toStdStringView(absl::string_view view) {
 }
 } // namespace
 
-std::string convertWorkloadMetadataToFlatNode(const WorkloadMetadataObject& obj) {
-  flatbuffers::FlatBufferBuilder fbb;
+namespace {
+// Creates the owner string without an intermediate copy.
+flatbuffers::Offset<flatbuffers::String> createOwner(flatbuffers::FlatBufferBuilder& fbb,
+                                                     absl::string_view namespace_name,
+                                                     absl::string_view workload_type,
+                                                     absl::string_view workload_name) {
+  const std::array<absl::string_view, 6> parts = {
+      OwnerPrefix, namespace_name, "/", workload_type, "s/", workload_name};
+  size_t size = 0;
+  for (const auto& part : parts) {
+    size += part.size();
+  }
+  char* buffer;
+  const auto owner = fbb.CreateUninitializedString(size, &buffer);
+  for (const auto& part : parts) {
+    memcpy(buffer, part.data(), part.size());
+    buffer += part.size();
+  }
+  return owner;
+}
+
+std::string encodeFlatNode(const WorkloadMetadataObject& obj) {
+  auto& fbb = threadLocalFlatBufferBuilder();
 
   flatbuffers::Offset<flatbuffers::String> name, cluster, namespace_, workload_name, owner,
       identity;
@@ -196,20 +287,16 @@ std::string convertWorkloadMetadataToFlatNode(const WorkloadMetadataObject& obj)
 
   switch (obj.workload_type_) {
   case WorkloadType::Deployment:
-    owner = fbb.CreateString(absl::StrCat(OwnerPrefix, obj.namespace_name_, "/", DeploymentSuffix,
-                                          "s/", obj.workload_name_));
+    owner = createOwner(fbb, obj.namespace_name_, DeploymentSuffix, obj.workload_name_);
     break;
   case WorkloadType::Job:
-    owner = fbb.CreateString(
-        absl::StrCat(OwnerPrefix, obj.namespace_name_, "/", JobSuffix, "s/", obj.workload_name_));
+    owner = createOwner(fbb, obj.namespace_name_, JobSuffix, obj.workload_name_);
     break;
   case WorkloadType::CronJob:
-    owner = fbb.CreateString(absl::StrCat(OwnerPrefix, obj.namespace_name_, "/", CronJobSuffix,
-                                          "s/", obj.workload_name_));
+    owner = createOwner(fbb, obj.namespace_name_, CronJobSuffix, obj.workload_name_);
     break;
   case WorkloadType::Pod:
-    owner = fbb.CreateString(
-        absl::StrCat(OwnerPrefix, obj.namespace_name_, "/", PodSuffix, "s/", obj.workload_name_));
+    owner = createOwner(fbb, obj.namespace_name_, PodSuffix, obj.workload_name_);
     break;
   }
 
@@ -235,8 +322,22 @@ std::string convertWorkloadMetadataToFlatNode(const WorkloadMetadataObject& obj)
   node.add_identity(identity);
   auto data = node.Finish();
   fbb.Finish(data);
-  auto fb = fbb.Release();
-  return std::string(reinterpret_cast<const char*>(fb.data()), fb.size());
+  return std::string(reinterpret_cast<const char*>(fbb.GetBufferPointer()), fbb.GetSize());
+}
+} // namespace
+
+const std::string& WorkloadMetadataObject::flatNode() const {
+  return flat_node_.get([this]() { return encodeFlatNode(*this); });
+}
+
+std::string convertWorkloadMetadataToFlatNode(const WorkloadMetadataObject& obj) {
+  return obj.flatNode();
+}
+
+flatbuffers::FlatBufferBuilder& threadLocalFlatBufferBuilder() {
+  thread_local flatbuffers::FlatBufferBuilder fbb;
+  fbb.Clear();
+  return fbb;
 }
 
 WorkloadMetadataObject convertFlatNodeToWorkloadMetadata(const Wasm::Common::FlatNode& node) {
@@ -14,6 +14,10 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <memory>
+
 #include "absl/strings/str_split.h"
 #include "absl/types/optional.h"
 #include "envoy/common/hashable.h"
@@ -73,40 +77,122 @@ constexpr absl::string_view AppVersionToken = "app.version";
 
 struct WorkloadMetadataObject : public Envoy::StreamInfo::FilterState::Object,
                                 public Envoy::Hashable {
+  // Copies the strings into a single buffer shared by all copies of the object.
   explicit WorkloadMetadataObject(absl::string_view instance_name, absl::string_view cluster_name,
                                   absl::string_view namespace_name, absl::string_view workload_name,
                                   absl::string_view canonical_name,
                                   absl::string_view canonical_revision, absl::string_view app_name,
                                   absl::string_view app_version, const WorkloadType workload_type,
                                   absl::string_view identity)
+      : WorkloadMetadataObject(copyStrings({instance_name, cluster_name, namespace_name,
+                                            workload_name, canonical_name, canonical_revision,
+                                            app_name, app_version, identity}),
+                               workload_type) {}
+
+  // References strings kept alive by the storage, e.g. strings interned by the
+  // workload discovery index.
+  explicit WorkloadMetadataObject(std::shared_ptr<const void> storage,
+                                  absl::string_view instance_name, absl::string_view cluster_name,
+                                  absl::string_view namespace_name, absl::string_view workload_name,
+                                  absl::string_view canonical_name,
+                                  absl::string_view canonical_revision, absl::string_view app_name,
+                                  absl::string_view app_version, const WorkloadType workload_type,
+                                  absl::string_view identity)
       : instance_name_(instance_name), cluster_name_(cluster_name), namespace_name_(namespace_name),
         workload_name_(workload_name), canonical_name_(canonical_name),
         canonical_revision_(canonical_revision), app_name_(app_name), app_version_(app_version),
-        workload_type_(workload_type), identity_(identity) {}
+        workload_type_(workload_type), identity_(identity), storage_(std::move(storage)) {}
 
+  // Parses the properties in a single pass. Malformed properties are skipped,
+  // and a later occurrence of a property overrides the earlier ones, including
+  // the workload name of a different workload type.
   static WorkloadMetadataObject fromBaggage(absl::string_view baggage_header_value);
 
-  std::string baggage() const;
+  // Serialized on first use, and reused afterwards.
+  const std::string& baggage() const;
+
+  // FlatNode encoding, built on first use and reused afterwards.
+  const std::string& flatNode() const;
+
+  // Bytes held by the strings built on first use so far.
+  size_t memoizedBytes() const { return baggage_.memoryBytes() + flat_node_.memoryBytes(); }
 
   absl::optional<uint64_t> hash() const override;
 
   absl::optional<std::string> serializeAsString() const override { return baggage(); }
 
-  const std::string instance_name_;
-  const std::string cluster_name_;
-  const std::string namespace_name_;
-  const std::string workload_name_;
-  const std::string canonical_name_;
-  const std::string canonical_revision_;
-  const std::string app_name_;
-  const std::string app_version_;
+  const absl::string_view instance_name_;
+  const absl::string_view cluster_name_;
+  const absl::string_view namespace_name_;
+  const absl::string_view workload_name_;
+  const absl::string_view canonical_name_;
+  const absl::string_view canonical_revision_;
+  const absl::string_view app_name_;
+  const absl::string_view app_version_;
   const WorkloadType workload_type_;
-  const std::string identity_;
+  const absl::string_view identity_;
+
+private:
+  using Strings = std::array<absl::string_view, 9>;
+  struct CopiedStrings {
+    std::shared_ptr<const std::string> buffer;
+    Strings views;
+  };
+  static CopiedStrings copyStrings(const Strings& strings);
+  WorkloadMetadataObject(CopiedStrings strings, const WorkloadType workload_type)
+      : WorkloadMetadataObject(std::move(strings.buffer), strings.views[0], strings.views[1],
+                               strings.views[2], strings.views[3], strings.views[4],
+                               strings.views[5], strings.views[6], strings.views[7],
+                               workload_type, strings.views[8]) {}
+
+  std::string serializeBaggage() const;
+
+  // String computed on first use, safe to read concurrently. A copy computes
+  // its own.
+  class LazyString {
+  public:
+    LazyString() = default;
+    LazyString(const LazyString&) {}
+    LazyString& operator=(const LazyString&) = delete;
+    ~LazyString() { delete value_.load(std::memory_order_relaxed); }
+
+    template <class F> const std::string& get(F compute) const {
+      const std::string* value = value_.load(std::memory_order_acquire);
+      if (value == nullptr) {
+        auto computed = std::make_unique<std::string>(compute());
+        std::string* expected = nullptr;
+        if (value_.compare_exchange_strong(expected, computed.get(), std::memory_order_acq_rel)) {
+          value = computed.release();
+        } else {
+          value = expected;
+        }
+      }
+      return *value;
+    }
+
+    size_t memoryBytes() const {
+      const std::string* value = value_.load(std::memory_order_acquire);
+      return value == nullptr ? 0 : sizeof(std::string) + value->capacity();
+    }
+
+  private:
+    mutable std::atomic<std::string*> value_{nullptr};
+  };
+
+  // Owns the strings referenced above.
+  std::shared_ptr<const void> storage_;
+  LazyString baggage_;
+  LazyString flat_node_;
 };
 
-// Convert metadata object to flatbuffer.
+// Convert metadata object to flatbuffer. The encoding is cached in the object.
 std::string convertWorkloadMetadataToFlatNode(const WorkloadMetadataObject& obj);
 
+// Returns the cleared flatbuffer builder of the calling thread, which keeps its
+// memory between uses. The built buffer must be copied out before the next
+// call on the same thread.
+flatbuffers::FlatBufferBuilder& threadLocalFlatBufferBuilder();
+
 // Convert flatbuffer to metadata object.
 WorkloadMetadataObject convertFlatNodeToWorkloadMetadata(const Wasm::Common::FlatNode& node);
 
@@ -153,6 +153,60 @@ TEST(WorkloadMetadataObjectTest, FromBaggage) {
   }
 }
 
+TEST(WorkloadMetadataObjectTest, FromMalformedBaggage) {
+  {
+    // The last occurrence of a property is used.
+    auto obj = WorkloadMetadataObject::fromBaggage(
+        "k8s.namespace.name=first,k8s.namespace.name=second,app.name=foo,app.name=bar");
+    EXPECT_EQ(obj.namespace_name_, "second");
+    EXPECT_EQ(obj.app_name_, "bar");
+  }
+
+  {
+    // The last workload name sets the workload type.
+    auto obj = WorkloadMetadataObject::fromBaggage("k8s.deployment.name=foo,k8s.pod.name=bar-pod");
+    EXPECT_EQ(obj.workload_type_, WorkloadType::Pod);
+    EXPECT_EQ(obj.workload_name_, "bar-pod");
+    EXPECT_EQ(obj.instance_name_, "bar-pod");
+  }
+
+  {
+    // Properties without a key or a value separator are skipped.
+    auto obj = WorkloadMetadataObject::fromBaggage(
+        ",k8s.namespace.name,=default,,k8s.cluster.name=my-cluster,service.name=a=b,");
+    EXPECT_EQ(obj.namespace_name_, "");
+    EXPECT_EQ(obj.cluster_name_, "my-cluster");
+    EXPECT_EQ(obj.canonical_name_, "a=b");
+  }
+
+  EXPECT_EQ(WorkloadMetadataObject::fromBaggage("").baggage(), "k8s.pod.name=");
+}
+
+TEST(WorkloadMetadataObjectTest, BaggageIsMemoized) {
+  WorkloadMetadataObject obj("pod-foo-1234", "my-cluster", "default", "foo", "foo-service",
+                             "v1alpha3", "foo-app", "v1", WorkloadType::Deployment, "");
+  const std::string& baggage = obj.baggage();
+  EXPECT_EQ(&baggage, &obj.baggage());
+  EXPECT_EQ(obj.serializeAsString(), baggage);
+
+  // A copy serializes its own.
+  WorkloadMetadataObject copy(obj);
+  EXPECT_NE(&baggage, &copy.baggage());
+  EXPECT_EQ(baggage, copy.baggage());
+}
+
+TEST(WorkloadMetadataObjectTest, FlatNodeIsCached) {
+  WorkloadMetadataObject obj("pod-foo-1234", "my-cluster", "default", "foo", "foo-service",
+                             "v1alpha3", "foo-app", "v1", WorkloadType::CronJob, "");
+  const std::string& flat_node = obj.flatNode();
+  EXPECT_EQ(&flat_node, &obj.flatNode());
+  EXPECT_EQ(convertWorkloadMetadataToFlatNode(obj), flat_node);
+
+  const auto& node = *flatbuffers::GetRoot<Wasm::Common::FlatNode>(flat_node.data());
+  EXPECT_EQ(node.owner()->str(), "kubernetes://apis/apps/v1/namespaces/default/cronjobs/foo");
+  EXPECT_EQ(convertFlatNodeToWorkloadMetadata(node).baggage(), obj.baggage());
+}
+
 TEST(WorkloadMetadataObjectTest, ConvertFromFlatNode) {
   flatbuffers::FlatBufferBuilder fbb;
   Wasm::Common::FlatNodeBuilder builder(fbb);
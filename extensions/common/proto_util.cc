@@ -37,9 +37,9 @@
 namespace Wasm {
 namespace Common {
 
-flatbuffers::DetachedBuffer
-extractNodeFlatBufferFromStruct(const google::protobuf::Struct& metadata) {
-  flatbuffers::FlatBufferBuilder fbb;
+namespace {
+void buildNodeFlatBuffer(const google::protobuf::Struct& metadata,
+                         flatbuffers::FlatBufferBuilder& fbb) {
   flatbuffers::Offset<flatbuffers::String> name, namespace_, owner, workload_name, cluster_id;
   std::vector<flatbuffers::Offset<KeyVal>> labels, platform_metadata;
   for (const auto& it : metadata.fields()) {
@@ -90,9 +90,22 @@ extractNodeFlatBufferFromStruct(const google::protobuf::Struct& metadata) {
   node.add_platform_metadata(platform_metadata_offset);
   auto data = node.Finish();
   fbb.Finish(data);
+}
+} // namespace
+
+flatbuffers::DetachedBuffer
+extractNodeFlatBufferFromStruct(const google::protobuf::Struct& metadata) {
+  flatbuffers::FlatBufferBuilder fbb;
+  buildNodeFlatBuffer(metadata, fbb);
   return fbb.Release();
 }
 
+std::string extractNodeFlatBufferStringFromStruct(const google::protobuf::Struct& metadata) {
+  auto& fbb = Istio::Common::threadLocalFlatBufferBuilder();
+  buildNodeFlatBuffer(metadata, fbb);
+  return std::string(reinterpret_cast<const char*>(fbb.GetBufferPointer()), fbb.GetSize());
+}
+
 void extractStructFromNodeFlatBuffer(const FlatNode& node, google::protobuf::Struct* metadata) {
   if (node.name()) {
     (*metadata->mutable_fields())["NAME"].set_string_value(node.name()->str());
@@ -29,6 +29,10 @@ namespace Common {
 flatbuffers::DetachedBuffer
 extractNodeFlatBufferFromStruct(const google::protobuf::Struct& metadata);
 
+// Same as above, but built with the builder of the calling thread and copied
+// once into a string.
+std::string extractNodeFlatBufferStringFromStruct(const google::protobuf::Struct& metadata);
+
 // Extract struct from a flatbuffer. This is an inverse of the above function.
 void extractStructFromNodeFlatBuffer(const FlatNode& node, google::protobuf::Struct* metadata);
 
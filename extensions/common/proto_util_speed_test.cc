@@ -191,6 +191,29 @@ static void BM_DecodeFlatBuffer(benchmark::State& state) {
 }
 BENCHMARK(BM_DecodeFlatBuffer);
 
+// Same as above, with the builder of the thread reused across calls.
+static void BM_DecodeFlatBufferString(benchmark::State& state) {
+  google::protobuf::Struct metadata_struct;
+  JsonParseOptions json_parse_options;
+  ASSERT_OK(
+      JsonStringToMessage(std::string(node_flatbuffer_json), &metadata_struct, json_parse_options));
+  std::string metadata_bytes;
+  ::Wasm::Common::serializeToStringDeterministic(metadata_struct, &metadata_bytes);
+  const std::string header_value =
+      Envoy::Base64::encode(metadata_bytes.data(), metadata_bytes.size());
+
+  size_t size = 0;
+  for (auto _ : state) {
+    auto bytes = Envoy::Base64::decodeWithoutPadding(header_value);
+    google::protobuf::Struct metadata;
+    metadata.ParseFromString(bytes);
+    auto fb = ::Wasm::Common::extractNodeFlatBufferStringFromStruct(metadata);
+    size += fb.size();
+    benchmark::DoNotOptimize(size);
+  }
+}
+BENCHMARK(BM_DecodeFlatBufferString);
+
 // Measure decoding performance of baggage.
 static void BM_DecodeBaggage(benchmark::State& state) {
   // Construct a header from sample value.
@@ -212,6 +235,68 @@ static void BM_DecodeBaggage(benchmark::State& state) {
 
 BENCHMARK(BM_DecodeBaggage);
 
+// Measure encoding performance of baggage.
+static void BM_EncodeBaggage(benchmark::State& state) {
+  google::protobuf::Struct metadata_struct;
+  JsonParseOptions json_parse_options;
+  ASSERT_OK(
+      JsonStringToMessage(std::string(node_flatbuffer_json), &metadata_struct, json_parse_options));
+  auto fb = ::Wasm::Common::extractNodeFlatBufferFromStruct(metadata_struct);
+  const auto& node = *flatbuffers::GetRoot<Wasm::Common::FlatNode>(fb.data());
+  const auto obj = Istio::Common::convertFlatNodeToWorkloadMetadata(node);
+
+  size_t size = 0;
+  for (auto _ : state) {
+    // A copy shares the strings, but not the serialized form.
+    const Istio::Common::WorkloadMetadataObject copy(obj);
+    size += copy.baggage().size();
+    benchmark::DoNotOptimize(size);
+  }
+}
+
+BENCHMARK(BM_EncodeBaggage);
+
+// Measure serialization of an object whose baggage is memoized, as read by
+// access logs and CEL.
+static void BM_SerializeBaggage(benchmark::State& state) {
+  google::protobuf::Struct metadata_struct;
+  JsonParseOptions json_parse_options;
+  ASSERT_OK(
+      JsonStringToMessage(std::string(node_flatbuffer_json), &metadata_struct, json_parse_options));
+  auto fb = ::Wasm::Common::extractNodeFlatBufferFromStruct(metadata_struct);
+  const auto& node = *flatbuffers::GetRoot<Wasm::Common::FlatNode>(fb.data());
+  const auto obj = Istio::Common::convertFlatNodeToWorkloadMetadata(node);
+
+  size_t size = 0;
+  for (auto _ : state) {
+    size += obj.serializeAsString()->size();
+    benchmark::DoNotOptimize(size);
+  }
+}
+
+BENCHMARK(BM_SerializeBaggage);
+
+// Measure encoding of a metadata object to a flatbuffer.
+static void BM_EncodeFlatNode(benchmark::State& state) {
+  google::protobuf::Struct metadata_struct;
+  JsonParseOptions json_parse_options;
+  ASSERT_OK(
+      JsonStringToMessage(std::string(node_flatbuffer_json), &metadata_struct, json_parse_options));
+  auto fb = ::Wasm::Common::extractNodeFlatBufferFromStruct(metadata_struct);
+  const auto& node = *flatbuffers::GetRoot<Wasm::Common::FlatNode>(fb.data());
+  const auto obj = Istio::Common::convertFlatNodeToWorkloadMetadata(node);
+
+  size_t size = 0;
+  for (auto _ : state) {
+    // A copy shares the strings, but not the cached encoding.
+    const Istio::Common::WorkloadMetadataObject copy(obj);
+    size += Istio::Common::convertWorkloadMetadataToFlatNode(copy).size();
+    benchmark::DoNotOptimize(size);
+  }
+}
+
+BENCHMARK(BM_EncodeFlatNode);
+
 } // namespace Common
 
 // WASM_EPILOG
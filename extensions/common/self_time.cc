@@ -0,0 +1,89 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "extensions/common/self_time.h"
+
+#include "absl/random/random.h"
+#include "absl/strings/str_cat.h"
+
+namespace Istio {
+namespace Common {
+
+namespace {
+
+// Calls between the runtime checks while the measurements are disabled.
+constexpr int64_t DisabledCountdown = 1024;
+
+// Shared by the filters of a worker. The countdown is drawn at random around
+// the rate so that calls repeating in a fixed order are sampled evenly.
+struct Sampler {
+  int64_t countdown_{0};
+  absl::InsecureBitGen random_;
+  // Innermost sample being measured.
+  SelfTime::Sample* active_{nullptr};
+};
+
+Sampler& threadSampler() {
+  thread_local Sampler sampler;
+  return sampler;
+}
+
+} // namespace
+
+SelfTime::SelfTime(Envoy::Stats::Scope& scope, Envoy::Runtime::Loader& runtime,
+                   absl::string_view filter, absl::string_view phase)
+    : histogram_(scope.histogramFromString(absl::StrCat("istio_self_time.", filter, ".", phase,
+                                                        "_ns"),
+                                           Envoy::Stats::Histogram::Unit::Unspecified)),
+      runtime_(runtime) {}
+
+bool SelfTime::sampled() const {
+  auto& sampler = threadSampler();
+  if (sampler.active_ != nullptr) {
+    return true;
+  }
+  if (--sampler.countdown_ > 0) {
+    return false;
+  }
+  const uint64_t rate = runtime_.snapshot().getInteger(SelfTimeSampleRateKey, 0);
+  if (rate == 0) {
+    sampler.countdown_ = DisabledCountdown;
+    return false;
+  }
+  sampler.countdown_ = absl::Uniform<int64_t>(sampler.random_, 1, 2 * static_cast<int64_t>(rate));
+  return true;
+}
+
+void SelfTime::record(std::chrono::nanoseconds duration) const {
+  histogram_.recordValue(duration.count());
+}
+
+void SelfTime::Sample::start() {
+  auto& sampler = threadSampler();
+  parent_ = sampler.active_;
+  sampler.active_ = this;
+  start_ = std::chrono::steady_clock::now();
+}
+
+void SelfTime::Sample::finish() {
+  const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start_;
+  self_time_->record(elapsed - children_);
+  if (parent_ != nullptr) {
+    parent_->children_ += elapsed;
+  }
+  threadSampler().active_ = parent_;
+}
+
+} // namespace Common
+} // namespace Istio
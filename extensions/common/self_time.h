@@ -0,0 +1,78 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+
+#include "absl/strings/string_view.h"
+#include "envoy/runtime/runtime.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats.h"
+
+namespace Istio {
+namespace Common {
+
+// Runtime key of the self-time sampling rate: one in N calls is measured.
+// Measurements are disabled if the key is unset or zero.
+constexpr absl::string_view SelfTimeSampleRateKey = "istio.self_time.sample_rate";
+
+// Self-time of a hot path of an Istio filter, recorded in nanoseconds into
+// the histogram istio_self_time.<filter>.<phase>_ns. Calls are sampled by a
+// thread local countdown; the clock and the runtime are read only when the
+// countdown expires. Phases nested in a sampled phase are always measured and
+// their time is excluded from the enclosing phase.
+class SelfTime {
+public:
+  SelfTime(Envoy::Stats::Scope& scope, Envoy::Runtime::Loader& runtime, absl::string_view filter,
+           absl::string_view phase);
+
+  // Measures its own lifetime if the call is sampled.
+  class Sample {
+  public:
+    explicit Sample(const SelfTime* self_time) : self_time_(self_time) {
+      if (self_time_ != nullptr) {
+        start();
+      }
+    }
+    ~Sample() {
+      if (self_time_ != nullptr) {
+        finish();
+      }
+    }
+    Sample(const Sample&) = delete;
+    Sample& operator=(const Sample&) = delete;
+
+  private:
+    void start();
+    void finish();
+
+    const SelfTime* const self_time_;
+    Sample* parent_{nullptr};
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::nanoseconds children_{0};
+  };
+
+  Sample sample() const { return Sample(sampled() ? this : nullptr); }
+
+private:
+  bool sampled() const;
+  void record(std::chrono::nanoseconds duration) const;
+
+  Envoy::Stats::Histogram& histogram_;
+  Envoy::Runtime::Loader& runtime_;
+};
+
+} // namespace Common
+} // namespace Istio
@@ -0,0 +1,118 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "extensions/common/self_time.h"
+
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "test/mocks/runtime/mocks.h"
+#include "test/mocks/stats/mocks.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace Istio {
+namespace Common {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::InvokeWithoutArgs;
+using ::testing::NiceMock;
+using ::testing::Property;
+using ::testing::Return;
+
+class SelfTimeTest : public testing::Test {
+protected:
+  void setRate(uint64_t rate) {
+    ON_CALL(runtime_.snapshot_, getInteger(SelfTimeSampleRateKey, 0)).WillByDefault(Return(rate));
+  }
+  void expectSamples(absl::string_view name, int count) {
+    EXPECT_CALL(store_, deliverHistogramToSinks(Property(&Envoy::Stats::Metric::name, name), _))
+        .Times(count);
+  }
+  // The sampler is thread local, each test starts with a new one.
+  template <class F> void runOnNewThread(F f) { std::thread(f).join(); }
+
+  NiceMock<Envoy::Stats::MockIsolatedStatsStore> store_;
+  NiceMock<Envoy::Runtime::MockLoader> runtime_;
+};
+
+TEST_F(SelfTimeTest, Disabled) {
+  SelfTime self_time(*store_.rootScope(), runtime_, "filter", "phase");
+  expectSamples("istio_self_time.filter.phase_ns", 0);
+  runOnNewThread([&] {
+    for (int i = 0; i < 10; i++) {
+      const auto sample = self_time.sample();
+    }
+  });
+}
+
+TEST_F(SelfTimeTest, SampleAll) {
+  setRate(1);
+  SelfTime self_time(*store_.rootScope(), runtime_, "filter", "phase");
+  expectSamples("istio_self_time.filter.phase_ns", 10);
+  runOnNewThread([&] {
+    for (int i = 0; i < 10; i++) {
+      const auto sample = self_time.sample();
+    }
+  });
+}
+
+TEST_F(SelfTimeTest, SampleOneInN) {
+  setRate(100);
+  SelfTime self_time(*store_.rootScope(), runtime_, "filter", "phase");
+  int samples = 0;
+  EXPECT_CALL(store_, deliverHistogramToSinks(_, _))
+      .WillRepeatedly(InvokeWithoutArgs([&] { samples++; }));
+  runOnNewThread([&] {
+    for (int i = 0; i < 100000; i++) {
+      const auto sample = self_time.sample();
+    }
+  });
+  EXPECT_GT(samples, 500);
+  EXPECT_LT(samples, 2000);
+}
+
+TEST_F(SelfTimeTest, NestedPhaseIsMeasured) {
+  setRate(1000000);
+  SelfTime outer(*store_.rootScope(), runtime_, "filter", "outer");
+  SelfTime inner(*store_.rootScope(), runtime_, "filter", "inner");
+  absl::flat_hash_map<std::string, std::vector<std::chrono::nanoseconds>> recorded;
+  EXPECT_CALL(store_, deliverHistogramToSinks(_, _))
+      .WillRepeatedly(Invoke([&](const Envoy::Stats::Histogram& histogram, uint64_t value) {
+        recorded[histogram.name()].push_back(std::chrono::nanoseconds(value));
+      }));
+  runOnNewThread([&] {
+    for (int i = 0; i < 10; i++) {
+      const auto outer_sample = outer.sample();
+      std::this_thread::sleep_for(std::chrono::milliseconds(i == 0 ? 5 : 0));
+      const auto inner_sample = inner.sample();
+      std::this_thread::sleep_for(std::chrono::milliseconds(i == 0 ? 50 : 0));
+    }
+  });
+  // Only the first outer call is sampled, the nested call follows it.
+  const auto& outer_times = recorded["istio_self_time.filter.outer_ns"];
+  const auto& inner_times = recorded["istio_self_time.filter.inner_ns"];
+  ASSERT_EQ(1, outer_times.size());
+  ASSERT_EQ(1, inner_times.size());
+  EXPECT_GE(inner_times[0], std::chrono::milliseconds(50));
+  // The outer phase only has its own sleep, the inner one is subtracted.
+  EXPECT_GE(outer_times[0], std::chrono::milliseconds(5));
+  EXPECT_LT(outer_times[0], std::chrono::milliseconds(50));
+}
+
+} // namespace Common
+} // namespace Istio
@@ -0,0 +1,165 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstring>
+#include <memory>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/numeric/int128.h"
+#include "absl/strings/string_view.h"
+#include "source/extensions/common/workload_discovery/api.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+
+// Workloads by IP address. Keys have the in-memory representation used by
+// Envoy IP addresses, and IPv4-mapped IPv6 addresses are indexed as IPv4.
+//
+// The addresses are split into shards by hash. A copy of the index shares
+// the shards of the original, and a shard is only copied when the copy first
+// changes it, so that a delta of a few workloads does not copy the whole
+// index. The original must not be changed once copied.
+class AddressIndex {
+public:
+  AddressIndex() = default;
+  AddressIndex(const AddressIndex& other) : shards_(other.shards_), size_(other.size_) {}
+  AddressIndex& operator=(const AddressIndex&) = delete;
+
+  void insert(absl::string_view address, const WorkloadMetadataObjectConstSharedPtr& workload) {
+    if (address.size() == 4) {
+      insertIpv4(ipv4Key(address.data()), workload);
+    } else if (address.size() == 16) {
+      if (isIpv4Mapped(reinterpret_cast<const uint8_t*>(address.data()))) {
+        insertIpv4(ipv4Key(address.data() + 12), workload);
+      } else {
+        const auto key = ipv6Key(address.data());
+        size_ += mutableShard(shardOf(key)).ipv6_.insert_or_assign(key, workload).second;
+      }
+    }
+  }
+  void erase(absl::string_view address) {
+    if (address.size() == 4) {
+      eraseIpv4(ipv4Key(address.data()));
+    } else if (address.size() == 16) {
+      if (isIpv4Mapped(reinterpret_cast<const uint8_t*>(address.data()))) {
+        eraseIpv4(ipv4Key(address.data() + 12));
+      } else {
+        const auto key = ipv6Key(address.data());
+        const size_t shard = shardOf(key);
+        if (shards_[shard] != nullptr && shards_[shard]->ipv6_.contains(key)) {
+          size_ -= mutableShard(shard).ipv6_.erase(key);
+        }
+      }
+    }
+  }
+  const WorkloadMetadataObjectConstSharedPtr* findIpv4(uint32_t address) const {
+    const auto& shard = shards_[shardOf(address)];
+    if (shard == nullptr) {
+      return nullptr;
+    }
+    const auto it = shard->ipv4_.find(address);
+    return it != shard->ipv4_.end() ? &it->second : nullptr;
+  }
+  const WorkloadMetadataObjectConstSharedPtr* findIpv6(absl::uint128 address) const {
+    uint8_t bytes[16];
+    memcpy(bytes, &address, sizeof(bytes));
+    if (isIpv4Mapped(bytes)) {
+      return findIpv4(ipv4Key(reinterpret_cast<const char*>(bytes) + 12));
+    }
+    const auto& shard = shards_[shardOf(address)];
+    if (shard == nullptr) {
+      return nullptr;
+    }
+    const auto it = shard->ipv6_.find(address);
+    return it != shard->ipv6_.end() ? &it->second : nullptr;
+  }
+  size_t size() const { return size_; }
+  // Estimated bytes held by the maps, excluding the workloads. Shards shared
+  // with other versions are included.
+  size_t memoryBytes() const {
+    size_t bytes = sizeof(shards_);
+    for (const auto& shard : shards_) {
+      if (shard != nullptr) {
+        bytes += sizeof(Shard) +
+                 shard->ipv4_.capacity() * (sizeof(decltype(shard->ipv4_)::value_type) + 1) +
+                 shard->ipv6_.capacity() * (sizeof(decltype(shard->ipv6_)::value_type) + 1);
+      }
+    }
+    return bytes;
+  }
+
+private:
+  struct Shard {
+    absl::flat_hash_map<uint32_t, WorkloadMetadataObjectConstSharedPtr> ipv4_;
+    absl::flat_hash_map<absl::uint128, WorkloadMetadataObjectConstSharedPtr> ipv6_;
+  };
+  // About a thousand addresses per shard at a million workloads.
+  static constexpr size_t ShardBits = 10;
+  static constexpr size_t ShardCount = size_t{1} << ShardBits;
+
+  // The shard is taken from the high bits of the hash, the maps of a shard
+  // use the low bits.
+  template <class Key> static size_t shardOf(const Key& key) {
+    return static_cast<uint64_t>(absl::Hash<Key>{}(key)) >> (64 - ShardBits);
+  }
+
+  // Returns the shard owned by this index, copied or created if needed.
+  Shard& mutableShard(size_t shard) {
+    if (!owned_[shard]) {
+      shards_[shard] = shards_[shard] != nullptr ? std::make_shared<Shard>(*shards_[shard])
+                                                 : std::make_shared<Shard>();
+      owned_[shard] = true;
+    }
+    return *shards_[shard];
+  }
+  void insertIpv4(uint32_t key, const WorkloadMetadataObjectConstSharedPtr& workload) {
+    size_ += mutableShard(shardOf(key)).ipv4_.insert_or_assign(key, workload).second;
+  }
+  void eraseIpv4(uint32_t key) {
+    const size_t shard = shardOf(key);
+    if (shards_[shard] != nullptr && shards_[shard]->ipv4_.contains(key)) {
+      size_ -= mutableShard(shard).ipv4_.erase(key);
+    }
+  }
+
+  // Returns true for an IPv4-mapped IPv6 address, ::ffff:a.b.c.d.
+  static bool isIpv4Mapped(const uint8_t* bytes) {
+    constexpr uint8_t prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    return memcmp(bytes, prefix, sizeof(prefix)) == 0;
+  }
+  static uint32_t ipv4Key(const char* bytes) {
+    uint32_t key;
+    memcpy(&key, bytes, sizeof(key));
+    return key;
+  }
+  static absl::uint128 ipv6Key(const char* bytes) {
+    absl::uint128 key;
+    memcpy(static_cast<void*>(&key), bytes, sizeof(key));
+    return key;
+  }
+
+  std::array<std::shared_ptr<Shard>, ShardCount> shards_;
+  // Shards created or copied by this index, which it may change.
+  std::bitset<ShardCount> owned_;
+  size_t size_{0};
+};
+
+using AddressIndexSharedPtr = std::shared_ptr<AddressIndex>;
+using AddressIndexConstSharedPtr = std::shared_ptr<const AddressIndex>;
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
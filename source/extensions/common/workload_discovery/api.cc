@@ -14,128 +14,198 @@
 
 #include "source/extensions/common/workload_discovery/api.h"
 
+#include <algorithm>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
 #include "envoy/registry/registry.h"
 #include "envoy/server/bootstrap_extension_config.h"
 #include "envoy/server/factory_context.h"
 #include "envoy/singleton/manager.h"
 #include "envoy/thread_local/thread_local.h"
-#include "source/common/common/non_copyable.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
 #include "source/common/config/subscription_base.h"
 #include "source/common/grpc/common.h"
 #include "source/common/init/target_impl.h"
+#include "source/common/protobuf/utility.h"
+#include "source/extensions/common/workload_discovery/address_index.h"
 #include "source/extensions/common/workload_discovery/discovery.pb.h"
 #include "source/extensions/common/workload_discovery/discovery.pb.validate.h"
 #include "source/extensions/common/workload_discovery/extension.pb.h"
 #include "source/extensions/common/workload_discovery/extension.pb.validate.h"
+#include "source/extensions/common/workload_discovery/worker_pool.h"
+#include "source/extensions/common/workload_discovery/workload_index.h"
+#include "source/extensions/common/workload_discovery/workload_interest.h"
+#include "source/extensions/common/workload_discovery/workload_snapshot.h"
 
 namespace Envoy::Extensions::Common::WorkloadDiscovery {
 namespace {
-constexpr absl::string_view DefaultNamespace = "default";
-constexpr absl::string_view DefaultTrustDomain = "cluster.local";
-Istio::Common::WorkloadMetadataObject convert(const istio::workload::Workload& workload) {
-  auto workload_type = Istio::Common::WorkloadType::Deployment;
-  switch (workload.workload_type()) {
-  case istio::workload::WorkloadType::CRONJOB:
-    workload_type = Istio::Common::WorkloadType::CronJob;
-    break;
-  case istio::workload::WorkloadType::JOB:
-    workload_type = Istio::Common::WorkloadType::Job;
-    break;
-  case istio::workload::WorkloadType::POD:
-    workload_type = Istio::Common::WorkloadType::Pod;
-    break;
-  default:
-    break;
+// Threads parsing the workloads of an update, and workloads parsed by each
+// task.
+constexpr size_t DecodeThreads = 2;
+constexpr size_t DecodeChunk = 1024;
+
+// Serialized workloads by resource name.
+using EncodedWorkloads = std::vector<std::pair<std::string, std::string>>;
+
+// Reads the uid of a serialized workload without parsing the other fields.
+std::string readUid(const std::string& bytes) {
+  using Protobuf::internal::WireFormatLite;
+  Protobuf::io::CodedInputStream input(reinterpret_cast<const uint8_t*>(bytes.data()),
+                                       bytes.size());
+  std::string uid;
+  while (const uint32_t tag = input.ReadTag()) {
+    if (WireFormatLite::GetTagFieldNumber(tag) == istio::workload::Workload::kUidFieldNumber &&
+        WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      if (!WireFormatLite::ReadString(&input, &uid)) {
+        break;
+      }
+    } else if (!WireFormatLite::SkipField(&input, tag)) {
+      break;
+    }
   }
+  return uid;
+}
 
-  absl::string_view ns = workload.namespace_();
-  absl::string_view trust_domain = workload.trust_domain();
-  // Trust domain may be elided if it's equal to "cluster.local"
-  if (trust_domain.empty()) {
-    trust_domain = DefaultTrustDomain;
+// Keeps the resources serialized, so that the main thread only copies their
+// bytes. They are parsed off the main thread by the provider.
+class WorkloadResourceDecoder : public Config::OpaqueResourceDecoder {
+public:
+  // Config::OpaqueResourceDecoder
+  ProtobufTypes::MessagePtr decodeResource(const ProtobufWkt::Any& resource) override {
+    return std::make_unique<ProtobufWkt::Any>(resource);
   }
-  // The namespace may be elided if it's equal to "default"
-  if (ns.empty()) {
-    ns = DefaultNamespace;
+  // Only called for the state of the world resources, which are not named.
+  std::string resourceName(const Protobuf::Message& resource) override {
+    return readUid(dynamic_cast<const ProtobufWkt::Any&>(resource).value());
   }
-  const auto identity = absl::StrCat("spiffe://", trust_domain, "/ns/", workload.namespace_(),
-                                     "/sa/", workload.service_account());
-  return Istio::Common::WorkloadMetadataObject(
-      workload.name(), workload.cluster_id(), workload.namespace_(), workload.workload_name(),
-      workload.canonical_name(), workload.canonical_revision(), workload.canonical_name(),
-      workload.canonical_revision(), workload_type, identity);
-}
+};
 } // namespace
 
-class WorkloadMetadataProviderImpl : public WorkloadMetadataProvider, public Singleton::Instance {
+class WorkloadMetadataProviderImpl
+    : public WorkloadMetadataProvider,
+      public Singleton::Instance,
+      public std::enable_shared_from_this<WorkloadMetadataProviderImpl> {
 public:
-  WorkloadMetadataProviderImpl(const envoy::config::core::v3::ConfigSource& config_source,
+  WorkloadMetadataProviderImpl(const istio::workload::BootstrapExtension& config,
                                Server::Configuration::ServerFactoryContext& factory_context)
-      : config_source_(config_source), factory_context_(factory_context),
-        tls_(factory_context.threadLocal()),
+      : config_source_(config.config_source()), snapshot_path_(config.snapshot_path()),
+        snapshot_interval_(PROTOBUF_GET_MS_OR_DEFAULT(config, snapshot_interval, 60000)),
+        on_demand_(config.has_on_demand()),
+        ttl_(PROTOBUF_GET_MS_OR_DEFAULT(config.on_demand(), ttl, 300000)),
+        negative_ttl_(PROTOBUF_GET_MS_OR_DEFAULT(config.on_demand(), negative_ttl, 30000)),
+        factory_context_(factory_context),
         scope_(factory_context.scope().createScope("workload_discovery")),
-        stats_(generateStats(*scope_)), subscription_(*this) {
-    tls_.set([](Event::Dispatcher&) { return std::make_shared<ThreadLocalProvider>(); });
-    // This is safe because the ADS mux is started in the cluster manager constructor prior to this
-    // call.
-    subscription_.start();
+        stats_(generateStats(*scope_)), tls_(factory_context.threadLocal()), interest_(ttl_),
+        decoders_(factory_context.api().threadFactory(), DecodeThreads),
+        executor_(factory_context.api().threadFactory(), 1), subscription_(*this) {
+    if (!snapshot_path_.empty()) {
+      loadSnapshot();
+      snapshot_timer_ = factory_context.mainThreadDispatcher().createTimer([this]() {
+        executor_.post([this]() { writeSnapshot(); });
+        snapshot_timer_->enableTimer(snapshot_interval_);
+      });
+      snapshot_timer_->enableTimer(snapshot_interval_);
+    }
+    // Workers count lookups locally, the counts are added to the stats once
+    // per stats flush.
+    lookup_stats_timer_ = factory_context.mainThreadDispatcher().createTimer([this]() {
+      flushLookupStats();
+      lookup_stats_timer_->enableTimer(factory_context_.statsConfig().flushInterval());
+    });
+    lookup_stats_timer_->enableTimer(factory_context.statsConfig().flushInterval());
+    tls_.set([index = workloads_.index()](Event::Dispatcher&) {
+      auto provider = std::make_shared<ThreadLocalProvider>();
+      provider->index_ = index;
+      return provider;
+    });
+    if (on_demand_) {
+      // The subscription is started by the first request, or by the
+      // workloads of the snapshot, which expire as if requested now.
+      if (!workloads_.workloads().empty()) {
+        const auto now = factory_context.timeSource().monotonicTime();
+        for (const auto& [name, _] : workloads_.workloads()) {
+          interest_.request(name, now);
+        }
+        subscribed_ = true;
+        subscription_.start(interest_.names());
+      }
+      interest_timer_ = factory_context.mainThreadDispatcher().createTimer([this]() {
+        expireInterest();
+        interest_timer_->enableTimer(negative_ttl_);
+      });
+      interest_timer_->enableTimer(negative_ttl_);
+    } else {
+      // This is safe because the ADS mux is started in the cluster manager constructor prior to
+      // this call.
+      subscription_.start({});
+    }
   }
 
-  std::optional<Istio::Common::WorkloadMetadataObject>
+  WorkloadMetadataObjectConstSharedPtr
   GetMetadata(const Network::Address::InstanceConstSharedPtr& address) override {
     if (address && address->ip()) {
+      auto& tls = *tls_;
+      const WorkloadMetadataObjectConstSharedPtr* workload = nullptr;
       if (const auto ipv4 = address->ip()->ipv4(); ipv4) {
-        uint32_t value = ipv4->address();
-        std::array<uint8_t, 4> output;
-        absl::little_endian::Store32(&output, value);
-        return tls_->get(std::string(output.begin(), output.end()));
+        workload = tls.index_->findIpv4(ipv4->address());
+        if (workload && on_demand_) {
+          tls.used_.addIpv4(ipv4->address());
+        }
       } else if (const auto ipv6 = address->ip()->ipv6(); ipv6) {
-        const uint64_t high = absl::Uint128High64(ipv6->address());
-        const uint64_t low = absl::Uint128Low64(ipv6->address());
-        std::array<uint8_t, 16> output;
-        absl::little_endian::Store64(&output, low);
-        absl::little_endian::Store64(&output[8], high);
-        return tls_->get(std::string(output.begin(), output.end()));
-      }
-    }
-    return {};
-  }
-
-private:
-  using IdToAddress = absl::flat_hash_map<std::string, std::vector<std::string>>;
-  using IdToAddressSharedPtr = std::shared_ptr<IdToAddress>;
-  using AddressToWorkload = absl::flat_hash_map<std::string, Istio::Common::WorkloadMetadataObject>;
-  using AddressToWorkloadSharedPtr = std::shared_ptr<AddressToWorkload>;
-
-  struct ThreadLocalProvider : public ThreadLocal::ThreadLocalObject {
-    void reset(const AddressToWorkloadSharedPtr& index) { address_to_workload_ = *index; }
-    void update(const AddressToWorkloadSharedPtr& added_addresses,
-                const IdToAddressSharedPtr& added_ids,
-                const std::shared_ptr<std::vector<std::string>> removed) {
-      for (const auto& id : *removed) {
-        for (const auto& address : id_to_address_[id]) {
-          address_to_workload_.erase(address);
+        workload = tls.index_->findIpv6(ipv6->address());
+        if (workload && on_demand_) {
+          tls.used_.addIpv6(ipv6->address());
         }
-        id_to_address_.erase(id);
       }
-      for (const auto& [address, workload] : *added_addresses) {
-        address_to_workload_.emplace(address, workload);
+      if (workload) {
+        tls.lookup_hit_++;
+        return *workload;
       }
-      for (const auto& [id, address] : *added_ids) {
-        id_to_address_.emplace(id, address);
+      tls.lookup_miss_++;
+      if (on_demand_) {
+        requestOnDemand(*address->ip());
       }
     }
-    size_t total() const { return address_to_workload_.size(); }
-    // Returns by-value since the flat map does not provide pointer stability.
-    std::optional<Istio::Common::WorkloadMetadataObject> get(const std::string& address) {
-      const auto it = address_to_workload_.find(address);
-      if (it != address_to_workload_.end()) {
-        return it->second;
+    return nullptr;
+  }
+
+  WorkloadMetadataObjectConstSharedPtr
+  peekMetadata(const Network::Address::InstanceConstSharedPtr& address) override {
+    if (address && address->ip()) {
+      const auto& index = *tls_->index_;
+      const WorkloadMetadataObjectConstSharedPtr* workload = nullptr;
+      if (const auto ipv4 = address->ip()->ipv4(); ipv4) {
+        workload = index.findIpv4(ipv4->address());
+      } else if (const auto ipv6 = address->ip()->ipv6(); ipv6) {
+        workload = index.findIpv6(ipv6->address());
+      }
+      if (workload) {
+        return *workload;
       }
-      return {};
     }
-    IdToAddress id_to_address_;
-    AddressToWorkload address_to_workload_;
+    return nullptr;
+  }
+
+  const WorkloadDiscoveryStats* stats() const override { return &stats_; }
+
+private:
+  // Workers share the immutable index of the latest version. A superseded
+  // index is released once the last worker drops its reference.
+  struct ThreadLocalProvider : public ThreadLocal::ThreadLocalObject {
+    AddressIndexConstSharedPtr index_{std::make_shared<AddressIndex>()};
+    // On-demand requests of the worker.
+    RequestedAddresses<uint32_t> requested_ipv4_;
+    RequestedAddresses<absl::uint128> requested_ipv6_;
+    // On-demand workloads found since the last expiry, which extend their TTL.
+    UsedAddresses used_;
+    // Lookups since the last stats flush.
+    uint64_t lookup_hit_{0};
+    uint64_t lookup_miss_{0};
   };
   class WorkloadSubscription : Config::SubscriptionBase<istio::workload::Workload> {
   public:
@@ -148,82 +218,293 @@ private:
               .subscriptionFactory()
               .subscriptionFromConfigSource(parent.config_source_,
                                             Grpc::Common::typeUrl(getResourceName()),
-                                            *parent.scope_, *this, resource_decoder_, {}),
+                                            *parent.scope_, *this,
+                                            std::make_shared<WorkloadResourceDecoder>(), {}),
           Config::SubscriptionPtr);
     }
-    void start() { subscription_->start({}); }
+    void start(const absl::flat_hash_set<std::string>& names) { subscription_->start(names); }
+    void requestOnDemand(const absl::flat_hash_set<std::string>& names) {
+      subscription_->requestOnDemandUpdate(names);
+    }
+    void updateInterest(const absl::flat_hash_set<std::string>& names) {
+      subscription_->updateResourceInterest(names);
+    }
 
   private:
     // Config::SubscriptionCallbacks
+    // Only the serialized resources are copied here, they are parsed and
+    // indexed off the main thread.
     absl::Status onConfigUpdate(const std::vector<Config::DecodedResourceRef>& resources,
                                 const std::string&) override {
-      AddressToWorkloadSharedPtr index = std::make_shared<AddressToWorkload>();
-      for (const auto& resource : resources) {
-        const auto& workload =
-            dynamic_cast<const istio::workload::Workload&>(resource.get().resource());
-        const auto& metadata = convert(workload);
-        for (const auto& addr : workload.addresses()) {
-          index->emplace(addr, metadata);
-        }
-      }
-      parent_.reset(index);
+      const auto start = parent_.factory_context_.timeSource().monotonicTime();
+      parent_.stats_.full_update_.inc();
+      auto workloads = encode(resources);
+      auto& parent = parent_;
+      parent_.executor_.post([&parent, workloads, start]() {
+        parent.reset(parent.decode(*workloads), start);
+      });
       return absl::OkStatus();
     }
     absl::Status onConfigUpdate(const std::vector<Config::DecodedResourceRef>& added_resources,
                                 const Protobuf::RepeatedPtrField<std::string>& removed_resources,
                                 const std::string&) override {
-      IdToAddressSharedPtr added_ids = std::make_shared<IdToAddress>();
-      AddressToWorkloadSharedPtr added_addresses = std::make_shared<AddressToWorkload>();
-      for (const auto& resource : added_resources) {
-        const auto& workload =
-            dynamic_cast<const istio::workload::Workload&>(resource.get().resource());
-        const auto& metadata = convert(workload);
-        for (const auto& addr : workload.addresses()) {
-          added_addresses->emplace(addr, metadata);
-        }
-        added_ids->emplace(workload.uid(), std::vector<std::string>(workload.addresses().begin(),
-                                                                    workload.addresses().end()));
-      }
-      auto removed = std::make_shared<std::vector<std::string>>();
-      removed->reserve(removed_resources.size());
-      for (const auto& resource : removed_resources) {
-        removed->push_back(resource);
-      }
-      parent_.update(added_addresses, added_ids, removed);
+      const auto start = parent_.factory_context_.timeSource().monotonicTime();
+      parent_.stats_.delta_update_.inc();
+      auto added = encode(added_resources);
+      auto removed = std::make_shared<Ids>(removed_resources.begin(), removed_resources.end());
+      auto& parent = parent_;
+      parent_.executor_.post([&parent, added, removed, start]() {
+        parent.update(parent.decode(*added), *removed, start);
+      });
       return absl::OkStatus();
     }
     void onConfigUpdateFailed(Config::ConfigUpdateFailureReason, const EnvoyException*) override {
       // Do nothing - feature is automatically disabled.
       // TODO: Potential issue with the expiration of the metadata.
     }
+    static std::shared_ptr<EncodedWorkloads>
+    encode(const std::vector<Config::DecodedResourceRef>& resources) {
+      auto workloads = std::make_shared<EncodedWorkloads>();
+      workloads->reserve(resources.size());
+      for (const auto& resource : resources) {
+        workloads->emplace_back(
+            resource.get().name(),
+            dynamic_cast<const ProtobufWkt::Any&>(resource.get().resource()).value());
+      }
+      return workloads;
+    }
+
     WorkloadMetadataProviderImpl& parent_;
     Config::SubscriptionPtr subscription_;
   };
 
-  void reset(AddressToWorkloadSharedPtr index) {
-    tls_.runOnAllThreads([index](OptRef<ThreadLocalProvider> tls) { tls->reset(index); });
-    stats_.total_.set(tls_->total());
+  // Executor thread. Parses the workloads on the decoding threads. Workloads
+  // that fail to parse are dropped, as they cannot be rejected anymore.
+  Workloads decode(EncodedWorkloads& encoded) {
+    Workloads workloads(encoded.size());
+    decoders_.runAll((encoded.size() + DecodeChunk - 1) / DecodeChunk, [&](size_t chunk) {
+      const size_t end = std::min(encoded.size(), (chunk + 1) * DecodeChunk);
+      for (size_t i = chunk * DecodeChunk; i < end; i++) {
+        if (workloads[i].second.ParseFromString(encoded[i].second)) {
+          workloads[i].first = std::move(encoded[i].first);
+        }
+      }
+    });
+    const size_t size = workloads.size();
+    workloads.erase(std::remove_if(workloads.begin(), workloads.end(),
+                                   [](const auto& workload) { return workload.first.empty(); }),
+                    workloads.end());
+    if (workloads.size() < size) {
+      ENVOY_LOG_MISC(warn, "Dropped {} workloads that failed to parse", size - workloads.size());
+    }
+    return workloads;
+  }
+
+  // Executor thread.
+  void reset(const Workloads& workloads, MonotonicTime start) {
+    workloads_.reset(workloads);
+    commit(start);
+  }
+
+  // Executor thread.
+  void update(const Workloads& added, const Ids& removed, MonotonicTime start) {
+    workloads_.update(added, removed);
+    commit(start);
+  }
+
+  // Main thread, before the executor is used. Lookups are served from the
+  // snapshot until the first update is received, which drops the workloads it
+  // does not confirm. On demand, the workloads are named by address as when
+  // requested, so that their lookups extend their TTL and they are not
+  // requested again. They are not provisional, since the server sends the
+  // removals of the requested workloads it does not know.
+  void loadSnapshot() {
+    auto workloads = WorkloadDiscovery::loadSnapshot(snapshot_path_);
+    if (!workloads.ok()) {
+      ENVOY_LOG_MISC(info, "Workload index snapshot not loaded: {}", workloads.status().message());
+      return;
+    }
+    if (on_demand_) {
+      IdToWorkload by_address;
+      for (const auto& [id, entry] : *workloads) {
+        for (const auto& address : entry.addresses_) {
+          if (auto name = addressName(address); !name.empty()) {
+            by_address.insert_or_assign(std::move(name), WorkloadEntry{{address}, entry.metadata_});
+          }
+        }
+      }
+      workloads_.loadSnapshot(std::move(by_address), false);
+    } else {
+      workloads_.loadSnapshot(std::move(*workloads), true);
+    }
+    stats_.total_.set(workloads_.index()->size());
+    stats_.index_memory_bytes_.set(workloads_.memoryBytes());
+    ENVOY_LOG_MISC(info, "Loaded {} workloads from snapshot {}", workloads_.workloads().size(),
+                   snapshot_path_);
+  }
+
+  // Executor thread.
+  void writeSnapshot() {
+    if (!snapshot_dirty_) {
+      return;
+    }
+    const auto status = WorkloadDiscovery::writeSnapshot(snapshot_path_, workloads_.workloads());
+    if (!status.ok()) {
+      ENVOY_LOG_MISC(warn, "Failed to write workload index snapshot: {}", status.message());
+      return;
+    }
+    snapshot_dirty_ = false;
+  }
+
+  // Executor thread. Hands the index over to the main thread for publishing.
+  void commit(MonotonicTime start) {
+    AddressIndexConstSharedPtr index = workloads_.index();
+    snapshot_dirty_ = true;
+    stats_.total_.set(index->size());
+    stats_.index_memory_bytes_.set(workloads_.memoryBytes());
+    factory_context_.mainThreadDispatcher().post(
+        [weak_this = weak_from_this(), index, start]() {
+          if (auto self = weak_this.lock(); self) {
+            self->publish(index, start);
+          }
+        });
+  }
+
+  // Publishes a new version of the index to all workers. Only the pointer is
+  // handed over, the index itself is built once on the executor thread. The
+  // apply time is recorded once all workers have the new version.
+  void publish(AddressIndexConstSharedPtr index, MonotonicTime start) {
+    tls_.runOnAllThreads([index](OptRef<ThreadLocalProvider> tls) { tls->index_ = index; },
+                         [weak_this = weak_from_this(), start]() {
+                           if (auto self = weak_this.lock(); self) {
+                             const auto elapsed =
+                                 self->factory_context_.timeSource().monotonicTime() - start;
+                             self->stats_.update_apply_time_.recordValue(
+                                 std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
+                                     .count());
+                           }
+                         });
   }
 
-  void update(const AddressToWorkloadSharedPtr& added_addresses,
-              const IdToAddressSharedPtr& added_ids,
-              const std::shared_ptr<std::vector<std::string>> removed) {
-    tls_.runOnAllThreads([added_addresses, added_ids, removed](OptRef<ThreadLocalProvider> tls) {
-      tls->update(added_addresses, added_ids, removed);
+  // Main thread. Each worker adds its own lookup counts, so that lookups do
+  // not contend on the shared counters.
+  void flushLookupStats() {
+    tls_.runOnAllThreads([&stats = stats_](OptRef<ThreadLocalProvider> tls) {
+      stats.lookup_hit_.add(tls->lookup_hit_);
+      stats.lookup_miss_.add(tls->lookup_miss_);
+      tls->lookup_hit_ = 0;
+      tls->lookup_miss_ = 0;
     });
-    stats_.total_.set(tls_->total());
+  }
+
+  // Worker thread. Requests of an address are not repeated for the negative
+  // TTL, which bounds the requests for addresses unknown to the server. The
+  // name is only formatted for the addresses to request.
+  void requestOnDemand(const Network::Address::Ip& ip) {
+    const auto now = factory_context_.timeSource().monotonicTime();
+    auto& tls = *tls_;
+    bool request = false;
+    if (const auto ipv4 = ip.ipv4(); ipv4) {
+      request = tls.requested_ipv4_.request(ipv4->address(), now, now + negative_ttl_);
+    } else if (const auto ipv6 = ip.ipv6(); ipv6) {
+      request = tls.requested_ipv6_.request(ipv6->address(), now, now + negative_ttl_);
+    }
+    if (!request) {
+      return;
+    }
+    // Same name as addressName() of the address, the network is left empty
+    // for the default network.
+    factory_context_.mainThreadDispatcher().post(
+        [weak_this = weak_from_this(), name = absl::StrCat("/", ip.addressAsString())]() {
+          if (auto self = weak_this.lock(); self) {
+            self->subscribe(name);
+          }
+        });
+  }
+
+  // Main thread. The TTL of a workload is counted from its last request.
+  void subscribe(const std::string& name) {
+    stats_.on_demand_requests_.inc();
+    interest_.request(name, factory_context_.timeSource().monotonicTime());
+    if (!subscribed_) {
+      subscribed_ = true;
+      subscription_.start({name});
+    } else {
+      subscription_.requestOnDemand({name});
+    }
+  }
+
+  // Main thread. Collects the workloads found by the workers, then expires
+  // the others.
+  void expireInterest() {
+    struct Collected {
+      absl::Mutex mutex_;
+      UsedAddresses used_ ABSL_GUARDED_BY(mutex_);
+    };
+    auto collected = std::make_shared<Collected>();
+    tls_.runOnAllThreads(
+        [collected](OptRef<ThreadLocalProvider> tls) {
+          if (tls->used_.empty()) {
+            return;
+          }
+          UsedAddresses used;
+          std::swap(used, tls->used_);
+          absl::MutexLock lock(&collected->mutex_);
+          collected->used_.merge(used);
+        },
+        [weak_this = weak_from_this(), collected]() {
+          if (auto self = weak_this.lock(); self) {
+            absl::MutexLock lock(&collected->mutex_);
+            self->expireInterest(collected->used_);
+          }
+        });
+  }
+
+  // Main thread. Unsubscribes from the workloads not found during their TTL
+  // and drops them from the index.
+  void expireInterest(const UsedAddresses& used) {
+    const auto now = factory_context_.timeSource().monotonicTime();
+    interest_.refresh(used.names(), now);
+    auto expired = std::make_shared<Ids>(interest_.expire(now));
+    if (expired->empty()) {
+      return;
+    }
+    subscription_.updateInterest(interest_.names());
+    executor_.post([this, expired, now]() { update({}, *expired, now); });
   }
 
   WorkloadDiscoveryStats generateStats(Stats::Scope& scope) {
-    return WorkloadDiscoveryStats{WORKLOAD_DISCOVERY_STATS(POOL_GAUGE(scope))};
+    return WorkloadDiscoveryStats{
+        WORKLOAD_DISCOVERY_STATS(POOL_COUNTER(scope), POOL_GAUGE(scope), POOL_HISTOGRAM(scope))};
   }
 
   const envoy::config::core::v3::ConfigSource config_source_;
+  const std::string snapshot_path_;
+  const std::chrono::milliseconds snapshot_interval_;
+  const bool on_demand_;
+  const std::chrono::milliseconds ttl_;
+  const std::chrono::milliseconds negative_ttl_;
   Server::Configuration::ServerFactoryContext& factory_context_;
-  ThreadLocal::TypedSlot<ThreadLocalProvider> tls_;
   Stats::ScopeSharedPtr scope_;
   WorkloadDiscoveryStats stats_;
+  // Destroyed before the stats, which the callbacks still queued on the
+  // workers reference.
+  ThreadLocal::TypedSlot<ThreadLocalProvider> tls_;
+  // Executor thread only.
+  WorkloadIndex workloads_;
+  bool snapshot_dirty_{false};
+  // Main thread only. Expiry of the workloads requested on demand.
+  WorkloadInterest interest_;
+  bool subscribed_{false};
+  // Destroyed before the state above, waiting for the update in progress.
+  // The executor applies the updates in order, and waits for the decoding
+  // threads while they parse the workloads of an update.
+  WorkerPool decoders_;
+  WorkerPool executor_;
   WorkloadSubscription subscription_;
+  Event::TimerPtr snapshot_timer_;
+  Event::TimerPtr interest_timer_;
+  Event::TimerPtr lookup_stats_timer_;
 };
 
 SINGLETON_MANAGER_REGISTRATION(workload_metadata_provider)
@@ -238,8 +519,7 @@ public:
   void onServerInitialized() override {
     provider_ = factory_context_.singletonManager().getTyped<WorkloadMetadataProvider>(
         SINGLETON_MANAGER_REGISTERED_NAME(workload_metadata_provider), [&] {
-          return std::make_shared<WorkloadMetadataProviderImpl>(config_.config_source(),
-                                                                factory_context_);
+          return std::make_shared<WorkloadMetadataProviderImpl>(config_, factory_context_);
         });
   }
 
@@ -21,17 +21,42 @@
 
 namespace Envoy::Extensions::Common::WorkloadDiscovery {
 
-#define WORKLOAD_DISCOVERY_STATS(GAUGE) GAUGE(total, NeverImport)
+#define WORKLOAD_DISCOVERY_STATS(COUNTER, GAUGE, HISTOGRAM)                                        \
+  COUNTER(delta_update)                                                                            \
+  COUNTER(full_update)                                                                             \
+  COUNTER(lookup_hit)                                                                              \
+  COUNTER(lookup_miss)                                                                             \
+  COUNTER(on_demand_requests)                                                                      \
+  GAUGE(total, NeverImport)                                                                        \
+  GAUGE(index_memory_bytes, NeverImport)                                                           \
+  HISTOGRAM(update_apply_time, Milliseconds)
 
 struct WorkloadDiscoveryStats {
-  WORKLOAD_DISCOVERY_STATS(GENERATE_GAUGE_STRUCT)
+  WORKLOAD_DISCOVERY_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT,
+                           GENERATE_HISTOGRAM_STRUCT)
 };
 
+using WorkloadMetadataObjectConstSharedPtr =
+    std::shared_ptr<const Istio::Common::WorkloadMetadataObject>;
+
 class WorkloadMetadataProvider {
 public:
   virtual ~WorkloadMetadataProvider() = default;
-  virtual std::optional<Istio::Common::WorkloadMetadataObject>
+  // Returns the workload of the address, or nullptr if it is not known. The
+  // returned object is immutable and is not affected by later updates. In
+  // on-demand mode, an unknown address is requested asynchronously and
+  // nullptr is returned while the request is pending.
+  virtual WorkloadMetadataObjectConstSharedPtr
   GetMetadata(const Network::Address::InstanceConstSharedPtr& address) PURE;
+  // Main thread, for introspection. Returns the workload of the address in
+  // the index published to the main thread, without counting the lookup or
+  // requesting an unknown address.
+  virtual WorkloadMetadataObjectConstSharedPtr
+  peekMetadata(const Network::Address::InstanceConstSharedPtr&) {
+    return nullptr;
+  }
+  // Returns the stats of the provider, or nullptr if it has none.
+  virtual const WorkloadDiscoveryStats* stats() const { return nullptr; }
 };
 
 using WorkloadMetadataProviderSharedPtr = std::shared_ptr<WorkloadMetadataProvider>;
@@ -0,0 +1,293 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/api.h"
+
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "envoy/registry/registry.h"
+#include "envoy/server/bootstrap_extension_config.h"
+#include "source/common/config/decoded_resource_impl.h"
+#include "source/common/network/utility.h"
+#include "source/extensions/common/workload_discovery/discovery.pb.h"
+#include "source/extensions/common/workload_discovery/extension.pb.h"
+#include "source/extensions/common/workload_discovery/workload_interner.h"
+#include "source/extensions/common/workload_discovery/workload_snapshot.h"
+#include "test/mocks/config/mocks.h"
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/server/server_factory_context.h"
+#include "test/test_common/environment.h"
+#include "test/test_common/simulated_time_system.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::ReturnRef;
+using testing::UnorderedElementsAre;
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+namespace {
+
+istio::workload::Workload makeWorkload(const std::string& name, const std::string& address) {
+  istio::workload::Workload workload;
+  workload.set_name(name);
+  workload.set_uid(absl::StrCat("Kubernetes//Pod/default/", name));
+  workload.set_namespace_("default");
+  workload.set_workload_name(name);
+  workload.set_cluster_id("Kubernetes");
+  workload.add_addresses(address);
+  return workload;
+}
+
+const std::string Ratings("\x0a\x00\x00\x01", 4);
+const std::string Reviews("\x0a\x00\x00\x02", 4);
+const std::string Details("\x0a\x00\x00\x03", 4);
+
+// Drives the provider of the bootstrap extension through the subscription
+// callbacks. The thread local slot and the timers are the ones of the mocks,
+// the executor and the decoding threads are real.
+class WorkloadDiscoveryTest : public testing::Test {
+protected:
+  WorkloadDiscoveryTest() {
+    ON_CALL(context_, timeSource()).WillByDefault(ReturnRef(time_system_));
+    // Callbacks posted to the main thread are run by runPosted().
+    ON_CALL(context_.dispatcher_, post(_)).WillByDefault(Invoke([this](Event::PostCb callback) {
+      absl::MutexLock lock(&mutex_);
+      posted_.push_back(std::move(callback));
+    }));
+    ON_CALL(context_.cluster_manager_.subscription_factory_,
+            subscriptionFromConfigSource(_, _, _, _, _, _))
+        .WillByDefault(Invoke(
+            [this](const envoy::config::core::v3::ConfigSource&, absl::string_view, Stats::Scope&,
+                   Config::SubscriptionCallbacks& callbacks,
+                   Config::OpaqueResourceDecoderSharedPtr decoder,
+                   const Config::SubscriptionOptions&) -> absl::StatusOr<Config::SubscriptionPtr> {
+              auto subscription = std::make_unique<NiceMock<Config::MockSubscription>>();
+              subscription_ = subscription.get();
+              callbacks_ = &callbacks;
+              decoder_ = std::move(decoder);
+              return subscription;
+            }));
+  }
+
+  void initialize(bool on_demand, const std::string& snapshot_path = "") {
+    // Timers are created in the reverse order of their mocks.
+    if (on_demand) {
+      interest_timer_ = new NiceMock<Event::MockTimer>(&context_.dispatcher_);
+    }
+    stats_timer_ = new NiceMock<Event::MockTimer>(&context_.dispatcher_);
+    if (!snapshot_path.empty()) {
+      new NiceMock<Event::MockTimer>(&context_.dispatcher_);
+    }
+    istio::workload::BootstrapExtension config;
+    if (on_demand) {
+      config.mutable_on_demand();
+    }
+    config.set_snapshot_path(snapshot_path);
+    auto* factory =
+        Registry::FactoryRegistry<Server::Configuration::BootstrapExtensionFactory>::getFactory(
+            "envoy.bootstrap.workload_discovery");
+    extension_ = factory->createBootstrapExtension(config, context_);
+    extension_->onServerInitialized();
+    provider_ = GetProvider(context_);
+    ASSERT_NE(nullptr, provider_);
+  }
+
+  void sendState(const std::vector<istio::workload::Workload>& workloads) {
+    std::vector<Config::DecodedResourcePtr> resources;
+    std::vector<Config::DecodedResourceRef> refs;
+    for (const auto& workload : workloads) {
+      ProtobufWkt::Any any;
+      any.PackFrom(workload);
+      resources.push_back(Config::DecodedResourceImpl::fromResource(*decoder_, any, "1"));
+      refs.emplace_back(*resources.back());
+    }
+    ASSERT_TRUE(callbacks_->onConfigUpdate(refs, "1").ok());
+  }
+
+  void sendDelta(const std::vector<istio::workload::Workload>& added,
+                 const std::vector<std::string>& removed) {
+    std::vector<Config::DecodedResourcePtr> resources;
+    std::vector<Config::DecodedResourceRef> refs;
+    for (const auto& workload : added) {
+      envoy::service::discovery::v3::Resource resource;
+      resource.set_name(workload.uid());
+      resource.mutable_resource()->PackFrom(workload);
+      resources.push_back(Config::DecodedResourceImpl::fromResource(*decoder_, resource));
+      refs.emplace_back(*resources.back());
+    }
+    Protobuf::RepeatedPtrField<std::string> removed_resources;
+    for (const auto& name : removed) {
+      *removed_resources.Add() = name;
+    }
+    ASSERT_TRUE(callbacks_->onConfigUpdate(refs, removed_resources, "2").ok());
+  }
+
+  // Waits for a callback posted to the main thread, then runs the callbacks
+  // posted so far.
+  void runPosted() {
+    std::vector<Event::PostCb> posted;
+    {
+      absl::MutexLock lock(&mutex_);
+      ASSERT_TRUE(mutex_.AwaitWithTimeout(
+          absl::Condition(+[](std::vector<Event::PostCb>* posted) { return !posted->empty(); },
+                          &posted_),
+          absl::Seconds(10)));
+      std::swap(posted, posted_);
+    }
+    for (auto& callback : posted) {
+      callback();
+    }
+  }
+
+  bool hasPosted() {
+    absl::MutexLock lock(&mutex_);
+    return !posted_.empty();
+  }
+
+  WorkloadMetadataObjectConstSharedPtr lookup(const std::string& address) {
+    return provider_->GetMetadata(Network::Utility::parseInternetAddressNoThrow(address));
+  }
+
+  Event::SimulatedTimeSystem time_system_;
+  absl::Mutex mutex_;
+  std::vector<Event::PostCb> posted_ ABSL_GUARDED_BY(mutex_);
+  NiceMock<Server::Configuration::MockServerFactoryContext> context_;
+  Config::MockSubscription* subscription_{};
+  Config::SubscriptionCallbacks* callbacks_{};
+  Config::OpaqueResourceDecoderSharedPtr decoder_;
+  Event::MockTimer* interest_timer_{};
+  Event::MockTimer* stats_timer_{};
+  Server::BootstrapExtensionPtr extension_;
+  WorkloadMetadataProviderSharedPtr provider_;
+};
+
+TEST_F(WorkloadDiscoveryTest, StateOfTheWorldUpdate) {
+  initialize(false);
+  EXPECT_EQ(nullptr, lookup("10.0.0.1"));
+
+  sendState({makeWorkload("ratings", Ratings), makeWorkload("reviews", Reviews)});
+  // The index is built on the executor, and published from the main thread.
+  runPosted();
+  const auto ratings = lookup("10.0.0.1");
+  ASSERT_NE(nullptr, ratings);
+  EXPECT_EQ("ratings", ratings->workload_name_);
+  EXPECT_NE(nullptr, lookup("10.0.0.2"));
+  EXPECT_EQ(1, provider_->stats()->full_update_.value());
+  EXPECT_EQ(2, provider_->stats()->total_.value());
+}
+
+TEST_F(WorkloadDiscoveryTest, DeltaUpdate) {
+  initialize(false);
+  const auto ratings = makeWorkload("ratings", Ratings);
+  sendDelta({ratings, makeWorkload("reviews", Reviews)}, {});
+  runPosted();
+  EXPECT_NE(nullptr, lookup("10.0.0.1"));
+
+  sendDelta({makeWorkload("details", Details)}, {ratings.uid()});
+  runPosted();
+  EXPECT_EQ(nullptr, lookup("10.0.0.1"));
+  EXPECT_NE(nullptr, lookup("10.0.0.2"));
+  EXPECT_NE(nullptr, lookup("10.0.0.3"));
+  EXPECT_EQ(2, provider_->stats()->delta_update_.value());
+  EXPECT_EQ(2, provider_->stats()->total_.value());
+}
+
+TEST_F(WorkloadDiscoveryTest, StateOfTheWorldDropsInvalidWorkloads) {
+  initialize(false);
+  ProtobufWkt::Any invalid;
+  invalid.set_type_url("type.googleapis.com/istio.workload.Workload");
+  invalid.set_value("\xff\xff");
+  const auto resource = Config::DecodedResourceImpl::fromResource(*decoder_, invalid, "1");
+  const auto ratings = makeWorkload("ratings", Ratings);
+  ProtobufWkt::Any any;
+  any.PackFrom(ratings);
+  const auto valid = Config::DecodedResourceImpl::fromResource(*decoder_, any, "1");
+  EXPECT_EQ(ratings.uid(), valid->name());
+  ASSERT_TRUE(callbacks_->onConfigUpdate({*resource, *valid}, "1").ok());
+  runPosted();
+  EXPECT_NE(nullptr, lookup("10.0.0.1"));
+  EXPECT_EQ(1, provider_->stats()->total_.value());
+}
+
+TEST_F(WorkloadDiscoveryTest, OnDemandRequestsAfterNegativeTtl) {
+  initialize(true);
+  EXPECT_CALL(*subscription_, start(UnorderedElementsAre("/10.0.0.1")));
+  EXPECT_EQ(nullptr, lookup("10.0.0.1"));
+  runPosted();
+  EXPECT_EQ(1, provider_->stats()->on_demand_requests_.value());
+
+  // Not requested again until the negative TTL elapses.
+  EXPECT_EQ(nullptr, lookup("10.0.0.1"));
+  EXPECT_FALSE(hasPosted());
+  time_system_.setMonotonicTime(time_system_.monotonicTime() + std::chrono::seconds(31));
+  EXPECT_CALL(*subscription_, requestOnDemandUpdate(UnorderedElementsAre("/10.0.0.1")));
+  EXPECT_EQ(nullptr, lookup("10.0.0.1"));
+  runPosted();
+  EXPECT_EQ(2, provider_->stats()->on_demand_requests_.value());
+
+  sendDelta({makeWorkload("ratings", Ratings)}, {});
+  runPosted();
+  EXPECT_NE(nullptr, lookup("10.0.0.1"));
+}
+
+TEST_F(WorkloadDiscoveryTest, OnDemandSnapshotIsNamedByAddress) {
+  // Written by a state of the world subscription, by uid.
+  IdToWorkload snapshot;
+  const auto ratings = makeWorkload("ratings", Ratings);
+  snapshot[ratings.uid()] = WorkloadEntry{
+      {Ratings}, std::make_shared<const Istio::Common::WorkloadMetadataObject>(convert(ratings))};
+  const auto path = TestEnvironment::temporaryPath("workload_discovery_on_demand.snapshot");
+  ASSERT_TRUE(writeSnapshot(path, snapshot).ok());
+  initialize(true, path);
+
+  // The lookups of the snapshot workload extend its TTL, and do not request
+  // it again.
+  EXPECT_CALL(*subscription_, updateResourceInterest(_)).Times(0);
+  for (int minute = 1; minute <= 10; minute++) {
+    time_system_.setMonotonicTime(time_system_.monotonicTime() + std::chrono::minutes(1));
+    EXPECT_NE(nullptr, lookup("10.0.0.1"));
+    interest_timer_->invokeCallback();
+  }
+  EXPECT_FALSE(hasPosted());
+  EXPECT_EQ(0, provider_->stats()->on_demand_requests_.value());
+
+  // It is not provisional, the first update keeps it.
+  sendDelta({makeWorkload("reviews", Reviews)}, {});
+  runPosted();
+  EXPECT_NE(nullptr, lookup("10.0.0.1"));
+  EXPECT_NE(nullptr, lookup("10.0.0.2"));
+}
+
+TEST_F(WorkloadDiscoveryTest, FlushesLookupStats) {
+  initialize(false);
+  sendState({makeWorkload("ratings", Ratings)});
+  runPosted();
+  EXPECT_NE(nullptr, lookup("10.0.0.1"));
+  EXPECT_EQ(nullptr, lookup("10.0.0.2"));
+  EXPECT_EQ(nullptr, lookup("10.0.0.3"));
+  // Workers count the lookups until the stats flush.
+  EXPECT_EQ(0, provider_->stats()->lookup_hit_.value());
+  stats_timer_->invokeCallback();
+  EXPECT_EQ(1, provider_->stats()->lookup_hit_.value());
+  EXPECT_EQ(2, provider_->stats()->lookup_miss_.value());
+}
+
+} // namespace
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
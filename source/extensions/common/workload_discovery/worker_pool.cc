@@ -0,0 +1,73 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/worker_pool.h"
+
+#include "absl/synchronization/blocking_counter.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+
+WorkerPool::WorkerPool(Thread::ThreadFactory& thread_factory, size_t threads) {
+  threads_.reserve(threads);
+  for (size_t i = 0; i < threads; i++) {
+    threads_.push_back(thread_factory.createThread([this]() { run(); }));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopped_ = true;
+  }
+  for (auto& thread : threads_) {
+    thread->join();
+  }
+}
+
+void WorkerPool::post(std::function<void()> callback) {
+  absl::MutexLock lock(&mutex_);
+  queue_.push_back(std::move(callback));
+}
+
+void WorkerPool::runAll(size_t tasks, const std::function<void(size_t)>& task) {
+  if (tasks == 0) {
+    return;
+  }
+  absl::BlockingCounter done(tasks);
+  for (size_t i = 0; i < tasks; i++) {
+    post([&task, &done, i]() {
+      task(i);
+      done.DecrementCount();
+    });
+  }
+  done.Wait();
+}
+
+void WorkerPool::run() {
+  while (true) {
+    std::function<void()> callback;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(this, &WorkerPool::ready));
+      if (stopped_) {
+        return;
+      }
+      callback = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    callback();
+  }
+}
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
@@ -0,0 +1,52 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "envoy/thread/thread.h"
+#include "source/common/common/non_copyable.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+
+// Runs callbacks on a fixed set of dedicated threads. Callbacks are started
+// in order of posting, with a single thread each one completes before the
+// next one starts.
+class WorkerPool : NonCopyable {
+public:
+  WorkerPool(Thread::ThreadFactory& thread_factory, size_t threads);
+  // Drops the callbacks not started yet and waits for the running ones.
+  ~WorkerPool();
+
+  void post(std::function<void()> callback);
+
+  // Runs task(0) to task(tasks - 1) on the pool and waits for all of them.
+  // Must not be called from a thread of the pool.
+  void runAll(size_t tasks, const std::function<void(size_t)>& task);
+
+private:
+  bool ready() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) { return stopped_ || !queue_.empty(); }
+  void run();
+
+  absl::Mutex mutex_;
+  std::deque<std::function<void()>> queue_ ABSL_GUARDED_BY(mutex_);
+  bool stopped_ ABSL_GUARDED_BY(mutex_){false};
+  std::vector<Thread::ThreadPtr> threads_;
+};
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
@@ -0,0 +1,219 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <random>
+
+#include "absl/base/internal/endian.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "benchmark/benchmark.h"
+#include "envoy/registry/registry.h"
+#include "envoy/server/bootstrap_extension_config.h"
+#include "source/common/network/utility.h"
+#include "source/extensions/common/workload_discovery/api.h"
+#include "source/extensions/common/workload_discovery/extension.pb.h"
+#include "source/extensions/common/workload_discovery/workload_index.h"
+#include "source/extensions/common/workload_discovery/workload_interner.h"
+#include "source/extensions/common/workload_discovery/workload_snapshot.h"
+#include "test/common/stats/stat_test_utility.h"
+#include "test/mocks/server/server_factory_context.h"
+#include "test/test_common/environment.h"
+
+using testing::NiceMock;
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+namespace {
+
+// Changes applied by a delta update.
+constexpr size_t DeltaSize = 100;
+
+std::string ipv4Address(uint32_t i) {
+  const uint32_t address = absl::ghtonl(0x0a000000 + i);
+  return std::string(reinterpret_cast<const char*>(&address), sizeof(address));
+}
+
+std::string ipv6Address(uint32_t i) {
+  std::string address(16, '\0');
+  address[0] = static_cast<char>(0xfd);
+  const uint32_t suffix = absl::ghtonl(i);
+  memcpy(address.data() + 12, &suffix, sizeof(suffix));
+  return address;
+}
+
+// Dual stack replica of one of n / 10 deployments spread over a hundred
+// namespaces.
+istio::workload::Workload makeWorkload(uint32_t i) {
+  istio::workload::Workload workload;
+  const uint32_t deployment = i / 10;
+  const auto ns = absl::StrCat("namespace-", deployment % 100);
+  const auto name = absl::StrCat("deployment-", deployment);
+  workload.set_name(absl::StrCat(name, "-84975bc778-", i));
+  workload.set_uid(absl::StrCat("Kubernetes//Pod/", ns, "/", workload.name()));
+  workload.set_namespace_(ns);
+  workload.set_workload_name(name);
+  workload.set_canonical_name(name);
+  workload.set_canonical_revision("v1");
+  workload.set_cluster_id("Kubernetes");
+  workload.set_service_account(name);
+  workload.set_workload_type(istio::workload::WorkloadType::DEPLOYMENT);
+  workload.add_addresses(ipv4Address(i + 1));
+  workload.add_addresses(ipv6Address(i + 1));
+  return workload;
+}
+
+// Workloads by uid are generated once per size, outside of the measurements.
+const Workloads& workloads(size_t n) {
+  static auto* sets = new std::map<size_t, Workloads>();
+  auto& set = (*sets)[n];
+  if (set.empty()) {
+    set.reserve(n);
+    for (uint32_t i = 0; i < n; i++) {
+      auto workload = makeWorkload(i);
+      set.emplace_back(workload.uid(), std::move(workload));
+    }
+  }
+  return set;
+}
+
+// Address of the i-th workload, as read from a connection.
+Network::Address::InstanceConstSharedPtr address(uint32_t i, bool ipv6) {
+  if (ipv6) {
+    return Network::Utility::parseInternetAddressNoThrow(
+        absl::StrFormat("fd00::%x:%x", i >> 16, i & 0xffff));
+  }
+  const uint32_t address = 0x0a000000 + i;
+  return Network::Utility::parseInternetAddressNoThrow(absl::StrCat(
+      address >> 24, ".", (address >> 16) & 0xff, ".", (address >> 8) & 0xff, ".", address & 0xff));
+}
+
+// Provider of the bootstrap extension serving the workloads from a snapshot,
+// as at startup before the first update.
+class ProviderBenchmark {
+public:
+  explicit ProviderBenchmark(const Workloads& set) {
+    IdToWorkload snapshot;
+    for (const auto& [uid, workload] : set) {
+      snapshot[uid] = WorkloadEntry{
+          {workload.addresses().begin(), workload.addresses().end()},
+          std::make_shared<const Istio::Common::WorkloadMetadataObject>(convert(workload))};
+    }
+    const auto path = TestEnvironment::temporaryPath("workload_discovery_speed_test.snapshot");
+    const auto status = writeSnapshot(path, snapshot);
+    RELEASE_ASSERT(status.ok(), std::string(status.message()));
+
+    istio::workload::BootstrapExtension config;
+    config.set_snapshot_path(path);
+    auto* factory =
+        Registry::FactoryRegistry<Server::Configuration::BootstrapExtensionFactory>::getFactory(
+            "envoy.bootstrap.workload_discovery");
+    extension_ = factory->createBootstrapExtension(config, context_);
+    extension_->onServerInitialized();
+    provider_ = GetProvider(context_);
+  }
+
+  WorkloadMetadataProvider& provider() { return *provider_; }
+
+private:
+  NiceMock<Server::Configuration::MockServerFactoryContext> context_;
+  Server::BootstrapExtensionPtr extension_;
+  WorkloadMetadataProviderSharedPtr provider_;
+};
+
+} // namespace
+
+// Arguments: number of workloads. Replaces all the workloads, as a state of
+// the world update does on the executor thread.
+static void BM_FullUpdate(benchmark::State& state) {
+  const auto& set = workloads(state.range(0));
+  size_t bytes = 0;
+  for (auto _ : state) { // NOLINT
+    Stats::TestUtil::MemoryTest memory_test;
+    WorkloadIndex index;
+    index.reset(set);
+    bytes = memory_test.consumedBytes();
+    benchmark::DoNotOptimize(index.index());
+  }
+  state.SetItemsProcessed(state.iterations() * set.size());
+  // Workers share the index, so this is also the memory of each worker.
+  state.counters["bytes_per_workload"] = static_cast<double>(bytes) / set.size();
+}
+BENCHMARK(BM_FullUpdate)
+    ->Arg(10000)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Arguments: number of workloads. Each delta replaces DeltaSize workloads by
+// as many others, alternating between two sets to keep the size constant.
+static void BM_DeltaUpdate(benchmark::State& state) {
+  const auto& set = workloads(state.range(0));
+  WorkloadIndex index;
+  index.reset(set);
+  Workloads deltas[2];
+  Ids ids[2];
+  for (uint32_t i = 0; i < DeltaSize; i++) {
+    auto workload = makeWorkload(set.size() + i);
+    deltas[0].emplace_back(set[i]);
+    ids[0].push_back(set[i].first);
+    ids[1].push_back(workload.uid());
+    deltas[1].emplace_back(workload.uid(), std::move(workload));
+  }
+  size_t next = 1;
+  for (auto _ : state) { // NOLINT
+    index.update(deltas[next], ids[1 - next]);
+    next = 1 - next;
+    benchmark::DoNotOptimize(index.index());
+  }
+  state.SetItemsProcessed(state.iterations() * 2 * DeltaSize);
+}
+BENCHMARK(BM_DeltaUpdate)
+    ->Arg(10000)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+// Arguments: number of workloads, IPv6 and hit. Looks up the peer of a
+// connection as the filters do, including the read of the thread local index
+// and the lookup counts. The thread local slot is the one of the mocks.
+static void BM_Lookup(benchmark::State& state) {
+  const auto& set = workloads(state.range(0));
+  const bool ipv6 = state.range(1);
+  const bool hit = state.range(2);
+  ProviderBenchmark bench(set);
+  auto& provider = bench.provider();
+  // Random addresses defeat the caches as lookups of peers do.
+  std::mt19937 random(0);
+  std::uniform_int_distribution<uint32_t> distribution(1, set.size());
+  const uint32_t offset = hit ? 0 : set.size();
+  std::vector<Network::Address::InstanceConstSharedPtr> addresses;
+  for (size_t i = 0; i < 4096; i++) {
+    addresses.push_back(address(distribution(random) + offset, ipv6));
+  }
+  size_t i = 0;
+  size_t found = 0;
+  for (auto _ : state) { // NOLINT
+    const auto workload = provider.GetMetadata(addresses[i++ % addresses.size()]);
+    found += workload != nullptr;
+    benchmark::DoNotOptimize(workload);
+  }
+  if (found != (hit ? state.iterations() : 0)) {
+    state.SkipWithError("unexpected lookup result");
+  }
+}
+BENCHMARK(BM_Lookup)->ArgsProduct({{10000, 100000, 1000000}, {0, 1}, {0, 1}});
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
@@ -0,0 +1,108 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/workload_index.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+
+void WorkloadIndex::loadSnapshot(IdToWorkload workloads, bool provisional) {
+  AddressIndexSharedPtr index = std::make_shared<AddressIndex>();
+  provisional_.clear();
+  for (const auto& [id, entry] : workloads) {
+    for (const auto& address : entry.addresses_) {
+      index->insert(address, entry.metadata_);
+    }
+    if (provisional) {
+      provisional_.insert(id);
+    }
+  }
+  id_to_workload_ = std::move(workloads);
+  index_ = index;
+}
+
+void WorkloadIndex::reset(const Workloads& workloads) {
+  AddressIndexSharedPtr index = std::make_shared<AddressIndex>();
+  for (const auto& [id, entry] : id_to_workload_) {
+    interner_.release(*entry.metadata_);
+  }
+  id_to_workload_.clear();
+  provisional_.clear();
+  for (const auto& [name, workload] : workloads) {
+    add(*index, name, workload);
+  }
+  index_ = index;
+  interner_.sweep();
+}
+
+void WorkloadIndex::update(const Workloads& added, const Ids& removed) {
+  // Shards of the index not changed by the delta are shared with the
+  // previous version.
+  AddressIndexSharedPtr index = std::make_shared<AddressIndex>(*index_);
+  for (const auto& id : removed) {
+    remove(*index, id);
+  }
+  if (!provisional_.empty()) {
+    // The first update after a snapshot confirms the workloads it sends.
+    for (const auto& [name, _] : added) {
+      provisional_.erase(name);
+    }
+    for (const auto& id : provisional_) {
+      remove(*index, id);
+    }
+    provisional_.clear();
+  }
+  for (const auto& [name, workload] : added) {
+    // A workload sent again replaces its addresses.
+    remove(*index, name);
+    add(*index, name, workload);
+  }
+  index_ = index;
+  interner_.sweepReleased();
+}
+
+void WorkloadIndex::add(AddressIndex& index, const std::string& name,
+                        const istio::workload::Workload& workload) {
+  const auto metadata = interner_.intern(workload);
+  for (const auto& addr : workload.addresses()) {
+    index.insert(addr, metadata);
+  }
+  id_to_workload_.insert_or_assign(
+      name, WorkloadEntry{{workload.addresses().begin(), workload.addresses().end()}, metadata});
+}
+
+void WorkloadIndex::remove(AddressIndex& index, const std::string& name) {
+  const auto it = id_to_workload_.find(name);
+  if (it == id_to_workload_.end()) {
+    return;
+  }
+  for (const auto& address : it->second.addresses_) {
+    index.erase(address);
+  }
+  interner_.release(*it->second.metadata_);
+  id_to_workload_.erase(it);
+}
+
+size_t WorkloadIndex::memoryBytes() const {
+  size_t bytes = index_->memoryBytes() + interner_.memoryBytes() +
+                 id_to_workload_.capacity() * (sizeof(IdToWorkload::value_type) + 1);
+  for (const auto& [id, entry] : id_to_workload_) {
+    bytes += id.size() + WorkloadInterner::memoryBytes(*entry.metadata_);
+    for (const auto& address : entry.addresses_) {
+      bytes += sizeof(address) + address.size();
+    }
+  }
+  return bytes;
+}
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
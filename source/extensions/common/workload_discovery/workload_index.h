@@ -0,0 +1,70 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "source/extensions/common/workload_discovery/address_index.h"
+#include "source/extensions/common/workload_discovery/discovery.pb.h"
+#include "source/extensions/common/workload_discovery/workload_interner.h"
+#include "source/extensions/common/workload_discovery/workload_snapshot.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+
+// Workloads by resource name, which is the uid unless requested on demand.
+using Workloads = std::vector<std::pair<std::string, istio::workload::Workload>>;
+using Ids = std::vector<std::string>;
+
+// Workloads of the discovery by resource name, with the address index of the
+// latest version. Each change builds a new index sharing the unchanged shards
+// of the previous one, the previous versions are left unchanged for the
+// workers still reading them. Not thread safe.
+class WorkloadIndex {
+public:
+  // Serves the workloads of a snapshot. Provisional workloads are served
+  // until the first update: those not confirmed by it are dropped, since the
+  // server does not send the removals of the workloads deleted while the
+  // proxy was down.
+  void loadSnapshot(IdToWorkload workloads, bool provisional);
+
+  // Replaces all the workloads.
+  void reset(const Workloads& workloads);
+
+  // Adds and removes workloads.
+  void update(const Workloads& added, const Ids& removed);
+
+  const AddressIndexConstSharedPtr& index() const { return index_; }
+  const IdToWorkload& workloads() const { return id_to_workload_; }
+  // Number of snapshot workloads not confirmed yet.
+  size_t provisional() const { return provisional_.size(); }
+
+  // Estimated bytes held by the latest version of the index.
+  size_t memoryBytes() const;
+
+private:
+  void add(AddressIndex& index, const std::string& name,
+           const istio::workload::Workload& workload);
+  void remove(AddressIndex& index, const std::string& name);
+
+  AddressIndexConstSharedPtr index_{std::make_shared<AddressIndex>()};
+  IdToWorkload id_to_workload_;
+  WorkloadInterner interner_;
+  absl::flat_hash_set<std::string> provisional_;
+};
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
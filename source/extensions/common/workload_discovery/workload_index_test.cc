@@ -0,0 +1,153 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/workload_index.h"
+
+#include "absl/strings/str_cat.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+namespace {
+
+istio::workload::Workload makeWorkload(const std::string& name, const std::string& address) {
+  istio::workload::Workload workload;
+  workload.set_name(name);
+  workload.set_uid(absl::StrCat("Kubernetes//Pod/default/", name));
+  workload.set_namespace_("default");
+  workload.set_workload_name(name);
+  workload.set_cluster_id("Kubernetes");
+  workload.add_addresses(address);
+  return workload;
+}
+
+const std::string Ratings("\x0a\x00\x00\x01", 4);
+const std::string Reviews("\x0a\x00\x00\x02", 4);
+const std::string Details("\x0a\x00\x00\x03", 4);
+
+IdToWorkload makeSnapshot() {
+  IdToWorkload workloads;
+  for (const auto& workload :
+       {makeWorkload("ratings", Ratings), makeWorkload("reviews", Reviews)}) {
+    workloads[workload.uid()] = WorkloadEntry{
+        {workload.addresses().begin(), workload.addresses().end()},
+        std::make_shared<const Istio::Common::WorkloadMetadataObject>(convert(workload))};
+  }
+  return workloads;
+}
+
+const WorkloadMetadataObjectConstSharedPtr* find(const AddressIndex& index,
+                                                 absl::string_view address) {
+  uint32_t key;
+  memcpy(&key, address.data(), sizeof(key));
+  return index.findIpv4(key);
+}
+
+const WorkloadMetadataObjectConstSharedPtr* find(const WorkloadIndex& index,
+                                                 absl::string_view address) {
+  return find(*index.index(), address);
+}
+
+TEST(WorkloadIndexTest, UpdateDropsUnconfirmedSnapshotWorkloads) {
+  WorkloadIndex index;
+  index.loadSnapshot(makeSnapshot(), true);
+  EXPECT_EQ(2, index.provisional());
+  ASSERT_NE(nullptr, find(index, Ratings));
+  ASSERT_NE(nullptr, find(index, Reviews));
+
+  // Only ratings is sent again, reviews was deleted while the proxy was down.
+  const auto ratings = makeWorkload("ratings", Ratings);
+  const auto details = makeWorkload("details", Details);
+  index.update({{ratings.uid(), ratings}, {details.uid(), details}}, {});
+  EXPECT_EQ(0, index.provisional());
+  EXPECT_NE(nullptr, find(index, Ratings));
+  EXPECT_EQ(nullptr, find(index, Reviews));
+  EXPECT_NE(nullptr, find(index, Details));
+  EXPECT_EQ(2, index.workloads().size());
+  EXPECT_FALSE(index.workloads().contains("Kubernetes//Pod/default/reviews"));
+
+  // Later updates only apply their changes.
+  index.update({}, {details.uid()});
+  EXPECT_NE(nullptr, find(index, Ratings));
+  EXPECT_EQ(nullptr, find(index, Details));
+}
+
+TEST(WorkloadIndexTest, UpdateKeepsConfirmedSnapshotWorkloads) {
+  WorkloadIndex index;
+  index.loadSnapshot(makeSnapshot(), false);
+  EXPECT_EQ(0, index.provisional());
+  const auto details = makeWorkload("details", Details);
+  index.update({{details.uid(), details}}, {});
+  EXPECT_NE(nullptr, find(index, Ratings));
+  EXPECT_NE(nullptr, find(index, Reviews));
+  EXPECT_NE(nullptr, find(index, Details));
+}
+
+TEST(WorkloadIndexTest, ResetReplacesSnapshot) {
+  WorkloadIndex index;
+  index.loadSnapshot(makeSnapshot(), true);
+  const auto details = makeWorkload("details", Details);
+  index.reset({{details.uid(), details}});
+  EXPECT_EQ(0, index.provisional());
+  EXPECT_EQ(nullptr, find(index, Ratings));
+  EXPECT_NE(nullptr, find(index, Details));
+  EXPECT_EQ(1, index.workloads().size());
+}
+
+TEST(WorkloadIndexTest, UpdateKeepsPreviousVersions) {
+  WorkloadIndex index;
+  const auto ratings = makeWorkload("ratings", Ratings);
+  index.update({{ratings.uid(), ratings}}, {});
+  const auto previous = index.index();
+  index.update({}, {ratings.uid()});
+  EXPECT_NE(nullptr, find(*previous, Ratings));
+  EXPECT_EQ(nullptr, find(index, Ratings));
+}
+
+TEST(WorkloadIndexTest, UpdateReplacesAddresses) {
+  WorkloadIndex index;
+  const auto ratings = makeWorkload("ratings", Ratings);
+  index.update({{ratings.uid(), ratings}}, {});
+  auto moved = makeWorkload("ratings", Reviews);
+  index.update({{moved.uid(), moved}}, {});
+  EXPECT_EQ(nullptr, find(index, Ratings));
+  EXPECT_NE(nullptr, find(index, Reviews));
+  EXPECT_EQ(1, index.index()->size());
+}
+
+TEST(WorkloadIndexTest, UpdateSharesUnchangedAddresses) {
+  WorkloadIndex index;
+  Workloads workloads;
+  std::vector<std::string> addresses;
+  for (uint8_t i = 0; i < 100; i++) {
+    addresses.push_back(std::string("\x0a\x01\x00", 3) + static_cast<char>(i));
+    auto workload = makeWorkload(absl::StrCat("ratings-", i), addresses.back());
+    workloads.emplace_back(workload.uid(), workload);
+  }
+  index.reset(workloads);
+  const auto previous = index.index();
+  index.update({}, {workloads[0].first});
+  EXPECT_EQ(99, index.index()->size());
+
+  // Only the shard of the removed address is copied.
+  size_t shared = 0;
+  for (const auto& address : addresses) {
+    shared += find(*previous, address) == find(index, address);
+  }
+  EXPECT_GE(shared, 95);
+}
+
+} // namespace
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
@@ -0,0 +1,93 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/workload_interest.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+
+std::string addressName(absl::string_view address) {
+  // Same text as the address strings of the Envoy IP addresses, which keep
+  // the address bytes in network order.
+  char buffer[INET6_ADDRSTRLEN];
+  const char* text = nullptr;
+  if (address.size() == sizeof(in_addr)) {
+    in_addr addr;
+    memcpy(&addr, address.data(), sizeof(addr));
+    text = inet_ntop(AF_INET, &addr, buffer, sizeof(buffer));
+  } else if (address.size() == sizeof(in6_addr)) {
+    in6_addr addr;
+    memcpy(&addr, address.data(), sizeof(addr));
+    text = inet_ntop(AF_INET6, &addr, buffer, sizeof(buffer));
+  }
+  // The network is left empty for the default network.
+  return text != nullptr ? absl::StrCat("/", text) : "";
+}
+
+void UsedAddresses::merge(const UsedAddresses& other) {
+  ipv4_.insert(other.ipv4_.begin(), other.ipv4_.end());
+  ipv6_.insert(other.ipv6_.begin(), other.ipv6_.end());
+}
+
+std::vector<std::string> UsedAddresses::names() const {
+  std::vector<std::string> names;
+  names.reserve(ipv4_.size() + ipv6_.size());
+  for (const uint32_t& address : ipv4_) {
+    names.push_back(
+        addressName(absl::string_view(reinterpret_cast<const char*>(&address), sizeof(address))));
+  }
+  for (const absl::uint128& address : ipv6_) {
+    names.push_back(
+        addressName(absl::string_view(reinterpret_cast<const char*>(&address), sizeof(address))));
+  }
+  return names;
+}
+
+void WorkloadInterest::refresh(const std::vector<std::string>& names, MonotonicTime now) {
+  for (const auto& name : names) {
+    if (const auto it = expiry_.find(name); it != expiry_.end()) {
+      it->second = std::max(it->second, now + ttl_);
+    }
+  }
+}
+
+std::vector<std::string> WorkloadInterest::expire(MonotonicTime now) {
+  std::vector<std::string> expired;
+  for (auto it = expiry_.begin(); it != expiry_.end();) {
+    if (it->second <= now) {
+      expired.push_back(it->first);
+      expiry_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  return expired;
+}
+
+absl::flat_hash_set<std::string> WorkloadInterest::names() const {
+  absl::flat_hash_set<std::string> names;
+  names.reserve(expiry_.size());
+  for (const auto& [name, _] : expiry_) {
+    names.insert(name);
+  }
+  return names;
+}
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
@@ -0,0 +1,98 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/numeric/int128.h"
+#include "absl/strings/string_view.h"
+#include "envoy/common/time.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+
+// Resource name of the on-demand request of an address, given in the
+// representation of the address index. Empty for an invalid address.
+std::string addressName(absl::string_view address);
+
+// On-demand requests of a worker, keyed like the address index, with the time
+// until which they are not repeated.
+template <class Key> class RequestedAddresses {
+public:
+  // Records a request of the address until the time, unless the address was
+  // requested and the request has not expired yet. Returns whether the
+  // address is to be requested.
+  bool request(const Key& address, MonotonicTime now, MonotonicTime until) {
+    if (const auto it = requested_.find(address); it != requested_.end() && now < it->second) {
+      return false;
+    }
+    if (requested_.size() >= prune_at_) {
+      absl::erase_if(requested_, [now](const auto& entry) { return entry.second <= now; });
+      prune_at_ = std::max<size_t>(1024, 2 * requested_.size());
+    }
+    requested_.insert_or_assign(address, until);
+    return true;
+  }
+  size_t size() const { return requested_.size(); }
+
+private:
+  absl::flat_hash_map<Key, MonotonicTime> requested_;
+  size_t prune_at_{1024};
+};
+
+// Addresses found by the lookups of a worker, keyed like the address index.
+// The addresses are only converted to resource names on the main thread.
+class UsedAddresses {
+public:
+  void addIpv4(uint32_t address) { ipv4_.insert(address); }
+  void addIpv6(absl::uint128 address) { ipv6_.insert(address); }
+  void merge(const UsedAddresses& other);
+  bool empty() const { return ipv4_.empty() && ipv6_.empty(); }
+
+  // Resource names of the addresses, as requested on demand.
+  std::vector<std::string> names() const;
+
+private:
+  absl::flat_hash_set<uint32_t> ipv4_;
+  absl::flat_hash_set<absl::uint128> ipv6_;
+};
+
+// Workloads requested on demand, each with the time it expires. The TTL is
+// counted from the last lookup, so that the workloads in use do not expire.
+class WorkloadInterest {
+public:
+  explicit WorkloadInterest(std::chrono::milliseconds ttl) : ttl_(ttl) {}
+
+  void request(const std::string& name, MonotonicTime now) {
+    expiry_.insert_or_assign(name, now + ttl_);
+  }
+  // Extends the TTL of the names already requested.
+  void refresh(const std::vector<std::string>& names, MonotonicTime now);
+  // Removes and returns the names expired at the time.
+  std::vector<std::string> expire(MonotonicTime now);
+
+  absl::flat_hash_set<std::string> names() const;
+  bool empty() const { return expiry_.empty(); }
+
+private:
+  const std::chrono::milliseconds ttl_;
+  absl::flat_hash_map<std::string, MonotonicTime> expiry_;
+};
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
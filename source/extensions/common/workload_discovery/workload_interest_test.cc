@@ -0,0 +1,128 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/workload_interest.h"
+
+#include "source/common/network/utility.h"
+
+#include "absl/strings/str_cat.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+namespace {
+
+using testing::UnorderedElementsAre;
+
+MonotonicTime minutes(int count) { return MonotonicTime(std::chrono::minutes(count)); }
+
+TEST(WorkloadInterestTest, ExpiresAfterTtl) {
+  WorkloadInterest interest(std::chrono::minutes(5));
+  interest.request("/10.0.0.1", minutes(0));
+  interest.request("/10.0.0.2", minutes(2));
+  EXPECT_TRUE(interest.expire(minutes(4)).empty());
+  EXPECT_THAT(interest.expire(minutes(5)), UnorderedElementsAre("/10.0.0.1"));
+  EXPECT_THAT(interest.names(), UnorderedElementsAre("/10.0.0.2"));
+  EXPECT_THAT(interest.expire(minutes(7)), UnorderedElementsAre("/10.0.0.2"));
+  EXPECT_TRUE(interest.empty());
+}
+
+TEST(WorkloadInterestTest, LookedUpWorkloadIsNotExpired) {
+  WorkloadInterest interest(std::chrono::minutes(5));
+  interest.request("/10.0.0.1", minutes(0));
+  interest.request("/10.0.0.2", minutes(0));
+  // The first workload is found by every lookup, far past its TTL.
+  for (int now = 1; now <= 30; now++) {
+    interest.refresh({"/10.0.0.1"}, minutes(now));
+    const auto expired = interest.expire(minutes(now));
+    if (now == 5) {
+      EXPECT_THAT(expired, UnorderedElementsAre("/10.0.0.2"));
+    } else {
+      EXPECT_TRUE(expired.empty()) << now;
+    }
+  }
+  EXPECT_THAT(interest.names(), UnorderedElementsAre("/10.0.0.1"));
+  // Lookups stop.
+  EXPECT_TRUE(interest.expire(minutes(34)).empty());
+  EXPECT_THAT(interest.expire(minutes(35)), UnorderedElementsAre("/10.0.0.1"));
+}
+
+TEST(WorkloadInterestTest, RefreshIgnoresOtherNames) {
+  WorkloadInterest interest(std::chrono::minutes(5));
+  interest.refresh({"/10.0.0.1"}, minutes(0));
+  EXPECT_TRUE(interest.empty());
+}
+
+// Name of the on-demand request of an address.
+std::string requestedName(const std::string& text) {
+  const auto address = Network::Utility::parseInternetAddressNoThrow(text);
+  return absl::StrCat("/", address->ip()->addressAsString());
+}
+
+TEST(UsedAddressesTest, NamesMatchRequestedNames) {
+  UsedAddresses used;
+  UsedAddresses other;
+  for (const auto* text : {"10.0.0.1", "2001:db8::1", "::ffff:10.0.0.2"}) {
+    const auto address = Network::Utility::parseInternetAddressNoThrow(text);
+    ASSERT_NE(nullptr, address) << text;
+    if (address->ip()->ipv4()) {
+      used.addIpv4(address->ip()->ipv4()->address());
+    } else {
+      other.addIpv6(address->ip()->ipv6()->address());
+    }
+  }
+  EXPECT_FALSE(other.empty());
+  used.merge(other);
+  EXPECT_THAT(used.names(),
+              UnorderedElementsAre(requestedName("10.0.0.1"), requestedName("2001:db8::1"),
+                                   requestedName("::ffff:10.0.0.2")));
+}
+
+TEST(RequestedAddressesTest, RepeatsAfterExpiry) {
+  RequestedAddresses<uint32_t> requested;
+  EXPECT_TRUE(requested.request(1, minutes(0), minutes(1)));
+  EXPECT_FALSE(requested.request(1, minutes(0), minutes(1)));
+  EXPECT_TRUE(requested.request(2, minutes(0), minutes(1)));
+  EXPECT_TRUE(requested.request(1, minutes(1), minutes(2)));
+}
+
+TEST(RequestedAddressesTest, PrunesExpiredRequests) {
+  RequestedAddresses<uint32_t> requested;
+  for (uint32_t i = 0; i < 1024; i++) {
+    EXPECT_TRUE(requested.request(i, minutes(0), minutes(1)));
+  }
+  EXPECT_TRUE(requested.request(1024, minutes(1), minutes(2)));
+  EXPECT_EQ(1, requested.size());
+}
+
+TEST(AddressNameTest, MatchesRequestedNames) {
+  for (const auto* text : {"10.0.0.1", "2001:db8::1", "::ffff:10.0.0.2"}) {
+    const auto address = Network::Utility::parseInternetAddressNoThrow(text);
+    ASSERT_NE(nullptr, address) << text;
+    std::string bytes;
+    if (address->ip()->ipv4()) {
+      const uint32_t ipv4 = address->ip()->ipv4()->address();
+      bytes.assign(reinterpret_cast<const char*>(&ipv4), sizeof(ipv4));
+    } else {
+      const absl::uint128 ipv6 = address->ip()->ipv6()->address();
+      bytes.assign(reinterpret_cast<const char*>(&ipv6), sizeof(ipv6));
+    }
+    EXPECT_EQ(requestedName(text), addressName(bytes));
+  }
+  EXPECT_EQ("", addressName("abc"));
+}
+
+} // namespace
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
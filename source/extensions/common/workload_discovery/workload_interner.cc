@@ -0,0 +1,146 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/workload_interner.h"
+
+#include "absl/strings/str_cat.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+namespace {
+constexpr absl::string_view DefaultNamespace = "default";
+constexpr absl::string_view DefaultTrustDomain = "cluster.local";
+
+Istio::Common::WorkloadType workloadType(const istio::workload::Workload& workload) {
+  switch (workload.workload_type()) {
+  case istio::workload::WorkloadType::CRONJOB:
+    return Istio::Common::WorkloadType::CronJob;
+  case istio::workload::WorkloadType::JOB:
+    return Istio::Common::WorkloadType::Job;
+  case istio::workload::WorkloadType::POD:
+    return Istio::Common::WorkloadType::Pod;
+  default:
+    return Istio::Common::WorkloadType::Deployment;
+  }
+}
+
+std::string identity(const istio::workload::Workload& workload) {
+  absl::string_view ns = workload.namespace_();
+  absl::string_view trust_domain = workload.trust_domain();
+  // Trust domain may be elided if it's equal to "cluster.local"
+  if (trust_domain.empty()) {
+    trust_domain = DefaultTrustDomain;
+  }
+  // The namespace may be elided if it's equal to "default"
+  if (ns.empty()) {
+    ns = DefaultNamespace;
+  }
+  return absl::StrCat("spiffe://", trust_domain, "/ns/", workload.namespace_(), "/sa/",
+                      workload.service_account());
+}
+} // namespace
+
+Istio::Common::WorkloadMetadataObject convert(const istio::workload::Workload& workload) {
+  return Istio::Common::WorkloadMetadataObject(
+      workload.name(), workload.cluster_id(), workload.namespace_(), workload.workload_name(),
+      workload.canonical_name(), workload.canonical_revision(), workload.canonical_name(),
+      workload.canonical_revision(), workloadType(workload), identity(workload));
+}
+
+WorkloadMetadataObjectConstSharedPtr
+WorkloadInterner::intern(const istio::workload::Workload& workload) {
+  const auto workload_type = workloadType(workload);
+  const auto workload_identity = identity(workload);
+  const GroupKey key(workload.cluster_id(), workload.namespace_(), workload.workload_name(),
+                     workload.canonical_name(), workload.canonical_revision(), workload_identity,
+                     workload_type);
+  auto it = groups_.find(key);
+  if (it == groups_.end()) {
+    auto group = std::make_shared<const Group>(
+        Group{workload.cluster_id(), workload.namespace_(), workload.workload_name(),
+              workload.canonical_name(), workload.canonical_revision(), workload_identity,
+              workload_type});
+    it = groups_.emplace(keyOf(*group), GroupEntry{std::move(group)}).first;
+  }
+  it->second.used_++;
+  const auto& group = *it->second.group_;
+  auto instance = std::make_shared<const Instance>(Instance{it->second.group_, workload.name()});
+  const absl::string_view instance_name = instance->instance_name_;
+  // The canonical name and revision double as the app name and version.
+  return std::make_shared<const Istio::Common::WorkloadMetadataObject>(
+      std::move(instance), instance_name, group.cluster_name_, group.namespace_name_,
+      group.workload_name_, group.canonical_name_, group.canonical_revision_,
+      group.canonical_name_, group.canonical_revision_, group.workload_type_, group.identity_);
+}
+
+void WorkloadInterner::release(const Istio::Common::WorkloadMetadataObject& workload) {
+  const auto it = groups_.find(GroupKey(workload.cluster_name_, workload.namespace_name_,
+                                        workload.workload_name_, workload.canonical_name_,
+                                        workload.canonical_revision_, workload.identity_,
+                                        workload.workload_type_));
+  // Workloads converted without the interner have their own strings.
+  if (it == groups_.end() ||
+      it->second.group_->cluster_name_.data() != workload.cluster_name_.data() ||
+      it->second.used_ == 0) {
+    return;
+  }
+  if (--it->second.used_ == 0) {
+    released_.insert(it->second.group_.get());
+  }
+}
+
+void WorkloadInterner::sweep() {
+  // A group referenced only by this map cannot be acquired concurrently.
+  absl::erase_if(groups_, [](const auto& entry) { return entry.second.group_.use_count() == 1; });
+  released_.clear();
+}
+
+void WorkloadInterner::sweepReleased() {
+  absl::erase_if(released_, [this](const Group* group) {
+    const auto it = groups_.find(keyOf(*group));
+    if (it->second.used_ > 0) {
+      // Interned again since released.
+      return true;
+    }
+    if (it->second.group_.use_count() == 1) {
+      groups_.erase(it);
+      return true;
+    }
+    return false;
+  });
+}
+
+WorkloadInterner::GroupKey WorkloadInterner::keyOf(const Group& group) {
+  return GroupKey(group.cluster_name_, group.namespace_name_, group.workload_name_,
+                  group.canonical_name_, group.canonical_revision_, group.identity_,
+                  group.workload_type_);
+}
+
+size_t WorkloadInterner::memoryBytes() const {
+  size_t bytes = groups_.capacity() * (sizeof(GroupKey) + sizeof(GroupEntry) + 1) +
+                 released_.capacity() * (sizeof(const Group*) + 1);
+  for (const auto& [key, entry] : groups_) {
+    const auto& group = entry.group_;
+    bytes += sizeof(Group) + group->cluster_name_.size() + group->namespace_name_.size() +
+             group->workload_name_.size() + group->canonical_name_.size() +
+             group->canonical_revision_.size() + group->identity_.size();
+  }
+  return bytes;
+}
+
+size_t WorkloadInterner::memoryBytes(const Istio::Common::WorkloadMetadataObject& workload) {
+  return sizeof(Istio::Common::WorkloadMetadataObject) + sizeof(Instance) +
+         workload.instance_name_.size() + workload.memoizedBytes();
+}
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
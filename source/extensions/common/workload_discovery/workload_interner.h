@@ -0,0 +1,97 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <tuple>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "extensions/common/metadata_object.h"
+#include "source/extensions/common/workload_discovery/api.h"
+#include "source/extensions/common/workload_discovery/discovery.pb.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+
+// Converts a workload to its metadata without sharing any strings.
+Istio::Common::WorkloadMetadataObject convert(const istio::workload::Workload& workload);
+
+// Converts workloads to metadata, sharing the strings common to the replicas
+// of a workload: cluster, namespace, workload name, canonical name and
+// revision, and identity. Only the instance name is stored per workload. Not
+// thread safe, the returned objects are.
+class WorkloadInterner {
+public:
+  WorkloadMetadataObjectConstSharedPtr intern(const istio::workload::Workload& workload);
+
+  // Marks a workload returned by intern() as no longer used by the caller.
+  // Workloads not returned by intern() are ignored.
+  void release(const Istio::Common::WorkloadMetadataObject& workload);
+
+  // Releases the shared strings no longer referenced by any workload.
+  void sweep();
+
+  // Releases the shared strings of the released workloads that are no longer
+  // referenced. Only visits the groups released since the last sweep, those
+  // still referenced by previous versions of the workloads are retried at
+  // the next sweep.
+  void sweepReleased();
+
+  // Number of distinct sets of shared strings.
+  size_t size() const { return groups_.size(); }
+
+  // Estimated bytes held by the shared strings.
+  size_t memoryBytes() const;
+
+  // Estimated bytes held by a workload returned by intern(), excluding the
+  // shared strings. Includes the baggage and FlatNode strings the workload
+  // has memoized so far.
+  static size_t memoryBytes(const Istio::Common::WorkloadMetadataObject& workload);
+
+private:
+  struct Group {
+    std::string cluster_name_;
+    std::string namespace_name_;
+    std::string workload_name_;
+    std::string canonical_name_;
+    std::string canonical_revision_;
+    std::string identity_;
+    Istio::Common::WorkloadType workload_type_;
+  };
+  using GroupConstSharedPtr = std::shared_ptr<const Group>;
+  // Storage of an interned workload.
+  struct Instance {
+    GroupConstSharedPtr group_;
+    std::string instance_name_;
+  };
+  // References the strings of the group it maps to.
+  using GroupKey =
+      std::tuple<absl::string_view, absl::string_view, absl::string_view, absl::string_view,
+                 absl::string_view, absl::string_view, Istio::Common::WorkloadType>;
+  struct GroupEntry {
+    GroupConstSharedPtr group_;
+    // Workloads returned by intern() and not released.
+    size_t used_{0};
+  };
+
+  static GroupKey keyOf(const Group& group);
+
+  absl::flat_hash_map<GroupKey, GroupEntry> groups_;
+  // Groups with no used workload, released once no longer referenced.
+  absl::flat_hash_set<const Group*> released_;
+};
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
@@ -0,0 +1,189 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/workload_interner.h"
+
+#include "absl/strings/str_cat.h"
+#include "test/common/stats/stat_test_utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+namespace {
+
+// Replica of one of a thousand deployments spread over fifty namespaces.
+istio::workload::Workload makeWorkload(size_t replica, size_t deployment) {
+  istio::workload::Workload workload;
+  const auto ns = absl::StrCat("bookinfo-namespace-", deployment % 50);
+  const auto name = absl::StrCat("reviews-backend-v", deployment);
+  workload.set_name(absl::StrCat(name, "-84975bc778-", replica));
+  workload.set_uid(absl::StrCat("Kubernetes//Pod/", ns, "/", workload.name()));
+  workload.set_namespace_(ns);
+  workload.set_workload_name(name);
+  workload.set_canonical_name(absl::StrCat("reviews-backend-", deployment));
+  workload.set_canonical_revision("v1");
+  workload.set_cluster_id("Kubernetes");
+  workload.set_service_account(absl::StrCat("bookinfo-reviews-", deployment));
+  workload.set_workload_type(istio::workload::WorkloadType::DEPLOYMENT);
+  return workload;
+}
+
+void expectEqual(const Istio::Common::WorkloadMetadataObject& expected,
+                 const Istio::Common::WorkloadMetadataObject& actual) {
+  EXPECT_EQ(expected.instance_name_, actual.instance_name_);
+  EXPECT_EQ(expected.cluster_name_, actual.cluster_name_);
+  EXPECT_EQ(expected.namespace_name_, actual.namespace_name_);
+  EXPECT_EQ(expected.workload_name_, actual.workload_name_);
+  EXPECT_EQ(expected.canonical_name_, actual.canonical_name_);
+  EXPECT_EQ(expected.canonical_revision_, actual.canonical_revision_);
+  EXPECT_EQ(expected.app_name_, actual.app_name_);
+  EXPECT_EQ(expected.app_version_, actual.app_version_);
+  EXPECT_EQ(expected.workload_type_, actual.workload_type_);
+  EXPECT_EQ(expected.identity_, actual.identity_);
+}
+
+TEST(WorkloadInternerTest, SharesStringsBetweenReplicas) {
+  WorkloadInterner interner;
+  const auto first = interner.intern(makeWorkload(1, 7));
+  const auto second = interner.intern(makeWorkload(2, 7));
+  const auto other = interner.intern(makeWorkload(1, 8));
+  expectEqual(convert(makeWorkload(1, 7)), *first);
+  expectEqual(convert(makeWorkload(2, 7)), *second);
+  EXPECT_EQ("spiffe://cluster.local/ns/bookinfo-namespace-7/sa/bookinfo-reviews-7",
+            first->identity_);
+
+  EXPECT_EQ(2, interner.size());
+  EXPECT_EQ(first->namespace_name_.data(), second->namespace_name_.data());
+  EXPECT_EQ(first->identity_.data(), second->identity_.data());
+  EXPECT_EQ(first->canonical_name_.data(), first->app_name_.data());
+  EXPECT_NE(first->instance_name_, second->instance_name_);
+  EXPECT_NE(first->workload_name_.data(), other->workload_name_.data());
+}
+
+TEST(WorkloadInternerTest, CopiesOutliveInterner) {
+  std::unique_ptr<Istio::Common::WorkloadMetadataObject> copy;
+  {
+    WorkloadInterner interner;
+    copy = std::make_unique<Istio::Common::WorkloadMetadataObject>(
+        *interner.intern(makeWorkload(1, 7)));
+  }
+  expectEqual(convert(makeWorkload(1, 7)), *copy);
+}
+
+TEST(WorkloadInternerTest, Sweep) {
+  WorkloadInterner interner;
+  auto first = interner.intern(makeWorkload(1, 7));
+  auto second = interner.intern(makeWorkload(1, 8));
+  EXPECT_EQ(2, interner.size());
+  const size_t bytes = interner.memoryBytes();
+
+  second.reset();
+  interner.sweep();
+  EXPECT_EQ(1, interner.size());
+  EXPECT_LT(interner.memoryBytes(), bytes);
+  expectEqual(convert(makeWorkload(1, 7)), *first);
+
+  first.reset();
+  interner.sweep();
+  EXPECT_EQ(0, interner.size());
+}
+
+TEST(WorkloadInternerTest, SweepReleased) {
+  WorkloadInterner interner;
+  auto first = interner.intern(makeWorkload(1, 7));
+  auto second = interner.intern(makeWorkload(2, 7));
+  auto other = interner.intern(makeWorkload(1, 8));
+  // Groups of workloads not released are kept.
+  other.reset();
+  interner.sweepReleased();
+  EXPECT_EQ(2, interner.size());
+
+  // Released groups are kept while a previous version references them.
+  interner.release(*first);
+  interner.release(*second);
+  interner.sweepReleased();
+  EXPECT_EQ(2, interner.size());
+  first.reset();
+  second.reset();
+  interner.sweepReleased();
+  EXPECT_EQ(1, interner.size());
+}
+
+TEST(WorkloadInternerTest, ReleaseIgnoresConvertedWorkloads) {
+  WorkloadInterner interner;
+  auto first = interner.intern(makeWorkload(1, 7));
+  interner.release(convert(makeWorkload(2, 7)));
+  interner.sweepReleased();
+  first.reset();
+  interner.sweepReleased();
+  EXPECT_EQ(1, interner.size());
+}
+
+TEST(WorkloadInternerTest, MemoryBytesCountsMemoizedStrings) {
+  WorkloadInterner interner;
+  const auto workload = interner.intern(makeWorkload(1, 7));
+  const size_t bytes = WorkloadInterner::memoryBytes(*workload);
+  const auto& baggage = workload->baggage();
+  EXPECT_GE(WorkloadInterner::memoryBytes(*workload), bytes + baggage.size());
+  const size_t with_baggage = WorkloadInterner::memoryBytes(*workload);
+  const auto& flat_node = workload->flatNode();
+  EXPECT_GE(WorkloadInterner::memoryBytes(*workload), with_baggage + flat_node.size());
+}
+
+// Compares the memory held by 100k workloads with and without interning.
+TEST(WorkloadInternerTest, MemoryAt100kWorkloads) {
+  if (Stats::TestUtil::MemoryTest::mode() == Stats::TestUtil::MemoryTest::Mode::Disabled) {
+    GTEST_SKIP() << "Memory accounting is not available";
+  }
+  constexpr size_t replicas = 100;
+  constexpr size_t deployments = 1000;
+  std::vector<istio::workload::Workload> workloads;
+  workloads.reserve(replicas * deployments);
+  for (size_t deployment = 0; deployment < deployments; deployment++) {
+    for (size_t replica = 0; replica < replicas; replica++) {
+      workloads.push_back(makeWorkload(replica, deployment));
+    }
+  }
+  std::vector<WorkloadMetadataObjectConstSharedPtr> index;
+  index.reserve(workloads.size());
+
+  size_t converted_bytes;
+  {
+    Stats::TestUtil::MemoryTest memory_test;
+    for (const auto& workload : workloads) {
+      index.push_back(
+          std::make_shared<const Istio::Common::WorkloadMetadataObject>(convert(workload)));
+    }
+    converted_bytes = memory_test.consumedBytes();
+  }
+  index.clear();
+
+  size_t interned_bytes;
+  WorkloadInterner interner;
+  {
+    Stats::TestUtil::MemoryTest memory_test;
+    for (const auto& workload : workloads) {
+      index.push_back(interner.intern(workload));
+    }
+    interned_bytes = memory_test.consumedBytes();
+  }
+  ENVOY_LOG_MISC(info, "100k workloads: {} bytes converted, {} bytes interned", converted_bytes,
+                 interned_bytes);
+  EXPECT_EQ(deployments, interner.size());
+  EXPECT_LT(interned_bytes, converted_bytes * 3 / 4);
+}
+
+} // namespace
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
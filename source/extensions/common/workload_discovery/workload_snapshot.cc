@@ -0,0 +1,263 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/workload_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+namespace {
+
+// File layout, in host byte order:
+//   Header
+//   WorkloadRecord[workload_count]
+//   AddressRecord[address_count], the addresses of each workload in order
+//   strings
+constexpr uint32_t SnapshotMagic = 0x49575353; // "IWSS"
+constexpr uint32_t SnapshotVersion = 1;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t workload_count;
+  uint32_t address_count;
+  uint64_t strings_size;
+};
+
+struct StringRef {
+  uint32_t offset;
+  uint32_t size;
+};
+
+enum StringField {
+  Uid,
+  InstanceName,
+  ClusterName,
+  NamespaceName,
+  WorkloadName,
+  CanonicalName,
+  CanonicalRevision,
+  AppName,
+  AppVersion,
+  Identity,
+  StringFieldCount,
+};
+
+struct WorkloadRecord {
+  StringRef strings[StringFieldCount];
+  uint32_t workload_type;
+  uint32_t address_count;
+};
+
+struct AddressRecord {
+  uint32_t size;
+  uint8_t bytes[16];
+};
+
+// Read-only mapping of a snapshot file.
+class MappedFile {
+public:
+  MappedFile(const void* data, size_t size) : data_(data), size_(size) {}
+  ~MappedFile() { munmap(const_cast<void*>(data_), size_); }
+  const char* data() const { return static_cast<const char*>(data_); }
+  size_t size() const { return size_; }
+
+private:
+  const void* data_;
+  const size_t size_;
+};
+
+// Strings shared by the workloads of a snapshot, written once each.
+class StringTable {
+public:
+  StringRef add(absl::string_view value) {
+    const auto [it, inserted] = offsets_.try_emplace(value, strings_.size());
+    if (inserted) {
+      strings_.append(value.data(), value.size());
+    }
+    return {it->second, static_cast<uint32_t>(value.size())};
+  }
+  const std::string& strings() const { return strings_; }
+
+private:
+  absl::flat_hash_map<absl::string_view, uint32_t> offsets_;
+  std::string strings_;
+};
+
+template <class T> void append(std::string& output, const T& value) {
+  output.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T> T read(const char* data) {
+  T value;
+  memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+bool writeAll(int fd, absl::string_view data) {
+  while (!data.empty()) {
+    const ssize_t written = write(fd, data.data(), data.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(written);
+  }
+  return true;
+}
+
+} // namespace
+
+absl::Status writeSnapshot(const std::string& path, const IdToWorkload& workloads) {
+  StringTable strings;
+  std::string records;
+  std::string addresses;
+  uint32_t address_count = 0;
+  for (const auto& [uid, entry] : workloads) {
+    const auto& metadata = *entry.metadata_;
+    WorkloadRecord record{};
+    record.strings[Uid] = strings.add(uid);
+    record.strings[InstanceName] = strings.add(metadata.instance_name_);
+    record.strings[ClusterName] = strings.add(metadata.cluster_name_);
+    record.strings[NamespaceName] = strings.add(metadata.namespace_name_);
+    record.strings[WorkloadName] = strings.add(metadata.workload_name_);
+    record.strings[CanonicalName] = strings.add(metadata.canonical_name_);
+    record.strings[CanonicalRevision] = strings.add(metadata.canonical_revision_);
+    record.strings[AppName] = strings.add(metadata.app_name_);
+    record.strings[AppVersion] = strings.add(metadata.app_version_);
+    record.strings[Identity] = strings.add(metadata.identity_);
+    record.workload_type = static_cast<uint32_t>(metadata.workload_type_);
+    for (const auto& address : entry.addresses_) {
+      if (address.size() != 4 && address.size() != 16) {
+        continue;
+      }
+      AddressRecord address_record{};
+      address_record.size = address.size();
+      memcpy(address_record.bytes, address.data(), address.size());
+      append(addresses, address_record);
+      record.address_count++;
+    }
+    address_count += record.address_count;
+    append(records, record);
+  }
+  Header header{SnapshotMagic, SnapshotVersion, static_cast<uint32_t>(workloads.size()),
+                address_count, strings.strings().size()};
+
+  // Each writer has its own temporary file, the epochs of a hot restart may
+  // write the snapshot at the same time.
+  std::string temporary_path = absl::StrCat(path, ".XXXXXX");
+  const int fd = mkstemp(temporary_path.data());
+  if (fd < 0) {
+    return absl::InternalError(
+        absl::StrCat("failed to create ", temporary_path, ": ", strerror(errno)));
+  }
+  const bool written = writeAll(fd, absl::string_view(reinterpret_cast<const char*>(&header),
+                                                      sizeof(header))) &&
+                       writeAll(fd, records) && writeAll(fd, addresses) &&
+                       writeAll(fd, strings.strings());
+  if (close(fd) != 0 || !written) {
+    unlink(temporary_path.c_str());
+    return absl::InternalError(absl::StrCat("failed to write ", temporary_path));
+  }
+  if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+    const int error = errno;
+    unlink(temporary_path.c_str());
+    return absl::InternalError(
+        absl::StrCat("failed to rename ", temporary_path, ": ", strerror(error)));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<IdToWorkload> loadSnapshot(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return absl::NotFoundError(absl::StrCat("failed to open ", path, ": ", strerror(errno)));
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+    close(fd);
+    return absl::InvalidArgumentError(absl::StrCat(path, " is not a workload snapshot"));
+  }
+  const size_t size = file_stat.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return absl::InternalError(absl::StrCat("failed to map ", path, ": ", strerror(errno)));
+  }
+  const auto file = std::make_shared<const MappedFile>(data, size);
+
+  const auto header = read<Header>(file->data());
+  if (header.magic != SnapshotMagic || header.version != SnapshotVersion) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(path, " has an unsupported format version ", header.version));
+  }
+  const uint64_t records_offset = sizeof(Header);
+  const uint64_t addresses_offset =
+      records_offset + uint64_t(header.workload_count) * sizeof(WorkloadRecord);
+  const uint64_t strings_offset =
+      addresses_offset + uint64_t(header.address_count) * sizeof(AddressRecord);
+  if (strings_offset + header.strings_size != size) {
+    return absl::InvalidArgumentError(absl::StrCat(path, " is truncated"));
+  }
+  const absl::string_view strings(file->data() + strings_offset, header.strings_size);
+
+  IdToWorkload workloads;
+  workloads.reserve(header.workload_count);
+  uint64_t address_index = 0;
+  for (uint32_t i = 0; i < header.workload_count; i++) {
+    const auto record =
+        read<WorkloadRecord>(file->data() + records_offset + i * sizeof(WorkloadRecord));
+    absl::string_view values[StringFieldCount];
+    for (int field = 0; field < StringFieldCount; field++) {
+      const auto& ref = record.strings[field];
+      if (uint64_t(ref.offset) + ref.size > strings.size()) {
+        return absl::InvalidArgumentError(absl::StrCat(path, " has an invalid string"));
+      }
+      values[field] = strings.substr(ref.offset, ref.size);
+    }
+    if (record.workload_type > static_cast<uint32_t>(Istio::Common::WorkloadType::CronJob) ||
+        address_index + record.address_count > header.address_count) {
+      return absl::InvalidArgumentError(absl::StrCat(path, " has an invalid workload"));
+    }
+    WorkloadEntry entry;
+    entry.metadata_ = std::make_shared<const Istio::Common::WorkloadMetadataObject>(
+        file, values[InstanceName], values[ClusterName], values[NamespaceName],
+        values[WorkloadName], values[CanonicalName], values[CanonicalRevision], values[AppName],
+        values[AppVersion], static_cast<Istio::Common::WorkloadType>(record.workload_type),
+        values[Identity]);
+    for (uint32_t j = 0; j < record.address_count; j++, address_index++) {
+      const auto address = read<AddressRecord>(file->data() + addresses_offset +
+                                               address_index * sizeof(AddressRecord));
+      if (address.size != 4 && address.size != 16) {
+        return absl::InvalidArgumentError(absl::StrCat(path, " has an invalid address"));
+      }
+      entry.addresses_.emplace_back(reinterpret_cast<const char*>(address.bytes), address.size);
+    }
+    workloads.emplace(values[Uid], std::move(entry));
+  }
+  return workloads;
+}
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
@@ -0,0 +1,43 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "source/extensions/common/workload_discovery/api.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+
+struct WorkloadEntry {
+  std::vector<std::string> addresses_;
+  WorkloadMetadataObjectConstSharedPtr metadata_;
+};
+
+// Workloads by resource name: the uid, or the address name when requested on
+// demand.
+using IdToWorkload = absl::flat_hash_map<std::string, WorkloadEntry>;
+
+// Writes the workloads to a snapshot file. The file is replaced atomically.
+absl::Status writeSnapshot(const std::string& path, const IdToWorkload& workloads);
+
+// Maps a snapshot file written by writeSnapshot() into memory. The strings of
+// the returned workloads reference the mapping, which is released with the
+// last of them.
+absl::StatusOr<IdToWorkload> loadSnapshot(const std::string& path);
+
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
@@ -0,0 +1,134 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/common/workload_discovery/workload_snapshot.h"
+
+#include <fstream>
+
+#include "test/test_common/environment.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace Envoy::Extensions::Common::WorkloadDiscovery {
+namespace {
+
+using Istio::Common::WorkloadMetadataObject;
+using Istio::Common::WorkloadType;
+
+IdToWorkload makeWorkloads() {
+  IdToWorkload workloads;
+  workloads["Kubernetes//Pod/default/productpage-v1-84975bc778-pxz2w"] = WorkloadEntry{
+      {std::string("\x0a\x00\x00\x01", 4), std::string(16, '\x20')},
+      std::make_shared<const WorkloadMetadataObject>(
+          "productpage-v1-84975bc778-pxz2w", "Kubernetes", "default", "productpage-v1",
+          "productpage", "v1", "productpage", "v1", WorkloadType::Deployment,
+          "spiffe://cluster.local/ns/default/sa/bookinfo-productpage")};
+  workloads["Kubernetes//Pod/default/ratings"] = WorkloadEntry{
+      {std::string("\x0a\x00\x00\x02", 4)},
+      std::make_shared<const WorkloadMetadataObject>("ratings", "Kubernetes", "default", "ratings",
+                                                     "", "", "", "", WorkloadType::Pod, "")};
+  return workloads;
+}
+
+void expectEqual(const IdToWorkload& expected, const IdToWorkload& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (const auto& [id, entry] : expected) {
+    const auto it = actual.find(id);
+    ASSERT_NE(it, actual.end()) << id;
+    EXPECT_EQ(entry.addresses_, it->second.addresses_);
+    const auto& lhs = *entry.metadata_;
+    const auto& rhs = *it->second.metadata_;
+    EXPECT_EQ(lhs.instance_name_, rhs.instance_name_);
+    EXPECT_EQ(lhs.cluster_name_, rhs.cluster_name_);
+    EXPECT_EQ(lhs.namespace_name_, rhs.namespace_name_);
+    EXPECT_EQ(lhs.workload_name_, rhs.workload_name_);
+    EXPECT_EQ(lhs.canonical_name_, rhs.canonical_name_);
+    EXPECT_EQ(lhs.canonical_revision_, rhs.canonical_revision_);
+    EXPECT_EQ(lhs.app_name_, rhs.app_name_);
+    EXPECT_EQ(lhs.app_version_, rhs.app_version_);
+    EXPECT_EQ(lhs.workload_type_, rhs.workload_type_);
+    EXPECT_EQ(lhs.identity_, rhs.identity_);
+  }
+}
+
+TEST(WorkloadSnapshotTest, RoundTrip) {
+  const std::string path = TestEnvironment::temporaryPath("workload_snapshot_round_trip");
+  const auto workloads = makeWorkloads();
+  ASSERT_TRUE(writeSnapshot(path, workloads).ok());
+
+  auto loaded = loadSnapshot(path);
+  ASSERT_TRUE(loaded.ok()) << loaded.status();
+  expectEqual(workloads, *loaded);
+
+  // Identical strings are stored once.
+  const auto& productpage = *loaded->at("Kubernetes//Pod/default/productpage-v1-84975bc778-pxz2w")
+                                 .metadata_;
+  const auto& ratings = *loaded->at("Kubernetes//Pod/default/ratings").metadata_;
+  EXPECT_EQ(productpage.canonical_name_.data(), productpage.app_name_.data());
+  EXPECT_EQ(productpage.namespace_name_.data(), ratings.namespace_name_.data());
+
+  // The workloads outlive the rest of the snapshot.
+  const auto metadata = loaded->at("Kubernetes//Pod/default/ratings").metadata_;
+  loaded = IdToWorkload();
+  EXPECT_EQ("ratings", metadata->instance_name_);
+}
+
+TEST(WorkloadSnapshotTest, Empty) {
+  const std::string path = TestEnvironment::temporaryPath("workload_snapshot_empty");
+  ASSERT_TRUE(writeSnapshot(path, IdToWorkload()).ok());
+  auto loaded = loadSnapshot(path);
+  ASSERT_TRUE(loaded.ok()) << loaded.status();
+  EXPECT_TRUE(loaded->empty());
+}
+
+TEST(WorkloadSnapshotTest, Missing) {
+  const auto loaded = loadSnapshot(TestEnvironment::temporaryPath("workload_snapshot_missing"));
+  EXPECT_EQ(absl::StatusCode::kNotFound, loaded.status().code());
+}
+
+TEST(WorkloadSnapshotTest, Invalid) {
+  const std::string path = TestEnvironment::temporaryPath("workload_snapshot_invalid");
+  ASSERT_TRUE(writeSnapshot(path, makeWorkloads()).ok());
+  std::string contents;
+  {
+    std::ifstream file(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  // Truncated.
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), contents.size() - 1);
+  }
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, loadSnapshot(path).status().code());
+
+  // Unknown version.
+  contents[4]++;
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), contents.size());
+  }
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, loadSnapshot(path).status().code());
+
+  // Not a snapshot.
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "workloads";
+  }
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, loadSnapshot(path).status().code());
+}
+
+} // namespace
+} // namespace Envoy::Extensions::Common::WorkloadDiscovery
@@ -15,25 +15,33 @@
 
 #include "source/extensions/filters/http/alpn/alpn_filter.h"
 
+#include <algorithm>
+
 #include "envoy/upstream/cluster_manager.h"
-#include "source/common/network/application_protocol.h"
 
 namespace Envoy {
 namespace Http {
 namespace Alpn {
 
+ClusterSettingsCache::ClusterSettingsCache(ThreadLocal::SlotAllocator& tls) : tls_(tls) {
+  tls_.set([](Event::Dispatcher&) { return std::make_shared<ThreadLocalClusters>(); });
+}
+
 AlpnFilterConfig::AlpnFilterConfig(
     const istio::envoy::config::filter::http::alpn::v2alpha1::FilterConfig& proto_config,
-    Upstream::ClusterManager& cluster_manager)
-    : cluster_manager_(cluster_manager) {
+    Upstream::ClusterManager& cluster_manager, ClusterSettingsCacheSharedPtr cluster_settings)
+    : cluster_manager_(cluster_manager), cluster_settings_(std::move(cluster_settings)) {
   for (const auto& pair : proto_config.alpn_override()) {
     std::vector<std::string> application_protocols;
     for (const auto& protocol : pair.alpn_override()) {
       application_protocols.push_back(protocol);
     }
 
-    alpn_overrides_.insert(
-        {getHttpProtocol(pair.upstream_protocol()), std::move(application_protocols)});
+    auto& alpn_override =
+        alpn_overrides_[static_cast<size_t>(getHttpProtocol(pair.upstream_protocol()))];
+    if (!alpn_override && !application_protocols.empty()) {
+      alpn_override = std::make_shared<Network::ApplicationProtocols>(application_protocols);
+    }
   }
 }
 
@@ -54,6 +62,35 @@ Http::Protocol AlpnFilterConfig::getHttpProtocol(
   }
 }
 
+bool ClusterSettingsCache::skipAlpnOverride(
+    const Upstream::ClusterInfoConstSharedPtr& cluster_info) {
+  auto& tls = *tls_;
+  const auto it = tls.clusters_.find(cluster_info->name());
+  // Compares the owners, which the weak pointer keeps from being reused.
+  if (it != tls.clusters_.end() && !it->second.cluster_info_.owner_before(cluster_info) &&
+      !cluster_info.owner_before(it->second.cluster_info_)) {
+    return it->second.skip_alpn_override_;
+  }
+  if (tls.clusters_.size() >= tls.prune_at_) {
+    absl::erase_if(tls.clusters_,
+                   [](const auto& entry) { return entry.second.cluster_info_.expired(); });
+    tls.prune_at_ = std::max<size_t>(64, 2 * tls.clusters_.size());
+  }
+
+  bool skip_alpn_override = false;
+  const auto& filter_metadata = cluster_info->metadata().filter_metadata();
+  const auto& istio = filter_metadata.find("istio");
+  if (istio != filter_metadata.end()) {
+    const auto& alpn_override = istio->second.fields().find("alpn_override");
+    if (alpn_override != istio->second.fields().end()) {
+      skip_alpn_override = alpn_override->second.string_value() == "false";
+    }
+  }
+  tls.clusters_.insert_or_assign(cluster_info->name(),
+                                 ClusterSettings{cluster_info, skip_alpn_override});
+  return skip_alpn_override;
+}
+
 Http::FilterHeadersStatus AlpnFilter::decodeHeaders(Http::RequestHeaderMap&, bool) {
   Router::RouteConstSharedPtr route = decoder_callbacks_->route();
   const Router::RouteEntry* route_entry;
@@ -69,30 +106,20 @@ Http::FilterHeadersStatus AlpnFilter::decodeHeaders(Http::RequestHeaderMap&, boo
     return Http::FilterHeadersStatus::Continue;
   }
 
-  const auto& filter_metadata = cluster->info()->metadata().filter_metadata();
-  const auto& istio = filter_metadata.find("istio");
-  if (istio != filter_metadata.end()) {
-    const auto& alpn_override = istio->second.fields().find("alpn_override");
-    if (alpn_override != istio->second.fields().end()) {
-      const auto alpn_override_value = alpn_override->second.string_value();
-      if (alpn_override_value == "false") {
-        // Skip ALPN header rewrite
-        ENVOY_LOG(debug,
-                  "Skipping ALPN header rewrite because istio.alpn_override metadata is false");
-        return Http::FilterHeadersStatus::Continue;
-      }
-    }
+  if (config_->skipAlpnOverride(cluster->info())) {
+    // Skip ALPN header rewrite
+    ENVOY_LOG(debug, "Skipping ALPN header rewrite because istio.alpn_override metadata is false");
+    return Http::FilterHeadersStatus::Continue;
   }
 
   auto protocols =
       cluster->info()->upstreamHttpProtocol(decoder_callbacks_->streamInfo().protocol());
   const auto& alpn_override = config_->alpnOverrides(protocols[0]);
 
-  if (!alpn_override.empty()) {
-    ENVOY_LOG(debug, "override with {} ALPNs", alpn_override.size());
+  if (alpn_override) {
+    ENVOY_LOG(debug, "override with {} ALPNs", alpn_override->value().size());
     decoder_callbacks_->streamInfo().filterState()->setData(
-        Network::ApplicationProtocols::key(),
-        std::make_unique<Network::ApplicationProtocols>(alpn_override),
+        Network::ApplicationProtocols::key(), alpn_override,
         Envoy::StreamInfo::FilterState::StateType::ReadOnly);
   } else {
     ENVOY_LOG(debug, "ALPN override is empty");
@@ -15,6 +15,15 @@
 
 #pragma once
 
+#include <array>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "envoy/singleton/instance.h"
+#include "envoy/thread_local/thread_local.h"
+#include "envoy/upstream/upstream.h"
+#include "source/common/network/application_protocol.h"
 #include "source/extensions/filters/http/alpn/config.pb.h"
 #include "source/extensions/filters/http/common/pass_through_filter.h"
 
@@ -22,29 +31,61 @@ namespace Envoy {
 namespace Http {
 namespace Alpn {
 
-using AlpnOverrides = absl::flat_hash_map<Http::Protocol, std::vector<std::string>>;
+using ApplicationProtocolsSharedPtr = std::shared_ptr<Network::ApplicationProtocols>;
+
+// Settings read from the cluster metadata, cached on each worker. A single
+// cache is shared by all the filter configs of the server.
+class ClusterSettingsCache : public Singleton::Instance {
+public:
+  explicit ClusterSettingsCache(ThreadLocal::SlotAllocator& tls);
+
+  // Returns true if the istio.alpn_override metadata of the cluster is
+  // "false". The metadata is parsed once per cluster version on each worker.
+  bool skipAlpnOverride(const Upstream::ClusterInfoConstSharedPtr& cluster_info);
+
+private:
+  struct ClusterSettings {
+    // Version of the cluster the settings were parsed from. A cluster updated
+    // by CDS has a new info object.
+    std::weak_ptr<const Upstream::ClusterInfo> cluster_info_;
+    bool skip_alpn_override_;
+  };
+  struct ThreadLocalClusters : public ThreadLocal::ThreadLocalObject {
+    absl::flat_hash_map<std::string, ClusterSettings> clusters_;
+    size_t prune_at_{64};
+  };
+
+  ThreadLocal::TypedSlot<ThreadLocalClusters> tls_;
+};
+
+using ClusterSettingsCacheSharedPtr = std::shared_ptr<ClusterSettingsCache>;
 
 class AlpnFilterConfig {
 public:
   AlpnFilterConfig(
       const istio::envoy::config::filter::http::alpn::v2alpha1::FilterConfig& proto_config,
-      Upstream::ClusterManager& cluster_manager);
+      Upstream::ClusterManager& cluster_manager, ClusterSettingsCacheSharedPtr cluster_settings);
 
   Upstream::ClusterManager& clusterManager() { return cluster_manager_; }
 
-  const std::vector<std::string> alpnOverrides(const Http::Protocol& protocol) const {
-    if (alpn_overrides_.count(protocol)) {
-      return alpn_overrides_.at(protocol);
-    }
-    return {};
+  bool skipAlpnOverride(const Upstream::ClusterInfoConstSharedPtr& cluster_info) {
+    return cluster_settings_->skipAlpnOverride(cluster_info);
+  }
+
+  // Returns the ALPN override of the upstream protocol, or nullptr if there is
+  // none. The object is immutable and shared by all requests.
+  const ApplicationProtocolsSharedPtr& alpnOverrides(Http::Protocol protocol) const {
+    return alpn_overrides_[static_cast<size_t>(protocol)];
   }
 
 private:
   Http::Protocol getHttpProtocol(
       const istio::envoy::config::filter::http::alpn::v2alpha1::FilterConfig::Protocol& protocol);
 
-  AlpnOverrides alpn_overrides_;
+  std::array<ApplicationProtocolsSharedPtr, static_cast<size_t>(Http::Protocol::Http3) + 1>
+      alpn_overrides_;
   Upstream::ClusterManager& cluster_manager_;
+  const ClusterSettingsCacheSharedPtr cluster_settings_;
 };
 
 using AlpnFilterConfigSharedPtr = std::shared_ptr<AlpnFilterConfig>;
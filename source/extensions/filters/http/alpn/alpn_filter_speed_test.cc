@@ -0,0 +1,87 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "source/common/network/application_protocol.h"
+#include "source/common/stream_info/filter_state_impl.h"
+#include "source/extensions/filters/http/alpn/alpn_filter.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/thread_local/mocks.h"
+#include "test/mocks/upstream/mocks.h"
+#include "test/test_common/utility.h"
+
+using istio::envoy::config::filter::http::alpn::v2alpha1::FilterConfig;
+using testing::_;
+using testing::NiceMock;
+using testing::Return;
+using testing::ReturnRef;
+
+namespace Envoy {
+namespace Http {
+namespace Alpn {
+
+// Arguments: whether the cluster skips the override.
+static void BM_AlpnOverride(benchmark::State& state) {
+  const bool skip = state.range(0);
+  FilterConfig proto_config;
+  auto* entry = proto_config.add_alpn_override();
+  entry->set_upstream_protocol(FilterConfig::HTTP2);
+  entry->add_alpn_override("istio-h2");
+  entry->add_alpn_override("h2");
+
+  NiceMock<Upstream::MockClusterManager> cluster_manager;
+  NiceMock<ThreadLocal::MockInstance> tls;
+  NiceMock<Upstream::MockThreadLocalCluster> cluster;
+  auto cluster_info = std::make_shared<NiceMock<Upstream::MockClusterInfo>>();
+  const auto metadata = TestUtility::parseYaml<envoy::config::core::v3::Metadata>(
+      absl::StrCat("filter_metadata: {istio: {alpn_override: \"", skip ? "false" : "true",
+                   "\"}}"));
+  ON_CALL(cluster_manager, getThreadLocalCluster(_)).WillByDefault(Return(&cluster));
+  ON_CALL(cluster, info()).WillByDefault(Return(cluster_info));
+  ON_CALL(*cluster_info, metadata()).WillByDefault(ReturnRef(metadata));
+  ON_CALL(*cluster_info, upstreamHttpProtocol(_))
+      .WillByDefault([](absl::optional<Http::Protocol>) -> std::vector<Http::Protocol> {
+        return {Http::Protocol::Http2};
+      });
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  NiceMock<StreamInfo::MockStreamInfo> stream_info;
+  ON_CALL(callbacks, streamInfo()).WillByDefault(ReturnRef(stream_info));
+  ON_CALL(stream_info, protocol()).WillByDefault(Return(Http::Protocol::Http2));
+  StreamInfo::FilterStateSharedPtr filter_state;
+  ON_CALL(stream_info, filterState()).WillByDefault(ReturnRef(filter_state));
+
+  auto config = std::make_shared<AlpnFilterConfig>(proto_config, cluster_manager,
+                                                   std::make_shared<ClusterSettingsCache>(tls));
+  Http::TestRequestHeaderMapImpl headers;
+  for (auto _ : state) { // NOLINT
+    // Each request has its own filter and filter state.
+    filter_state = std::make_shared<StreamInfo::FilterStateImpl>(
+        StreamInfo::FilterState::LifeSpan::FilterChain);
+    AlpnFilter filter(config);
+    filter.setDecoderFilterCallbacks(callbacks);
+    benchmark::DoNotOptimize(filter.decodeHeaders(headers, false));
+  }
+  if (!skip && !filter_state->hasData<Network::ApplicationProtocols>(
+                   Network::ApplicationProtocols::key())) {
+    state.SkipWithError("ALPN was not overridden");
+  }
+}
+BENCHMARK(BM_AlpnOverride)->Arg(0)->Arg(1);
+
+} // namespace Alpn
+} // namespace Http
+} // namespace Envoy
@@ -18,6 +18,7 @@
 #include "source/common/network/application_protocol.h"
 #include "source/extensions/filters/http/alpn/alpn_filter.h"
 #include "test/mocks/http/mocks.h"
+#include "test/mocks/thread_local/mocks.h"
 #include "test/mocks/upstream/mocks.h"
 
 using istio::envoy::config::filter::http::alpn::v2alpha1::FilterConfig;
@@ -31,6 +32,8 @@ namespace Http {
 namespace Alpn {
 namespace {
 
+using AlpnOverrides = absl::flat_hash_map<Http::Protocol, std::vector<std::string>>;
+
 class AlpnFilterTest : public testing::Test {
 public:
   std::unique_ptr<AlpnFilter> makeAlpnOverrideFilter(const AlpnOverrides& alpn) {
@@ -45,7 +48,8 @@ public:
       proto_config.mutable_alpn_override()->Add(std::move(entry));
     }
 
-    auto config = std::make_shared<AlpnFilterConfig>(proto_config, cluster_manager_);
+    auto config =
+        std::make_shared<AlpnFilterConfig>(proto_config, cluster_manager_, cluster_settings_);
     auto filter = std::make_unique<AlpnFilter>(config);
     filter->setDecoderFilterCallbacks(callbacks_);
     return filter;
@@ -67,6 +71,9 @@ protected:
 
   NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks_;
   NiceMock<Upstream::MockClusterManager> cluster_manager_;
+  NiceMock<ThreadLocal::MockInstance> tls_;
+  // Shared by the configs of all the filters, as on a server.
+  ClusterSettingsCacheSharedPtr cluster_settings_{std::make_shared<ClusterSettingsCache>(tls_)};
   std::shared_ptr<Upstream::MockThreadLocalCluster> fake_cluster_{
       std::make_shared<NiceMock<Upstream::MockThreadLocalCluster>>()};
   std::shared_ptr<Upstream::MockClusterInfo> cluster_info_{
@@ -123,6 +130,7 @@ TEST_F(AlpnFilterTest, OverrideAlpn) {
         return {Http::Protocol::Http2};
       });
 
+  const Network::ApplicationProtocols* shared_override = nullptr;
   auto protocols = {Http::Protocol::Http10, Http::Protocol::Http11, Http::Protocol::Http2};
   for (const auto p : protocols) {
     EXPECT_CALL(stream_info, protocol()).WillOnce(Return(p));
@@ -133,12 +141,16 @@ TEST_F(AlpnFilterTest, OverrideAlpn) {
     EXPECT_EQ(filter->decodeHeaders(headers_, false), Http::FilterHeadersStatus::Continue);
     EXPECT_TRUE(
         filter_state->hasData<Network::ApplicationProtocols>(Network::ApplicationProtocols::key()));
-    auto alpn_override =
-        filter_state
-            ->getDataReadOnly<Network::ApplicationProtocols>(Network::ApplicationProtocols::key())
-            ->value();
-
-    EXPECT_EQ(alpn_override, alpn.at(Http::Protocol::Http2));
+    const auto* application_protocols =
+        filter_state->getDataReadOnly<Network::ApplicationProtocols>(
+            Network::ApplicationProtocols::key());
+
+    EXPECT_EQ(application_protocols->value(), alpn.at(Http::Protocol::Http2));
+    // The same immutable object is shared by all requests.
+    if (shared_override) {
+      EXPECT_EQ(application_protocols, shared_override);
+    }
+    shared_override = application_protocols;
   }
 }
 
@@ -188,6 +200,42 @@ TEST_F(AlpnFilterTest, AlpnOverrideFalse) {
   EXPECT_EQ(filter->decodeHeaders(headers_, false), Http::FilterHeadersStatus::Continue);
 }
 
+TEST_F(AlpnFilterTest, ClusterMetadataParsedOncePerVersion) {
+  NiceMock<StreamInfo::MockStreamInfo> stream_info;
+  auto metadata = TestUtility::parseYaml<envoy::config::core::v3::Metadata>(R"EOF(
+        filter_metadata:
+          istio:
+            alpn_override: "false"
+      )EOF");
+  ON_CALL(callbacks_, streamInfo()).WillByDefault(ReturnRef(stream_info));
+  ON_CALL(cluster_manager_, getThreadLocalCluster(_)).WillByDefault(Return(fake_cluster_.get()));
+  ON_CALL(*fake_cluster_, info()).WillByDefault(Return(cluster_info_));
+  EXPECT_CALL(*cluster_info_, metadata()).WillOnce(ReturnRef(metadata));
+
+  const AlpnOverrides alpn = {{Http::Protocol::Http2, {"qux"}}};
+  EXPECT_CALL(*cluster_info_, upstreamHttpProtocol(_)).Times(0);
+  for (int i = 0; i < 3; i++) {
+    auto filter = makeAlpnOverrideFilter(alpn);
+    EXPECT_EQ(filter->decodeHeaders(headers_, false), Http::FilterHeadersStatus::Continue);
+  }
+
+  // A CDS update replaces the info of the cluster, with the same name.
+  auto updated_info = std::make_shared<NiceMock<Upstream::MockClusterInfo>>();
+  ON_CALL(*fake_cluster_, info()).WillByDefault(Return(updated_info));
+  ON_CALL(*updated_info, upstreamHttpProtocol(_))
+      .WillByDefault([](absl::optional<Http::Protocol>) -> std::vector<Http::Protocol> {
+        return {Http::Protocol::Http2};
+      });
+  Envoy::StreamInfo::FilterStateSharedPtr filter_state(
+      std::make_shared<Envoy::StreamInfo::FilterStateImpl>(
+          Envoy::StreamInfo::FilterState::LifeSpan::FilterChain));
+  ON_CALL(stream_info, filterState()).WillByDefault(ReturnRef(filter_state));
+  auto filter = makeAlpnOverrideFilter(alpn);
+  EXPECT_EQ(filter->decodeHeaders(headers_, false), Http::FilterHeadersStatus::Continue);
+  EXPECT_TRUE(
+      filter_state->hasData<Network::ApplicationProtocols>(Network::ApplicationProtocols::key()));
+}
+
 } // namespace
 } // namespace Alpn
 } // namespace Http
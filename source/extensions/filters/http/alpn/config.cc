@@ -15,6 +15,7 @@
 
 #include "source/extensions/filters/http/alpn/config.h"
 
+#include "envoy/singleton/manager.h"
 #include "source/common/protobuf/message_validator_impl.h"
 #include "source/extensions/filters/http/alpn/alpn_filter.h"
 
@@ -23,11 +24,19 @@ using istio::envoy::config::filter::http::alpn::v2alpha1::FilterConfig;
 namespace Envoy {
 namespace Http {
 namespace Alpn {
+
+SINGLETON_MANAGER_REGISTRATION(alpn_cluster_settings)
+
 absl::StatusOr<Http::FilterFactoryCb>
 AlpnConfigFactory::createFilterFactoryFromProto(const Protobuf::Message& config, const std::string&,
                                                 Server::Configuration::FactoryContext& context) {
+  auto& server_context = context.serverFactoryContext();
+  auto cluster_settings = server_context.singletonManager().getTyped<ClusterSettingsCache>(
+      SINGLETON_MANAGER_REGISTERED_NAME(alpn_cluster_settings), [&server_context] {
+        return std::make_shared<ClusterSettingsCache>(server_context.threadLocal());
+      });
   return createFilterFactory(dynamic_cast<const FilterConfig&>(config),
-                             context.serverFactoryContext().clusterManager());
+                             server_context.clusterManager(), std::move(cluster_settings));
 }
 
 ProtobufTypes::MessagePtr AlpnConfigFactory::createEmptyConfigProto() {
@@ -38,9 +47,10 @@ std::string AlpnConfigFactory::name() const { return "istio.alpn"; }
 
 Http::FilterFactoryCb
 AlpnConfigFactory::createFilterFactory(const FilterConfig& proto_config,
-                                       Upstream::ClusterManager& cluster_manager) {
-  AlpnFilterConfigSharedPtr filter_config{
-      std::make_shared<AlpnFilterConfig>(proto_config, cluster_manager)};
+                                       Upstream::ClusterManager& cluster_manager,
+                                       ClusterSettingsCacheSharedPtr cluster_settings) {
+  AlpnFilterConfigSharedPtr filter_config{std::make_shared<AlpnFilterConfig>(
+      proto_config, cluster_manager, std::move(cluster_settings))};
   return [filter_config](Http::FilterChainFactoryCallbacks& callbacks) -> void {
     callbacks.addStreamDecoderFilter(std::make_unique<AlpnFilter>(filter_config));
   };
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include "source/extensions/filters/http/alpn/alpn_filter.h"
 #include "source/extensions/filters/http/alpn/config.pb.h"
 #include "source/extensions/filters/http/common/factory_base.h"
 
@@ -37,7 +38,7 @@ public:
 private:
   Http::FilterFactoryCb createFilterFactory(
       const istio::envoy::config::filter::http::alpn::v2alpha1::FilterConfig& config_pb,
-      Upstream::ClusterManager& cluster_manager);
+      Upstream::ClusterManager& cluster_manager, ClusterSettingsCacheSharedPtr cluster_settings);
 };
 
 } // namespace Alpn
@@ -0,0 +1,83 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/filters/http/istio_stats/bypass.h"
+
+#include "envoy/common/exception.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+Bypass::Bypass(const stats::Bypass& proto_config)
+    : path_prefixes_(proto_config.path_prefixes().begin(), proto_config.path_prefixes().end()),
+      route_names_(proto_config.route_names().begin(), proto_config.route_names().end()) {
+  for (const auto& header : proto_config.headers()) {
+    headers_.push_back({Http::LowerCaseString(header.name()), header.exact(), header.prefix()});
+  }
+  for (const auto& cidr : proto_config.source_cidrs()) {
+    auto range = Network::Address::CidrRange::create(cidr);
+    if (!range.ok()) {
+      throw EnvoyException(absl::StrCat("invalid bypass source CIDR ", cidr, ": ",
+                                        range.status().message()));
+    }
+    source_cidrs_.push_back(std::move(range.value()));
+  }
+}
+
+bool Bypass::matches(const Http::RequestHeaderMap& request_headers,
+                     Http::StreamDecoderFilterCallbacks& callbacks) const {
+  for (const auto& header : headers_) {
+    const auto values = request_headers.get(header.name_);
+    for (size_t i = 0; i < values.size(); i++) {
+      const auto value = values[i]->value().getStringView();
+      if ((header.exact_.empty() || value == header.exact_) &&
+          absl::StartsWith(value, header.prefix_)) {
+        return true;
+      }
+    }
+  }
+  if (!path_prefixes_.empty()) {
+    const auto path = request_headers.getPathValue();
+    for (const auto& prefix : path_prefixes_) {
+      if (absl::StartsWith(path, prefix)) {
+        return true;
+      }
+    }
+  }
+  if (!source_cidrs_.empty()) {
+    const auto& address = callbacks.streamInfo().downstreamAddressProvider().remoteAddress();
+    for (const auto& cidr : source_cidrs_) {
+      if (address && cidr.isInRange(*address)) {
+        return true;
+      }
+    }
+  }
+  if (!route_names_.empty()) {
+    const auto route = callbacks.route();
+    if (route && route_names_.contains(route->routeName())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
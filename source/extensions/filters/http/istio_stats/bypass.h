@@ -0,0 +1,59 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "envoy/http/filter.h"
+#include "envoy/http/header_map.h"
+#include "envoy/network/address.h"
+#include "source/common/network/cidr_range.h"
+#include "source/extensions/filters/http/istio_stats/config.pb.h"
+
+#include "absl/container/flat_hash_set.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+// Requests excluded from the istio metrics, e.g. the health probes. A request
+// is bypassed if any of the headers, path prefixes, source ranges or route
+// names matches.
+class Bypass {
+public:
+  // Throws EnvoyException on an invalid source CIDR.
+  explicit Bypass(const stats::Bypass& proto_config);
+
+  bool matches(const Http::RequestHeaderMap& request_headers,
+               Http::StreamDecoderFilterCallbacks& callbacks) const;
+
+private:
+  struct Header {
+    Http::LowerCaseString name_;
+    std::string exact_;
+    std::string prefix_;
+  };
+  std::vector<Header> headers_;
+  const std::vector<std::string> path_prefixes_;
+  std::vector<Network::Address::CidrRange> source_cidrs_;
+  const absl::flat_hash_set<std::string> route_names_;
+};
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
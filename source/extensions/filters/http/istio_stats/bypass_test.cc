@@ -0,0 +1,163 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/filters/http/istio_stats/bypass.h"
+
+#include "source/common/network/utility.h"
+#include "test/mocks/http/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::NiceMock;
+using testing::Return;
+using testing::ReturnRef;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+namespace {
+
+class BypassTest : public testing::Test {
+protected:
+  BypassTest() {
+    ON_CALL(*callbacks_.route_, routeName()).WillByDefault(ReturnRef(route_name_));
+    setRemoteAddress("192.168.0.1");
+  }
+
+  static Bypass create(const std::string& yaml) {
+    stats::Bypass proto_config;
+    TestUtility::loadFromYaml(yaml, proto_config);
+    return Bypass(proto_config);
+  }
+
+  void setRemoteAddress(const std::string& address) {
+    callbacks_.stream_info_.downstream_connection_info_provider_->setRemoteAddress(
+        Network::Utility::parseInternetAddressNoThrow(address));
+  }
+
+  bool matches(const Bypass& bypass) { return bypass.matches(headers_, callbacks_); }
+
+  Http::TestRequestHeaderMapImpl headers_{{":method", "GET"}, {":path", "/productpage"}};
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks_;
+  std::string route_name_{"default"};
+};
+
+TEST_F(BypassTest, Empty) { EXPECT_FALSE(matches(create("{}"))); }
+
+TEST_F(BypassTest, HeaderExact) {
+  const auto bypass = create(R"EOF(
+headers:
+  - name: User-Agent
+    exact: kube-probe/1.30
+)EOF");
+  EXPECT_FALSE(matches(bypass));
+  headers_.addCopy("user-agent", "kube-probe/1.30.1");
+  EXPECT_FALSE(matches(bypass));
+  // Any of the values of the header.
+  headers_.addCopy("user-agent", "kube-probe/1.30");
+  EXPECT_TRUE(matches(bypass));
+}
+
+TEST_F(BypassTest, HeaderPrefix) {
+  const auto bypass = create(R"EOF(
+headers:
+  - name: user-agent
+    prefix: kube-probe/
+)EOF");
+  headers_.setCopy(Http::LowerCaseString("user-agent"), "curl/8.0");
+  EXPECT_FALSE(matches(bypass));
+  headers_.setCopy(Http::LowerCaseString("user-agent"), "kube-probe/1.30");
+  EXPECT_TRUE(matches(bypass));
+}
+
+TEST_F(BypassTest, HeaderPresence) {
+  const auto bypass = create(R"EOF(
+headers:
+  - name: x-health-check
+)EOF");
+  EXPECT_FALSE(matches(bypass));
+  headers_.addCopy("x-health-check", "");
+  EXPECT_TRUE(matches(bypass));
+}
+
+TEST_F(BypassTest, PathPrefix) {
+  const auto bypass = create(R"EOF(
+path_prefixes:
+  - /healthz
+  - /ready
+)EOF");
+  EXPECT_FALSE(matches(bypass));
+  headers_.setPath("/readyz");
+  EXPECT_TRUE(matches(bypass));
+  headers_.setPath("/healthz/live");
+  EXPECT_TRUE(matches(bypass));
+}
+
+TEST_F(BypassTest, SourceCidr) {
+  const auto bypass = create(R"EOF(
+source_cidrs:
+  - 10.0.0.0/8
+  - 2001:db8::/32
+)EOF");
+  EXPECT_FALSE(matches(bypass));
+  setRemoteAddress("10.1.2.3");
+  EXPECT_TRUE(matches(bypass));
+  setRemoteAddress("2001:db8::1");
+  EXPECT_TRUE(matches(bypass));
+  setRemoteAddress("2001:db9::1");
+  EXPECT_FALSE(matches(bypass));
+}
+
+TEST_F(BypassTest, InvalidSourceCidr) {
+  EXPECT_THROW_WITH_REGEX(create(R"EOF(
+source_cidrs:
+  - 10.0.0.0/8
+  - 10.0.0.300/8
+)EOF"),
+                          EnvoyException, "invalid bypass source CIDR 10.0.0.300/8");
+}
+
+TEST_F(BypassTest, RouteName) {
+  const auto bypass = create(R"EOF(
+route_names:
+  - health
+)EOF");
+  EXPECT_FALSE(matches(bypass));
+  route_name_ = "health";
+  EXPECT_TRUE(matches(bypass));
+  ON_CALL(callbacks_, route()).WillByDefault(Return(nullptr));
+  EXPECT_FALSE(matches(bypass));
+}
+
+TEST_F(BypassTest, AnyFieldMatches) {
+  const auto bypass = create(R"EOF(
+headers:
+  - name: user-agent
+    prefix: kube-probe/
+path_prefixes:
+  - /healthz
+)EOF");
+  EXPECT_FALSE(matches(bypass));
+  headers_.setPath("/healthz");
+  EXPECT_TRUE(matches(bypass));
+}
+
+} // namespace
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,117 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/filters/http/istio_stats/cardinality.h"
+
+#include <algorithm>
+
+#include "envoy/stats/stats.h"
+
+#include "absl/strings/match.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+namespace {
+
+ProtobufWkt::Struct toStruct(uint64_t series, uint64_t bytes) {
+  ProtobufWkt::Struct out;
+  (*out.mutable_fields())["series"].set_number_value(series);
+  (*out.mutable_fields())["bytes"].set_number_value(bytes);
+  return out;
+}
+
+} // namespace
+
+void Cardinality::addScope(const Stats::Scope& scope, absl::string_view state) {
+  std::vector<std::pair<Stats::RefcountPtr<Stats::Metric>, uint64_t>> metrics;
+  scope.iterate(Stats::IterateFn<Stats::Counter>([&](const Stats::CounterSharedPtr& counter) {
+    metrics.emplace_back(counter.get(), CounterBytes);
+    return true;
+  }));
+  scope.iterate(Stats::IterateFn<Stats::Gauge>([&](const Stats::GaugeSharedPtr& gauge) {
+    metrics.emplace_back(gauge.get(), GaugeBytes);
+    return true;
+  }));
+  scope.iterate(
+      Stats::IterateFn<Stats::Histogram>([&](const Stats::HistogramSharedPtr& histogram) {
+        metrics.emplace_back(histogram.get(), HistogramBytes);
+        return true;
+      }));
+  Series total;
+  for (const auto& [metric, bytes] : metrics) {
+    add(*metric, bytes, total);
+  }
+  scopes_.emplace_back(state, total);
+}
+
+void Cardinality::add(const Stats::Metric& metric, uint64_t bytes, Series& scope) {
+  const std::string name = metric.tagExtractedName();
+  if (!absl::StartsWith(name, prefix_) || !seen_.insert(&metric).second) {
+    return;
+  }
+  bytes += metric.statName().size();
+  auto& entry = metrics_[name.substr(prefix_.size())];
+  entry.total_.series_++;
+  entry.total_.bytes_ += bytes;
+  for (const auto& tag : metric.tags()) {
+    entry.tags_[tag.name_][tag.value_]++;
+  }
+  scope.series_++;
+  scope.bytes_ += bytes;
+}
+
+ProtobufWkt::Struct Cardinality::report(size_t top, absl::string_view metric) const {
+  ProtobufWkt::Struct out;
+  auto* scopes = (*out.mutable_fields())["scopes"].mutable_list_value();
+  for (const auto& [state, total] : scopes_) {
+    auto scope = toStruct(total.series_, total.bytes_);
+    (*scope.mutable_fields())["state"].set_string_value(state);
+    *scopes->add_values()->mutable_struct_value() = std::move(scope);
+  }
+  auto* metrics = (*out.mutable_fields())["metrics"].mutable_struct_value();
+  for (const auto& [name, entry] : metrics_) {
+    if (!metric.empty() && name != metric) {
+      continue;
+    }
+    auto report = toStruct(entry.total_.series_, entry.total_.bytes_);
+    auto* tags = (*report.mutable_fields())["tags"].mutable_struct_value();
+    for (const auto& [tag, values] : entry.tags_) {
+      std::vector<std::pair<absl::string_view, uint64_t>> heaviest(values.begin(), values.end());
+      const size_t n = std::min(top, heaviest.size());
+      std::partial_sort(heaviest.begin(), heaviest.begin() + n, heaviest.end(),
+                        [](const auto& a, const auto& b) {
+                          return a.second > b.second || (a.second == b.second && a.first < b.first);
+                        });
+      ProtobufWkt::Struct tag_report;
+      (*tag_report.mutable_fields())["values"].set_number_value(values.size());
+      auto* list = (*tag_report.mutable_fields())["top"].mutable_list_value();
+      for (size_t i = 0; i < n; i++) {
+        auto* value = list->add_values()->mutable_struct_value();
+        (*value->mutable_fields())["value"].set_string_value(std::string(heaviest[i].first));
+        (*value->mutable_fields())["series"].set_number_value(heaviest[i].second);
+      }
+      *(*tags->mutable_fields())[tag].mutable_struct_value() = std::move(tag_report);
+    }
+    (*metrics->mutable_fields())[name].mutable_struct_value()->Swap(&report);
+  }
+  return out;
+}
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,77 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <map>
+
+#include "envoy/stats/scope.h"
+#include "source/common/protobuf/protobuf.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+// Series count of the istio metrics by metric and tag, with an estimate of
+// their memory.
+class Cardinality {
+public:
+  // Rough size of the stat objects of a series, excluding the name. A
+  // histogram has interval and cumulative log-linear histograms, its
+  // per-worker histograms are not accounted for.
+  static constexpr uint64_t CounterBytes = 64;
+  static constexpr uint64_t GaugeBytes = 64;
+  static constexpr uint64_t HistogramBytes = 1024;
+
+  // Only the metrics with a tag extracted name starting with the prefix are
+  // reported, without it.
+  explicit Cardinality(absl::string_view prefix) : prefix_(prefix) {}
+
+  // Adds the metrics of a scope. The store lock of the scope is held only
+  // while references to its metrics are taken, the metrics are read after.
+  // Series shared with a previous scope are counted once.
+  void addScope(const Stats::Scope& scope, absl::string_view state);
+
+  // Returns the series count and bytes of the scopes and of each metric,
+  // with the number of distinct values of each tag and the top values by
+  // series count. Restricted to a single metric if set.
+  ProtobufWkt::Struct report(size_t top, absl::string_view metric = {}) const;
+
+private:
+  struct Series {
+    uint64_t series_{0};
+    uint64_t bytes_{0};
+  };
+  struct Metric {
+    Series total_;
+    // Series count of each value of each tag.
+    std::map<std::string, absl::flat_hash_map<std::string, uint64_t>> tags_;
+  };
+
+  void add(const Stats::Metric& metric, uint64_t bytes, Series& scope);
+
+  const std::string prefix_;
+  std::vector<std::pair<std::string, Series>> scopes_;
+  std::map<std::string, Metric> metrics_;
+  absl::flat_hash_set<const Stats::Metric*> seen_;
+};
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,118 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/filters/http/istio_stats/cardinality.h"
+
+#include "source/common/stats/isolated_store_impl.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+namespace {
+
+class CardinalityTest : public testing::Test {
+protected:
+  CardinalityTest() : pool_(store_.symbolTable()) {}
+
+  void addCounter(Stats::Scope& scope, absl::string_view name, absl::string_view workload,
+                  absl::string_view code) {
+    scope.counterFromStatNameWithTags(
+        pool_.add(name), {{pool_.add("source_workload"), pool_.add(workload)},
+                          {pool_.add("response_code"), pool_.add(code)}});
+  }
+
+  static const ProtobufWkt::Struct& field(const ProtobufWkt::Struct& value,
+                                          const std::string& name) {
+    return value.fields().at(name).struct_value();
+  }
+
+  static double number(const ProtobufWkt::Struct& value, const std::string& name) {
+    return value.fields().at(name).number_value();
+  }
+
+  Stats::IsolatedStoreImpl store_;
+  Stats::StatNamePool pool_;
+};
+
+TEST_F(CardinalityTest, CountsSeriesByMetricAndTag) {
+  Stats::Scope& scope = *store_.rootScope();
+  addCounter(scope, "istiocustom.istio_requests_total", "a", "200");
+  addCounter(scope, "istiocustom.istio_requests_total", "a", "503");
+  addCounter(scope, "istiocustom.istio_requests_total", "b", "200");
+  scope.histogramFromStatName(pool_.add("istiocustom.istio_request_bytes"),
+                              Stats::Histogram::Unit::Bytes);
+  scope.counterFromStatName(pool_.add("cluster.outbound.upstream_rq_total"));
+
+  Cardinality cardinality("istiocustom.");
+  cardinality.addScope(scope, "active");
+  const auto report = cardinality.report(1);
+
+  const auto& scopes = report.fields().at("scopes").list_value();
+  ASSERT_EQ(1, scopes.values_size());
+  EXPECT_EQ("active", scopes.values(0).struct_value().fields().at("state").string_value());
+  EXPECT_EQ(4, number(scopes.values(0).struct_value(), "series"));
+
+  const auto& metrics = field(report, "metrics");
+  EXPECT_EQ(2, metrics.fields_size());
+  const auto& requests = field(metrics, "istio_requests_total");
+  EXPECT_EQ(3, number(requests, "series"));
+  EXPECT_LE(3 * Cardinality::CounterBytes, number(requests, "bytes"));
+  const auto& workload = field(field(requests, "tags"), "source_workload");
+  EXPECT_EQ(2, number(workload, "values"));
+  const auto& top = workload.fields().at("top").list_value();
+  ASSERT_EQ(1, top.values_size());
+  EXPECT_EQ("a", top.values(0).struct_value().fields().at("value").string_value());
+  EXPECT_EQ(2, number(top.values(0).struct_value(), "series"));
+  EXPECT_EQ(1, number(field(metrics, "istio_request_bytes"), "series"));
+}
+
+TEST_F(CardinalityTest, FiltersMetric) {
+  Stats::Scope& scope = *store_.rootScope();
+  addCounter(scope, "istiocustom.istio_requests_total", "a", "200");
+  scope.histogramFromStatName(pool_.add("istiocustom.istio_request_bytes"),
+                              Stats::Histogram::Unit::Bytes);
+
+  Cardinality cardinality("istiocustom.");
+  cardinality.addScope(scope, "active");
+  const auto& metrics = field(cardinality.report(10, "istio_request_bytes"), "metrics");
+  EXPECT_EQ(1, metrics.fields_size());
+  EXPECT_TRUE(metrics.fields().contains("istio_request_bytes"));
+}
+
+TEST_F(CardinalityTest, CountsSharedSeriesOnce) {
+  auto active = store_.rootScope()->createScope("");
+  auto draining = store_.rootScope()->createScope("");
+  addCounter(*draining, "istiocustom.istio_requests_total", "a", "200");
+  addCounter(*active, "istiocustom.istio_requests_total", "a", "200");
+  addCounter(*active, "istiocustom.istio_requests_total", "b", "200");
+
+  Cardinality cardinality("istiocustom.");
+  cardinality.addScope(*active, "active");
+  cardinality.addScope(*draining, "draining");
+  const auto report = cardinality.report(10);
+  const auto& scopes = report.fields().at("scopes").list_value();
+  ASSERT_EQ(2, scopes.values_size());
+  EXPECT_EQ(2, number(scopes.values(0).struct_value(), "series"));
+  EXPECT_EQ(0, number(scopes.values(1).struct_value(), "series"));
+  EXPECT_EQ(2, number(field(field(report, "metrics"), "istio_requests_total"), "series"));
+}
+
+} // namespace
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
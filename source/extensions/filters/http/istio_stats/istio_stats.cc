@@ -16,22 +16,31 @@
 
 #include <atomic>
 
+#include "absl/strings/match.h"
 #include "envoy/router/string_accessor.h"
 #include "envoy/registry/registry.h"
+#include "envoy/server/admin.h"
 #include "envoy/server/factory_context.h"
 #include "envoy/singleton/manager.h"
+#include "envoy/thread_local/thread_local.h"
+#include "extensions/common/host_metadata_cache.h"
 #include "extensions/common/metadata_object.h"
+#include "extensions/common/self_time.h"
 #include "parser/parser.h"
 #include "source/common/grpc/common.h"
 #include "source/common/http/header_map_impl.h"
 #include "source/common/http/header_utility.h"
 #include "source/common/network/utility.h"
+#include "source/common/protobuf/utility.h"
 #include "source/common/stream_info/utility.h"
 #include "source/extensions/filters/common/expr/cel_state.h"
 #include "source/extensions/filters/common/expr/context.h"
 #include "source/extensions/filters/common/expr/evaluator.h"
 #include "source/extensions/filters/http/common/pass_through_filter.h"
 #include "source/extensions/filters/http/grpc_stats/grpc_stats_filter.h"
+#include "source/extensions/filters/http/istio_stats/bypass.h"
+#include "source/extensions/filters/http/istio_stats/cardinality.h"
+#include "source/extensions/filters/http/istio_stats/istio_store.h"
 
 #if defined(__GNUC__)
 #pragma GCC diagnostic push
@@ -87,21 +96,36 @@ absl::string_view extractMapString(const ProtobufWkt::Struct& metadata, const st
   return extractString(it->second.struct_value(), key);
 }
 
-absl::optional<Istio::Common::WorkloadMetadataObject>
-extractEndpointMetadata(const StreamInfo::StreamInfo& info) {
-  auto upstream_info = info.upstreamInfo();
-  auto upstream_host = upstream_info ? upstream_info->upstreamHost() : nullptr;
-  if (upstream_host && upstream_host->metadata()) {
-    const auto& filter_metadata = upstream_host->metadata()->filter_metadata();
-    const auto& it = filter_metadata.find("istio");
-    if (it != filter_metadata.end()) {
-      const auto& workload_it = it->second.fields().find("workload");
-      if (workload_it != it->second.fields().end()) {
-        return Istio::Common::convertEndpointMetadata(workload_it->second.string_value());
+using WorkloadMetadataObjectConstSharedPtr =
+    std::shared_ptr<const Istio::Common::WorkloadMetadataObject>;
+using EndpointMetadataCache =
+    Istio::Common::HostMetadataCache<WorkloadMetadataObjectConstSharedPtr>;
+
+WorkloadMetadataObjectConstSharedPtr
+decodeEndpointMetadata(const envoy::config::core::v3::Metadata& metadata) {
+  const auto& filter_metadata = metadata.filter_metadata();
+  const auto& it = filter_metadata.find("istio");
+  if (it != filter_metadata.end()) {
+    const auto& workload_it = it->second.fields().find("workload");
+    if (workload_it != it->second.fields().end()) {
+      auto object = Istio::Common::convertEndpointMetadata(workload_it->second.string_value());
+      if (object) {
+        return std::make_shared<const Istio::Common::WorkloadMetadataObject>(*object);
       }
     }
   }
-  return {};
+  return nullptr;
+}
+
+// The endpoint metadata is decoded once per upstream host.
+WorkloadMetadataObjectConstSharedPtr extractEndpointMetadata(const StreamInfo::StreamInfo& info,
+                                                             EndpointMetadataCache& cache) {
+  auto upstream_info = info.upstreamInfo();
+  auto upstream_host = upstream_info ? upstream_info->upstreamHost() : nullptr;
+  if (!upstream_host) {
+    return nullptr;
+  }
+  return cache.get(*upstream_host, decodeEndpointMetadata);
 }
 
 enum class Reporter {
@@ -316,6 +340,85 @@ using ContextSharedPtr = std::shared_ptr<Context>;
 
 SINGLETON_MANAGER_REGISTRATION(Context)
 
+constexpr absl::string_view CardinalityPath = "/istio/stats/cardinality";
+constexpr absl::string_view PrometheusPath = "/istio/stats/prometheus";
+
+// Default number of values reported for each tag by the cardinality handler.
+constexpr size_t CardinalityTopValues = 10;
+
+class RotatingScope;
+
+// Admin handlers of the istio metrics of all the filter configs: the
+// cardinality of the metrics in the scopes, and the series of the dedicated
+// store in the Prometheus format. Scopes are rotated, the store is merged,
+// and both are reported on the main thread. The dedicated store is shared by
+// the configs of the server, so that its series survive the config updates.
+class StatsAdmin : public Singleton::Instance {
+public:
+  explicit StatsAdmin(Server::Configuration::ServerFactoryContext& server_context)
+      : server_context_(server_context), admin_(server_context.admin()) {
+    if (admin_) {
+      admin_->addHandler(std::string(CardinalityPath),
+                         "print the series count of the istio metrics by metric and tag "
+                         "(params: top, metric)",
+                         MAKE_ADMIN_HANDLER(cardinalityHandler), true, false);
+      admin_->addHandler(std::string(PrometheusPath),
+                         "print the istio metrics of the dedicated store in prometheus format",
+                         MAKE_ADMIN_HANDLER(prometheusHandler), true, false);
+    }
+  }
+  ~StatsAdmin() override {
+    if (admin_) {
+      admin_->removeHandler(std::string(CardinalityPath));
+      admin_->removeHandler(std::string(PrometheusPath));
+    }
+  }
+
+  void add(const RotatingScope& scope) { scopes_.insert(&scope); }
+  void remove(const RotatingScope& scope) { scopes_.erase(&scope); }
+
+  // Returns the dedicated store, created with the expiry of the first config
+  // using it.
+  IstioStore& store(std::chrono::milliseconds expiry) {
+    if (!store_) {
+      store_ = std::make_unique<IstioStore>(
+          server_context_.scope().symbolTable(), server_context_.threadLocal(),
+          server_context_.mainThreadDispatcher(), server_context_.statsConfig().flushInterval(),
+          expiry);
+    }
+    return *store_;
+  }
+
+private:
+  Http::Code cardinalityHandler(Http::ResponseHeaderMap& response_headers,
+                                Buffer::Instance& response, Server::AdminStream& admin_stream);
+  Http::Code prometheusHandler(Http::ResponseHeaderMap&, Buffer::Instance& response,
+                               Server::AdminStream&) {
+    if (store_) {
+      IstioStore::Table table(server_context_.scope().symbolTable());
+      store_->addTo(table);
+      response.add(IstioStore::render(table));
+    }
+    return Http::Code::OK;
+  }
+
+  Server::Configuration::ServerFactoryContext& server_context_;
+  OptRef<Server::Admin> admin_;
+  absl::flat_hash_set<const RotatingScope*> scopes_;
+  std::unique_ptr<IstioStore> store_;
+};
+
+using StatsAdminSharedPtr = std::shared_ptr<StatsAdmin>;
+
+SINGLETON_MANAGER_REGISTRATION(StatsAdmin)
+
+StatsAdminSharedPtr getStatsAdmin(Server::Configuration::FactoryContext& factory_context) {
+  return factory_context.serverFactoryContext().singletonManager().getTyped<StatsAdmin>(
+      SINGLETON_MANAGER_REGISTERED_NAME(StatsAdmin), [&factory_context] {
+        return std::make_shared<StatsAdmin>(factory_context.serverFactoryContext());
+      });
+}
+
 using google::api::expr::runtime::CelValue;
 
 // Instructions on dropping, creating, and overriding labels.
@@ -348,6 +451,45 @@ struct MetricOverrides : public Logger::Loggable<Logger::Id::filter> {
   // Third transformation: tags added.
   using TagAdditions = std::vector<std::pair<Stats::StatName, uint32_t>>;
   absl::flat_hash_map<Stats::StatName, TagAdditions> tag_additions_;
+  // Conditions required to record a metric, checked before its tags are built.
+  absl::flat_hash_map<Stats::StatName, std::vector<uint32_t>> metric_matches_;
+  // Conditions of the metric matches, evaluated once per stream evaluation.
+  std::vector<uint32_t> match_conditions_;
+  // Expressions of the tags and the value of each recorded metric, evaluated
+  // only if the metric matches.
+  absl::flat_hash_map<Stats::StatName, std::vector<uint32_t>> metric_exprs_;
+
+  void indexExpressions() {
+    const auto add = [this](Stats::StatName metric, absl::optional<uint32_t> value) {
+      if (drop_.contains(metric)) {
+        return;
+      }
+      auto& exprs = metric_exprs_[metric];
+      if (value.has_value()) {
+        exprs.push_back(value.value());
+      }
+      const auto& tag_overrides_it = tag_overrides_.find(metric);
+      if (tag_overrides_it != tag_overrides_.end()) {
+        for (const auto& [_, id] : tag_overrides_it->second) {
+          if (id.has_value()) {
+            exprs.push_back(id.value());
+          }
+        }
+      }
+      const auto& tag_additions_it = tag_additions_.find(metric);
+      if (tag_additions_it != tag_additions_.end()) {
+        for (const auto& [_, id] : tag_additions_it->second) {
+          exprs.push_back(id);
+        }
+      }
+    };
+    for (const auto& [_, metric] : context_->all_metrics_) {
+      add(metric, {});
+    }
+    for (const auto& [_, metric] : custom_metrics_) {
+      add(metric.name_, metric.expr_);
+    }
+  }
 
   Stats::StatNameTagVector
   overrideTags(Stats::StatName metric, const Stats::StatNameTagVector& tags,
@@ -383,9 +525,33 @@ struct MetricOverrides : public Logger::Loggable<Logger::Id::filter> {
     if (it != expression_ids_.end()) {
       return {it->second};
     }
+    const auto& attribute_it = attribute_ids_.find(expr);
+    if (!int_expr && attribute_it != attribute_ids_.end()) {
+      // Generated attributes are read directly, without the CEL evaluation.
+      compiled_exprs_.push_back({nullptr, false, attribute_it->second});
+    } else {
+      auto compiled = compileExpression(expr);
+      if (compiled == nullptr) {
+        return {};
+      }
+      compiled_exprs_.push_back({std::move(compiled), int_expr, {}});
+    }
+    uint32_t id = compiled_exprs_.size() - 1;
+    expression_ids_.emplace(expr, id);
+    return {id};
+  }
+  absl::optional<uint32_t> createCondition(const std::string& expr) {
+    auto compiled = compileExpression(expr);
+    if (compiled == nullptr) {
+      return {};
+    }
+    conditions_.push_back(std::move(compiled));
+    return {static_cast<uint32_t>(conditions_.size() - 1)};
+  }
+  Filters::Common::Expr::ExpressionPtr compileExpression(const std::string& expr) {
     auto parse_status = google::api::expr::parser::Parse(expr);
     if (!parse_status.ok()) {
-      return {};
+      return nullptr;
     }
     if (expr_builder_ == nullptr) {
       google::api::expr::runtime::InterpreterOptions options;
@@ -398,17 +564,29 @@ struct MetricOverrides : public Logger::Loggable<Logger::Id::filter> {
       }
     }
     parsed_exprs_.push_back(parse_status.value().expr());
-    compiled_exprs_.push_back(std::make_pair(
-        Extensions::Filters::Common::Expr::createExpression(*expr_builder_, parsed_exprs_.back()),
-        int_expr));
-    uint32_t id = compiled_exprs_.size() - 1;
-    expression_ids_.emplace(expr, id);
-    return {id};
+    return Extensions::Filters::Common::Expr::createExpression(*expr_builder_,
+                                                               parsed_exprs_.back());
   }
+  struct CompiledExpression {
+    Filters::Common::Expr::ExpressionPtr expr_;
+    bool int_expr_;
+    // Set if the expression is the name of a generated attribute.
+    absl::optional<uint32_t> attribute_;
+  };
   Filters::Common::Expr::BuilderPtr expr_builder_;
   std::vector<google::api::expr::v1alpha1::Expr> parsed_exprs_;
-  std::vector<std::pair<Filters::Common::Expr::ExpressionPtr, bool>> compiled_exprs_;
+  std::vector<CompiledExpression> compiled_exprs_;
   absl::flat_hash_map<std::string, uint32_t> expression_ids_;
+
+  // Generated attributes take the value of the first matching condition.
+  struct AttributeMatch {
+    absl::optional<uint32_t> condition_;
+    std::string value_;
+    Stats::StatName stat_value_;
+  };
+  std::vector<std::vector<AttributeMatch>> attributes_;
+  absl::flat_hash_map<std::string, uint32_t> attribute_ids_;
+  std::vector<Filters::Common::Expr::ExpressionPtr> conditions_;
 };
 
 // Self-managed scope with active rotation. Envoy stats scope controls the
@@ -433,7 +611,9 @@ public:
                 uint64_t delete_interval_ms)
       : parent_scope_(factory_context.scope()), active_scope_(parent_scope_.createScope("")),
         raw_scope_(active_scope_.get()), rotate_interval_ms_(rotate_interval_ms),
-        delete_interval_ms_(delete_interval_ms) {
+        delete_interval_ms_(delete_interval_ms),
+        stats_admin_(getStatsAdmin(factory_context)) {
+    stats_admin_->add(*this);
     if (rotate_interval_ms_ > 0) {
       ASSERT(delete_interval_ms_ < rotate_interval_ms_);
       ASSERT(delete_interval_ms_ >= 1000);
@@ -444,6 +624,7 @@ public:
     }
   }
   ~RotatingScope() {
+    stats_admin_->remove(*this);
     if (rotate_timer_) {
       rotate_timer_->disableTimer();
       rotate_timer_.reset();
@@ -455,6 +636,13 @@ public:
   }
   Stats::Scope* scope() { return raw_scope_.load(); }
 
+  void addTo(Cardinality& cardinality) const {
+    cardinality.addScope(*active_scope_, "active");
+    if (draining_scope_) {
+      cardinality.addScope(*draining_scope_, "draining");
+    }
+  }
+
 private:
   void onRotate() {
     ENVOY_LOG(info, "Rotating active Istio stats scope after {}ms.", rotate_interval_ms_);
@@ -476,8 +664,29 @@ private:
   const uint64_t delete_interval_ms_;
   Event::TimerPtr rotate_timer_{nullptr};
   Event::TimerPtr delete_timer_{nullptr};
+  const StatsAdminSharedPtr stats_admin_;
 };
 
+Http::Code StatsAdmin::cardinalityHandler(Http::ResponseHeaderMap& response_headers,
+                                          Buffer::Instance& response,
+                                          Server::AdminStream& admin_stream) {
+  const auto params = admin_stream.queryParams();
+  size_t top = CardinalityTopValues;
+  const auto top_param = params.getFirstValue("top");
+  if (top_param.has_value() && !absl::SimpleAtoi(top_param.value(), &top)) {
+    response.add("invalid top\n");
+    return Http::Code::BadRequest;
+  }
+  Cardinality cardinality(absl::StrCat(CustomStatNamespace, "."));
+  for (const auto* scope : scopes_) {
+    scope->addTo(cardinality);
+  }
+  response_headers.setReferenceContentType(Http::Headers::get().ContentTypeValues.Json);
+  response.add(MessageUtil::getJsonStringFromMessageOrError(
+      cardinality.report(top, params.getFirstValue("metric").value_or("")), true, true));
+  return Http::Code::OK;
+}
+
 struct Config : public Logger::Loggable<Logger::Id::filter> {
   Config(const stats::PluginConfig& proto_config,
          Server::Configuration::FactoryContext& factory_context)
@@ -493,7 +702,24 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
                                           /* 5m */ 1000 * 60 * 5)),
         disable_host_header_fallback_(proto_config.disable_host_header_fallback()),
         report_duration_(
-            PROTOBUF_GET_MS_OR_DEFAULT(proto_config, tcp_reporting_duration, /* 5s */ 5000)) {
+            PROTOBUF_GET_MS_OR_DEFAULT(proto_config, tcp_reporting_duration, /* 5s */ 5000)),
+        endpoint_metadata_(factory_context.serverFactoryContext().threadLocal()),
+        log_self_time_(factory_context.serverFactoryContext().scope(),
+                       factory_context.serverFactoryContext().runtime(), "istio_stats", "log"),
+        bypassed_requests_(factory_context.serverFactoryContext().scope().counterFromString(
+            "istio_stats.bypassed_requests")) {
+    if (proto_config.has_bypass()) {
+      bypass_ = std::make_unique<Bypass>(proto_config.bypass());
+    }
+    endpoint_metadata_.set(
+        [](Event::Dispatcher&) { return std::make_shared<EndpointMetadataCache>(); });
+    if (proto_config.dedicated_store()) {
+      // Series are dropped once idle for the rotation interval.
+      const std::chrono::milliseconds expiry(
+          PROTOBUF_GET_MS_OR_DEFAULT(proto_config, rotation_interval, 0));
+      stats_admin_ = getStatsAdmin(factory_context);
+      store_ = &stats_admin_->store(expiry);
+    }
     reporter_ = Reporter::ClientSidecar;
     switch (proto_config.reporter()) {
     case stats::Reporter::UNSPECIFIED:
@@ -514,8 +740,27 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
     default:
       break;
     }
-    if (proto_config.metrics_size() > 0 || proto_config.definitions_size() > 0) {
+    if (proto_config.metrics_size() > 0 || proto_config.definitions_size() > 0 ||
+        proto_config.attributes_size() > 0) {
       metric_overrides_ = std::make_unique<MetricOverrides>(context_, scope()->symbolTable());
+      for (const auto& attribute : proto_config.attributes()) {
+        std::vector<MetricOverrides::AttributeMatch> matches;
+        for (const auto& match : attribute.match()) {
+          absl::optional<uint32_t> condition;
+          if (!match.condition().empty()) {
+            condition = metric_overrides_->createCondition(match.condition());
+            if (!condition.has_value()) {
+              ENVOY_LOG(info, "Failed to parse attribute condition: {}", match.condition());
+              continue;
+            }
+          }
+          matches.push_back(
+              {condition, match.value(), metric_overrides_->pool_.add(match.value())});
+        }
+        metric_overrides_->attribute_ids_.insert_or_assign(attribute.output_attribute(),
+                                                           metric_overrides_->attributes_.size());
+        metric_overrides_->attributes_.push_back(std::move(matches));
+      }
       for (const auto& definition : proto_config.definitions()) {
         const auto& it = context_->all_metrics_.find(definition.name());
         if (it != context_->all_metrics_.end()) {
@@ -551,6 +796,39 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
           }
           continue;
         }
+        if (!metric.match().empty()) {
+          std::vector<Stats::StatName> matched;
+          if (!metric.name().empty()) {
+            const auto& it = context_->all_metrics_.find(metric.name());
+            if (it != context_->all_metrics_.end()) {
+              matched.push_back(it->second);
+            }
+            const auto& custom_it = metric_overrides_->custom_metrics_.find(metric.name());
+            if (custom_it != metric_overrides_->custom_metrics_.end()) {
+              matched.push_back(custom_it->second.name_);
+            }
+          } else {
+            for (const auto& [_, metric] : context_->all_metrics_) {
+              matched.push_back(metric);
+            }
+            for (const auto& [_, metric] : metric_overrides_->custom_metrics_) {
+              matched.push_back(metric.name_);
+            }
+          }
+          if (matched.empty()) {
+            ENVOY_LOG(info, "Metric match of an unknown metric: {}", metric.name());
+          } else {
+            auto condition = metric_overrides_->createCondition(metric.match());
+            if (!condition.has_value()) {
+              ENVOY_LOG(info, "Failed to parse metric match: {}", metric.match());
+            } else {
+              metric_overrides_->match_conditions_.push_back(condition.value());
+              for (const auto& name : matched) {
+                metric_overrides_->metric_matches_[name].push_back(condition.value());
+              }
+            }
+          }
+        }
         for (const auto& tag : metric.tags_to_remove()) {
           const auto& tag_it = context_->all_tags_.find(tag);
           if (tag_it == context_->all_tags_.end()) {
@@ -627,9 +905,9 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
           }
         }
       }
+      metric_overrides_->indexExpressions();
     }
   }
-
   // RAII for stream context propagation.
   struct StreamOverrides : public Filters::Common::Expr::StreamActivation {
     StreamOverrides(Config& parent, Stats::StatNameDynamicPool& pool)
@@ -645,31 +923,92 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
         activation_request_headers_ = request_headers;
         activation_response_headers_ = response_headers;
         activation_response_trailers_ = response_trailers;
+        const auto& attributes = parent_.metric_overrides_->attributes_;
+        attribute_values_.assign(attributes.size(), nullptr);
+        for (size_t id = 0; id < attributes.size(); id++) {
+          for (const auto& match : attributes[id]) {
+            if (!match.condition_.has_value() || evaluateCondition(match.condition_.value())) {
+              attribute_values_[id] = &match;
+              break;
+            }
+          }
+        }
+        condition_values_.assign(parent_.metric_overrides_->conditions_.size(), false);
+        for (const uint32_t id : parent_.metric_overrides_->match_conditions_) {
+          condition_values_[id] = evaluateCondition(id);
+        }
+        // Only the expressions of the matching metrics are evaluated.
         const auto& compiled_exprs = parent_.metric_overrides_->compiled_exprs_;
-        expr_values_.clear();
-        expr_values_.reserve(compiled_exprs.size());
+        expr_values_.assign(compiled_exprs.size(), std::make_pair(parent_.context_->unknown_, 0));
+        expr_needed_.assign(compiled_exprs.size(), false);
+        any_matches_ = false;
+        for (const auto& [metric, exprs] : parent_.metric_overrides_->metric_exprs_) {
+          if (!matches(metric)) {
+            continue;
+          }
+          any_matches_ = true;
+          for (const uint32_t id : exprs) {
+            expr_needed_[id] = true;
+          }
+        }
         for (size_t id = 0; id < compiled_exprs.size(); id++) {
-          Protobuf::Arena arena;
-          auto eval_status = compiled_exprs[id].first->Evaluate(*this, &arena);
-          if (!eval_status.ok() || eval_status.value().IsError()) {
-            expr_values_.push_back(std::make_pair(parent_.context_->unknown_, 0));
-          } else {
-            const auto string_value = Filters::Common::Expr::print(eval_status.value());
-            if (compiled_exprs[id].second) {
-              uint64_t amount = 0;
-              if (!absl::SimpleAtoi(string_value, &amount)) {
-                ENVOY_LOG(trace, "Failed to get metric value: {}", string_value);
-              }
-              expr_values_.push_back(std::make_pair(Stats::StatName(), amount));
-            } else {
-              expr_values_.push_back(std::make_pair(pool_.add(string_value), 0));
-            }
+          if (expr_needed_[id]) {
+            expr_values_[id] = evaluateExpression(compiled_exprs[id]);
           }
         }
         resetActivation();
       }
     }
 
+    std::pair<Stats::StatName, uint64_t>
+    evaluateExpression(const MetricOverrides::CompiledExpression& compiled) {
+      if (compiled.attribute_.has_value()) {
+        const auto* match = attribute_values_[compiled.attribute_.value()];
+        return std::make_pair(match ? match->stat_value_ : parent_.context_->unknown_, 0);
+      }
+      Protobuf::Arena arena;
+      auto eval_status = compiled.expr_->Evaluate(*this, &arena);
+      if (!eval_status.ok() || eval_status.value().IsError()) {
+        return std::make_pair(parent_.context_->unknown_, 0);
+      }
+      const auto string_value = Filters::Common::Expr::print(eval_status.value());
+      if (compiled.int_expr_) {
+        uint64_t amount = 0;
+        if (!absl::SimpleAtoi(string_value, &amount)) {
+          ENVOY_LOG(trace, "Failed to get metric value: {}", string_value);
+        }
+        return std::make_pair(Stats::StatName(), amount);
+      }
+      return std::make_pair(pool_.add(string_value), 0);
+    }
+
+    bool evaluateCondition(uint32_t id) {
+      Protobuf::Arena arena;
+      auto eval_status = parent_.metric_overrides_->conditions_[id]->Evaluate(*this, &arena);
+      return eval_status.ok() && eval_status.value().IsBool() && eval_status.value().BoolOrDie();
+    }
+
+    // Whether the match conditions of the metric hold for the stream.
+    bool matches(Stats::StatName metric) const {
+      const auto& it = parent_.metric_overrides_->metric_matches_.find(metric);
+      if (it == parent_.metric_overrides_->metric_matches_.end()) {
+        return true;
+      }
+      for (const uint32_t id : it->second) {
+        if (!condition_values_[id]) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Whether any metric is recorded for the stream. The tags of the stream
+    // are only needed in that case.
+    bool anyMatches() const {
+      ASSERT(evaluated_);
+      return !parent_.metric_overrides_ || any_matches_;
+    }
+
     absl::optional<CelValue> FindValue(absl::string_view name,
                                        Protobuf::Arena* arena) const override {
       auto obj = StreamActivation::FindValue(name, arena);
@@ -680,6 +1019,18 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
         return Filters::Common::Expr::CelProtoWrapper::CreateMessage(&parent_.context_->node_,
                                                                      arena);
       }
+      if (parent_.metric_overrides_) {
+        const auto& it = parent_.metric_overrides_->attribute_ids_.find(name);
+        // Attributes are visible once generated, including to later conditions.
+        if (it != parent_.metric_overrides_->attribute_ids_.end() &&
+            it->second < attribute_values_.size()) {
+          const auto* match = attribute_values_[it->second];
+          if (match) {
+            return CelValue::CreateString(&match->value_);
+          }
+          return {};
+        }
+      }
       if (activation_info_) {
         const auto* obj = activation_info_->filterState()
                               .getDataReadOnly<Envoy::Extensions::Filters::Common::Expr::CelState>(
@@ -695,55 +1046,46 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
                     uint64_t amount = 1) {
       ASSERT(evaluated_);
       if (parent_.metric_overrides_) {
-        if (parent_.metric_overrides_->drop_.contains(metric)) {
+        if (parent_.metric_overrides_->drop_.contains(metric) || !matches(metric)) {
           return;
         }
-        auto new_tags = parent_.metric_overrides_->overrideTags(metric, tags, expr_values_);
-        Stats::Utility::counterFromStatNames(*parent_.scope(),
-                                             {parent_.context_->stat_namespace_, metric}, new_tags)
-            .add(amount);
+        parent_.incCounter(
+            metric, parent_.metric_overrides_->overrideTags(metric, tags, expr_values_), amount);
         return;
       }
-      Stats::Utility::counterFromStatNames(*parent_.scope(),
-                                           {parent_.context_->stat_namespace_, metric}, tags)
-          .add(amount);
+      parent_.incCounter(metric, tags, amount);
     }
 
     void recordHistogram(Stats::StatName metric, Stats::Histogram::Unit unit,
                          const Stats::StatNameTagVector& tags, uint64_t value) {
       ASSERT(evaluated_);
       if (parent_.metric_overrides_) {
-        if (parent_.metric_overrides_->drop_.contains(metric)) {
+        if (parent_.metric_overrides_->drop_.contains(metric) || !matches(metric)) {
           return;
         }
-        auto new_tags = parent_.metric_overrides_->overrideTags(metric, tags, expr_values_);
-        Stats::Utility::histogramFromStatNames(
-            *parent_.scope(), {parent_.context_->stat_namespace_, metric}, unit, new_tags)
-            .recordValue(value);
+        parent_.recordValue(
+            metric, unit, parent_.metric_overrides_->overrideTags(metric, tags, expr_values_),
+            value);
         return;
       }
-      Stats::Utility::histogramFromStatNames(
-          *parent_.scope(), {parent_.context_->stat_namespace_, metric}, unit, tags)
-          .recordValue(value);
+      parent_.recordValue(metric, unit, tags, value);
     }
 
     void recordCustomMetrics() {
       ASSERT(evaluated_);
       if (parent_.metric_overrides_) {
         for (const auto& [_, metric] : parent_.metric_overrides_->custom_metrics_) {
+          if (!matches(metric.name_)) {
+            continue;
+          }
           const auto tags = parent_.metric_overrides_->overrideTags(metric.name_, {}, expr_values_);
           uint64_t amount = expr_values_[metric.expr_].second;
           switch (metric.type_) {
           case MetricOverrides::MetricType::Counter:
-            Stats::Utility::counterFromStatNames(
-                *parent_.scope(), {parent_.context_->stat_namespace_, metric.name_}, tags)
-                .add(amount);
+            parent_.incCounter(metric.name_, tags, amount);
             break;
           case MetricOverrides::MetricType::Histogram:
-            Stats::Utility::histogramFromStatNames(
-                *parent_.scope(), {parent_.context_->stat_namespace_, metric.name_},
-                Stats::Histogram::Unit::Bytes, tags)
-                .recordValue(amount);
+            parent_.recordValue(metric.name_, Stats::Histogram::Unit::Bytes, tags, amount);
             break;
           case MetricOverrides::MetricType::Gauge:
             Stats::Utility::gaugeFromStatNames(*parent_.scope(),
@@ -761,6 +1103,12 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
     Config& parent_;
     Stats::StatNameDynamicPool& pool_;
     std::vector<std::pair<Stats::StatName, uint64_t>> expr_values_;
+    std::vector<const MetricOverrides::AttributeMatch*> attribute_values_;
+    // Values of the match conditions, indexed by condition.
+    std::vector<bool> condition_values_;
+    // Expressions used by the matching metrics, indexed by expression.
+    std::vector<bool> expr_needed_;
+    bool any_matches_{false};
     bool evaluated_{false};
   };
 
@@ -776,6 +1124,26 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
         .set(1);
   }
 
+  // Counters and histograms are recorded in the dedicated store if enabled.
+  void incCounter(Stats::StatName metric, const Stats::StatNameTagVector& tags, uint64_t amount) {
+    if (store_) {
+      store_->addCounter(metric, tags, amount);
+      return;
+    }
+    Stats::Utility::counterFromStatNames(*scope(), {context_->stat_namespace_, metric}, tags)
+        .add(amount);
+  }
+  void recordValue(Stats::StatName metric, Stats::Histogram::Unit unit,
+                   const Stats::StatNameTagVector& tags, uint64_t value) {
+    if (store_) {
+      store_->recordValue(metric, unit, tags, value);
+      return;
+    }
+    Stats::Utility::histogramFromStatNames(*scope(), {context_->stat_namespace_, metric}, unit,
+                                           tags)
+        .recordValue(value);
+  }
+
   Reporter reporter() const { return reporter_; }
   Stats::Scope* scope() { return scope_.scope(); }
 
@@ -785,7 +1153,14 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
 
   const bool disable_host_header_fallback_;
   const std::chrono::milliseconds report_duration_;
+  ThreadLocal::TypedSlot<EndpointMetadataCache> endpoint_metadata_;
+  const Istio::Common::SelfTime log_self_time_;
+  Stats::Counter& bypassed_requests_;
+  std::unique_ptr<Bypass> bypass_;
   std::unique_ptr<MetricOverrides> metric_overrides_;
+  // Owned by the stats admin, which the config holds.
+  StatsAdminSharedPtr stats_admin_;
+  IstioStore* store_{nullptr};
 };
 
 using ConfigSharedPtr = std::shared_ptr<Config>;
@@ -815,6 +1190,11 @@ public:
 
   // Http::StreamDecoderFilter
   Http::FilterHeadersStatus decodeHeaders(Http::RequestHeaderMap& request_headers, bool) override {
+    if (config_->bypass_ && config_->bypass_->matches(request_headers, *decoder_callbacks_)) {
+      bypassed_ = true;
+      config_->bypassed_requests_.inc();
+      return Http::FilterHeadersStatus::Continue;
+    }
     is_grpc_ = Grpc::Common::isGrpcRequestHeaders(request_headers);
     if (is_grpc_) {
       report_timer_ = decoder_callbacks_->dispatcher().createTimer([this] { onReportTimer(); });
@@ -826,10 +1206,21 @@ public:
   // AccessLog::Instance
   void log(const Formatter::HttpFormatterContext& log_context,
            const StreamInfo::StreamInfo& info) override {
+    if (bypassed_) {
+      return;
+    }
+    const auto self_time = config_->log_self_time_.sample();
     const Http::RequestHeaderMap* request_headers = &log_context.requestHeaders();
     const Http::ResponseHeaderMap* response_headers = &log_context.responseHeaders();
     const Http::ResponseTrailerMap* response_trailers = &log_context.responseTrailers();
 
+    // Evaluate the end stream override expressions for HTTP. This may change values for periodic
+    // metrics. The tags are not built if no metric matches the stream.
+    stream_.evaluate(info, request_headers, response_headers, response_trailers);
+    if (!stream_.anyMatches()) {
+      disableReportTimer();
+      return;
+    }
     reportHelper(true);
     if (is_grpc_) {
       tags_.push_back({context_.request_protocol_, context_.grpc_});
@@ -853,10 +1244,6 @@ public:
       tags_.push_back({context_.grpc_response_status_, context_.empty_});
     }
     populateFlagsAndConnectionSecurity(info);
-
-    // Evaluate the end stream override expressions for HTTP. This may change values for periodic
-    // metrics.
-    stream_.evaluate(info, request_headers, response_headers, response_trailers);
     stream_.addCounter(context_.requests_total_, tags_);
     auto duration = info.requestComplete();
     if (duration.has_value()) {
@@ -907,9 +1294,8 @@ public:
 private:
   // Invoked periodically for streams.
   void reportHelper(bool end_stream) {
-    if (end_stream && report_timer_) {
-      report_timer_->disableTimer();
-      report_timer_.reset();
+    if (end_stream) {
+      disableReportTimer();
     }
     // HTTP handled first.
     if (decoder_callbacks_) {
@@ -919,8 +1305,9 @@ private:
         if (peer_read_ || end_stream) {
           populatePeerInfo(info, info.filterState());
         }
-        if (is_grpc_ && (peer_read_ || end_stream)) {
-          // For periodic HTTP metric, evaluate once when the peer info is read.
+        if (is_grpc_ && peer_read_ && !end_stream) {
+          // For periodic HTTP metric, evaluate once when the peer info is read. The end stream
+          // evaluation is done by the access log.
           stream_.evaluate(decoder_callbacks_->streamInfo());
         }
       }
@@ -955,11 +1342,14 @@ private:
       peer_read_ = peerInfoRead(config_->reporter(), filter_state);
       // Report connection open once peer info is read or connection is closed.
       if (peer_read_ || end_stream) {
-        populatePeerInfo(info, filter_state);
-        tags_.push_back({context_.request_protocol_, context_.tcp_});
-        populateFlagsAndConnectionSecurity(info);
-        // For TCP, evaluate only once immediately before emitting the first metric.
+        // For TCP, evaluate only once immediately before emitting the first metric. The tags are
+        // not built if no metric matches the connection.
         stream_.evaluate(info);
+        if (stream_.anyMatches()) {
+          populatePeerInfo(info, filter_state);
+          tags_.push_back({context_.request_protocol_, context_.tcp_});
+          populateFlagsAndConnectionSecurity(info);
+        }
         stream_.addCounter(context_.tcp_connections_opened_total_, tags_);
       }
     }
@@ -979,6 +1369,12 @@ private:
       stream_.recordCustomMetrics();
     }
   }
+  void disableReportTimer() {
+    if (report_timer_) {
+      report_timer_->disableTimer();
+      report_timer_.reset();
+    }
+  }
   void onReportTimer() {
     reportHelper(false);
     report_timer_->enableTimer(config_->report_duration_);
@@ -1003,8 +1399,8 @@ private:
     if (object) {
       peer.emplace(Istio::Common::convertFlatNodeToWorkloadMetadata(*object));
     } else if (config_->reporter() == Reporter::ClientSidecar) {
-      if (auto label_obj = extractEndpointMetadata(info); label_obj) {
-        peer.emplace(label_obj.value());
+      if (auto label_obj = extractEndpointMetadata(info, *config_->endpoint_metadata_); label_obj) {
+        peer.emplace(*label_obj);
       }
     }
 
@@ -1260,6 +1656,8 @@ private:
   uint64_t bytes_received_{0};
   absl::optional<bool> mutual_tls_;
   bool is_grpc_{false};
+  // Set in decodeHeaders if the request matches the bypass of the config.
+  bool bypassed_{false};
   uint64_t request_message_count_{0};
   uint64_t response_message_count_{0};
   // Custom expression values are evaluated at most twice: at the start and the end of the stream.
@@ -0,0 +1,381 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays a recorded trace of request attributes through the stats filter, on
+// a real thread local stats store and worker threads, to profile the filter
+// with a production traffic mix:
+//
+//   istio_stats_replay <config.yaml> <trace.yaml> [threads] [iterations]
+//
+// The config is a stats PluginConfig and the trace a ReplayTrace, see the
+// examples in testdata. Each thread replays the whole trace the given number
+// of times.
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/notification.h"
+#include "extensions/common/metadata_object.h"
+#include "extensions/common/proto_util.h"
+#include "source/common/common/thread.h"
+#include "source/common/memory/stats.h"
+#include "source/common/network/address_impl.h"
+#include "source/common/network/socket_impl.h"
+#include "source/common/stats/allocator_impl.h"
+#include "source/common/stats/thread_local_store.h"
+#include "source/common/stream_info/stream_info_impl.h"
+#include "source/common/stream_info/utility.h"
+#include "source/common/thread_local/thread_local_impl.h"
+#include "source/extensions/filters/common/expr/cel_state.h"
+#include "source/extensions/filters/http/istio_stats/istio_stats.h"
+#include "source/extensions/filters/http/istio_stats/replay.pb.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/server/factory_context.h"
+#include "test/test_common/utility.h"
+
+using testing::NiceMock;
+using testing::Return;
+using testing::ReturnRef;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+namespace {
+
+// Stats of the filter, see CustomStatNamespace.
+constexpr absl::string_view StatPrefix = "istiocustom.";
+
+std::string readFile(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw EnvoyException(absl::StrCat("failed to read ", path));
+  }
+  std::stringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+template <class T> void addHeaders(const Protobuf::Map<std::string, std::string>& from, T& to) {
+  for (const auto& [key, value] : from) {
+    to.addCopy(Http::LowerCaseString(key), value);
+  }
+}
+
+// A recorded request, decoded once per worker outside of the measurement.
+struct Request {
+  explicit Request(const stats::ReplayRequest& request)
+      : peer_id_(request.peer_id()), response_code_(request.response_code()),
+        request_bytes_(request.request_bytes()), response_bytes_(request.response_bytes()) {
+    if (request.has_peer()) {
+      peer_ = ::Wasm::Common::extractNodeFlatBufferStringFromStruct(request.peer());
+    }
+    for (const auto& name : request.response_flags()) {
+      const auto flag = StreamInfo::ResponseFlagUtils::toResponseFlag(name);
+      if (!flag) {
+        throw EnvoyException(absl::StrCat("unknown response flag ", name));
+      }
+      response_flags_.push_back(*flag);
+    }
+    if (request.has_duration()) {
+      duration_ = std::chrono::nanoseconds(
+          Protobuf::util::TimeUtil::DurationToNanoseconds(request.duration()));
+    }
+    addHeaders(request.request_headers(), request_headers_);
+    addHeaders(request.response_headers(), response_headers_);
+    addHeaders(request.response_trailers(), response_trailers_);
+  }
+
+  std::string peer_;
+  std::string peer_id_;
+  absl::optional<uint32_t> response_code_;
+  std::vector<StreamInfo::ResponseFlag> response_flags_;
+  absl::optional<std::chrono::nanoseconds> duration_;
+  uint64_t request_bytes_;
+  uint64_t response_bytes_;
+  Http::TestRequestHeaderMapImpl request_headers_;
+  Http::TestResponseHeaderMapImpl response_headers_;
+  Http::TestResponseTrailerMapImpl response_trailers_;
+};
+
+const Filters::Common::Expr::CelStatePrototype& peerPrototype() {
+  static const auto* const prototype = new Filters::Common::Expr::CelStatePrototype(
+      true, Filters::Common::Expr::CelStateType::FlatBuffers, ::Istio::Common::nodeInfoSchema(),
+      StreamInfo::FilterState::LifeSpan::FilterChain);
+  return *prototype;
+}
+
+const Filters::Common::Expr::CelStatePrototype& peerIdPrototype() {
+  static const auto* const prototype = new Filters::Common::Expr::CelStatePrototype(
+      false, Filters::Common::Expr::CelStateType::String, absl::string_view(),
+      StreamInfo::FilterState::LifeSpan::FilterChain);
+  return *prototype;
+}
+
+// Sets the filter state written by the metadata exchange filters.
+void setPeer(StreamInfo::FilterState& filter_state, const Request& request, bool outbound) {
+  if (!request.peer_.empty()) {
+    auto state = std::make_unique<Filters::Common::Expr::CelState>(peerPrototype());
+    state->setValue(request.peer_);
+    filter_state.setData(outbound ? "wasm.upstream_peer" : "wasm.downstream_peer",
+                         std::move(state), StreamInfo::FilterState::StateType::Mutable,
+                         peerPrototype().life_span_);
+  }
+  if (!request.peer_id_.empty()) {
+    auto state = std::make_unique<Filters::Common::Expr::CelState>(peerIdPrototype());
+    state->setValue(request.peer_id_);
+    filter_state.setData(outbound ? "wasm.upstream_peer_id" : "wasm.downstream_peer_id",
+                         std::move(state), StreamInfo::FilterState::StateType::Mutable,
+                         peerIdPrototype().life_span_);
+  }
+}
+
+// Clock of the replayed streams, set to the recorded durations.
+class ReplayTime : public TimeSource {
+public:
+  SystemTime systemTime() override { return SystemTime(now_.time_since_epoch()); }
+  MonotonicTime monotonicTime() override { return now_; }
+
+  MonotonicTime now_;
+};
+
+// The interfaces are too large to be implemented by hand, but every method
+// used by the filter is a plain override: a call into gmock takes its global
+// mutex, which serializes the workers.
+class DecoderCallbacks : public Http::MockStreamDecoderFilterCallbacks {
+public:
+  explicit DecoderCallbacks(Event::Dispatcher& dispatcher) : dispatcher_(dispatcher) {}
+
+  Event::Dispatcher& dispatcher() override { return dispatcher_; }
+  Router::RouteConstSharedPtr route() override { return nullptr; }
+  StreamInfo::StreamInfo& streamInfo() override { return *stream_info_; }
+
+  StreamInfo::StreamInfo* stream_info_{};
+
+private:
+  Event::Dispatcher& dispatcher_;
+};
+
+class FilterChain : public Http::MockFilterChainFactoryCallbacks {
+public:
+  void addStreamFilter(Http::StreamFilterSharedPtr filter) override { filter_ = filter; }
+  void addAccessLogHandler(AccessLog::InstanceSharedPtr handler) override { handler_ = handler; }
+
+  Http::StreamFilterSharedPtr filter_;
+  AccessLog::InstanceSharedPtr handler_;
+};
+
+// Replays the trace on the calling worker thread.
+class Replayer {
+public:
+  Replayer(const stats::ReplayTrace& trace, const Http::FilterFactoryCb& filter_factory,
+           Event::Dispatcher& dispatcher)
+      : filter_factory_(filter_factory), outbound_(trace.outbound()), callbacks_(dispatcher),
+        connection_info_(std::make_shared<Network::ConnectionInfoSetterImpl>(
+            std::make_shared<Network::Address::Ipv4Instance>("10.0.0.2", 9080),
+            std::make_shared<Network::Address::Ipv4Instance>("10.0.0.1", 40000))) {
+    for (const auto& request : trace.requests()) {
+      requests_.push_back(std::make_unique<Request>(request));
+      for (uint32_t i = 1; i < request.count(); i++) {
+        requests_.push_back(requests_.back());
+      }
+    }
+  }
+
+  size_t size() const { return requests_.size(); }
+
+  // Replays the trace from the request at offset.
+  void run(uint32_t iterations, size_t offset) {
+    for (uint32_t i = 0; i < iterations; i++) {
+      for (size_t j = 0; j < requests_.size(); j++) {
+        replay(*requests_[(offset + j) % requests_.size()]);
+      }
+    }
+  }
+
+private:
+  void replay(Request& request) {
+    // Each request has its own filter and stream info.
+    time_.now_ = MonotonicTime();
+    StreamInfo::StreamInfoImpl stream_info(time_, connection_info_,
+                                           StreamInfo::FilterState::LifeSpan::FilterChain);
+    callbacks_.stream_info_ = &stream_info;
+    filter_factory_(chain_);
+    chain_.filter_->setDecoderFilterCallbacks(callbacks_);
+    chain_.filter_->decodeHeaders(request.request_headers_, true);
+    setPeer(*stream_info.filterState(), request, outbound_);
+    if (request.response_code_) {
+      stream_info.setResponseCode(*request.response_code_);
+    }
+    for (const auto flag : request.response_flags_) {
+      stream_info.setResponseFlag(flag);
+    }
+    stream_info.setRequestHeaders(request.request_headers_);
+    stream_info.getDownstreamBytesMeter()->addWireBytesReceived(request.request_bytes_);
+    stream_info.getDownstreamBytesMeter()->addWireBytesSent(request.response_bytes_);
+    if (request.duration_) {
+      time_.now_ = MonotonicTime(*request.duration_);
+      stream_info.onRequestComplete();
+    }
+    Formatter::HttpFormatterContext log_context(
+        &request.request_headers_, &request.response_headers_, &request.response_trailers_);
+    chain_.handler_->log(log_context, stream_info);
+    chain_.filter_->onDestroy();
+    callbacks_.stream_info_ = nullptr;
+  }
+
+  const Http::FilterFactoryCb& filter_factory_;
+  const bool outbound_;
+  std::vector<std::shared_ptr<Request>> requests_;
+  ReplayTime time_;
+  DecoderCallbacks callbacks_;
+  FilterChain chain_;
+  const Network::ConnectionInfoProviderSharedPtr connection_info_;
+};
+
+// Counts the series of each metric of the filter.
+std::map<std::string, size_t> countSeries(Stats::Store& store) {
+  std::map<std::string, size_t> series;
+  const auto count = [&](const Stats::Metric& metric) {
+    const std::string name = metric.tagExtractedName();
+    if (absl::StartsWith(name, StatPrefix)) {
+      series[name.substr(StatPrefix.size())]++;
+    }
+  };
+  for (const auto& counter : store.counters()) {
+    count(*counter);
+  }
+  for (const auto& gauge : store.gauges()) {
+    count(*gauge);
+  }
+  for (const auto& histogram : store.histograms()) {
+    count(*histogram);
+  }
+  return series;
+}
+
+int replay(const std::string& config_path, const std::string& trace_path, uint32_t threads,
+           uint32_t iterations) {
+  stats::PluginConfig proto_config;
+  TestUtility::loadFromYaml(readFile(config_path), proto_config);
+  stats::ReplayTrace trace;
+  TestUtility::loadFromYaml(readFile(trace_path), trace);
+
+  Thread::MainThread main_thread;
+  Stats::SymbolTableImpl symbol_table;
+  Stats::AllocatorImpl allocator(symbol_table);
+  Stats::ThreadLocalStoreImpl store(allocator);
+  Api::ApiPtr api = Api::createApiForTest();
+  Event::DispatcherPtr main_dispatcher = api->allocateDispatcher("main_thread");
+  ThreadLocal::InstanceImpl tls;
+  tls.registerThread(*main_dispatcher, true);
+  std::vector<Event::DispatcherPtr> dispatchers;
+  for (uint32_t i = 0; i < threads; i++) {
+    dispatchers.push_back(api->allocateDispatcher(absl::StrCat("worker_", i)));
+    tls.registerThread(*dispatchers.back(), false);
+  }
+  store.initializeThreading(*main_dispatcher, tls);
+
+  NiceMock<Server::Configuration::MockFactoryContext> context;
+  ON_CALL(context, scope()).WillByDefault(ReturnRef(*store.rootScope()));
+  ON_CALL(context.server_factory_context_, scope()).WillByDefault(ReturnRef(*store.rootScope()));
+  ON_CALL(context.server_factory_context_, threadLocal()).WillByDefault(ReturnRef(tls));
+  ON_CALL(context.listener_info_, direction())
+      .WillByDefault(Return(trace.outbound() ? envoy::config::core::v3::OUTBOUND
+                                             : envoy::config::core::v3::INBOUND));
+  *context.server_factory_context_.local_info_.node_.mutable_metadata() = trace.node();
+  IstioStatsFilterConfigFactory factory;
+  auto filter_factory = factory.createFilterFactoryFromProto(proto_config, "", context).value();
+
+  // Workers decode the trace, then wait for each other to start the replay.
+  absl::BlockingCounter ready(threads);
+  absl::Notification start;
+  absl::BlockingCounter done(threads);
+  size_t requests = 0;
+  std::vector<Thread::ThreadPtr> workers;
+  for (uint32_t i = 0; i < threads; i++) {
+    Event::Dispatcher& dispatcher = *dispatchers[i];
+    dispatcher.post([&, i] {
+      Replayer replayer(trace, filter_factory, dispatcher);
+      if (i == 0) {
+        requests = replayer.size() * iterations * threads;
+      }
+      ready.DecrementCount();
+      start.WaitForNotification();
+      replayer.run(iterations, replayer.size() * i / threads);
+      done.DecrementCount();
+    });
+    workers.push_back(api->threadFactory().createThread([&dispatcher, &tls] {
+      dispatcher.run(Event::Dispatcher::RunType::RunUntilExit);
+      tls.shutdownThread();
+    }));
+  }
+  ready.Wait();
+  const uint64_t allocated_before = Memory::Stats::totalCurrentlyAllocated();
+  const auto begin = std::chrono::steady_clock::now();
+  start.Notify();
+  done.Wait();
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  const uint64_t allocated_after = Memory::Stats::totalCurrentlyAllocated();
+  const auto series = countSeries(store);
+
+  tls.shutdownGlobalThreading();
+  store.shutdownThreading();
+  for (uint32_t i = 0; i < threads; i++) {
+    dispatchers[i]->exit();
+    workers[i]->join();
+  }
+  tls.shutdownThread();
+
+  const double seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << "requests: " << requests << " on " << threads << " threads in " << seconds
+            << "s, " << requests / seconds << " requests/s" << std::endl;
+  // Thread caches are not accounted for, use a heap profile for the allocation sites.
+  std::cout << "heap growth: " << static_cast<int64_t>(allocated_after - allocated_before)
+            << " bytes" << std::endl;
+  size_t total = 0;
+  for (const auto& [name, count] : series) {
+    std::cout << "series: " << name << " " << count << std::endl;
+    total += count;
+  }
+  std::cout << "series: total " << total << std::endl;
+  return 0;
+}
+
+} // namespace
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
+
+int main(int argc, char** argv) {
+  uint32_t threads = 1;
+  uint32_t iterations = 1;
+  if (argc < 3 || argc > 5 || (argc > 3 && !absl::SimpleAtoi(argv[3], &threads)) ||
+      (argc > 4 && !absl::SimpleAtoi(argv[4], &iterations)) || threads == 0) {
+    std::cerr << "usage: " << argv[0] << " <config.yaml> <trace.yaml> [threads] [iterations]"
+              << std::endl;
+    return 1;
+  }
+  try {
+    return Envoy::Extensions::HttpFilters::IstioStats::replay(argv[1], argv[2], threads,
+                                                              iterations);
+  } catch (const Envoy::EnvoyException& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
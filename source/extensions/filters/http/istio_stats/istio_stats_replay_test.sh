@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Copyright Istio Authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Replays the example trace of istio_stats_replay on 2 threads, 3 times each.
+# The trace has 10 requests, in 2 distinct series of each metric.
+
+set -u
+set -e
+
+REPLAY="$1"
+CONFIG="$2"
+TRACE="$3"
+
+OUTPUT=$("${REPLAY}" "${CONFIG}" "${TRACE}" 2 3)
+echo "${OUTPUT}"
+
+function expect() {
+  if ! grep -q "$1" <<< "${OUTPUT}"; then
+    echo "missing output: $1"
+    exit 1
+  fi
+}
+
+expect "^requests: 60 on 2 threads"
+expect "^series: istio_requests_total 2$"
+expect "^series: istio_request_duration_milliseconds 2$"
@@ -0,0 +1,262 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark/benchmark.h"
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/stats/allocator_impl.h"
+#include "source/common/stats/custom_stat_namespaces_impl.h"
+#include "source/common/stats/thread_local_store.h"
+#include "source/common/stats/utility.h"
+#include "source/common/stream_info/filter_state_impl.h"
+#include "source/common/thread_local/thread_local_impl.h"
+#include "source/extensions/filters/http/istio_stats/istio_stats.h"
+#include "source/extensions/filters/http/istio_stats/istio_store.h"
+#include "source/server/admin/prometheus_stats.h"
+#include "source/server/admin/stats_params.h"
+#include "test/common/stats/stat_test_utility.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/server/factory_context.h"
+#include "test/mocks/stream_info/mocks.h"
+#include "test/mocks/upstream/cluster_manager.h"
+#include "test/test_common/utility.h"
+
+using testing::_;
+using testing::Const;
+using testing::NiceMock;
+using testing::Return;
+using testing::ReturnRef;
+using testing::SaveArg;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+namespace {
+
+// Response class dimension generated natively.
+constexpr absl::string_view NativeConfig = R"EOF(
+attributes:
+  - output_attribute: istio_responseClass
+    match:
+      - value: 2xx
+        condition: response.code >= 200 && response.code <= 299
+  - output_attribute: istio_operationId
+    match:
+      - value: GetMethod
+        condition: request.method == 'GET'
+      - value: PostMethod
+        condition: request.method == 'POST'
+metrics:
+  - name: requests_total
+    dimensions:
+      response_code: istio_responseClass
+)EOF";
+
+// Requests total and duration of each response code, recorded on the main
+// thread either in the Envoy stats or in the dedicated store.
+class StoreBenchmark {
+public:
+  explicit StoreBenchmark(bool dedicated)
+      : api_(Api::createApiForTest()), dispatcher_(api_->allocateDispatcher("main_thread")),
+        allocator_(symbol_table_), store_(allocator_), pool_(symbol_table_),
+        stat_namespace_(pool_.add("istiocustom")),
+        requests_total_(pool_.add("istio_requests_total")),
+        request_duration_(pool_.add("istio_request_duration_milliseconds")),
+        reporter_(pool_.add("reporter")), destination_(pool_.add("destination")),
+        response_code_(pool_.add("response_code")) {
+    custom_namespaces_.registerStatNamespace("istiocustom");
+    tls_.registerThread(*dispatcher_, true);
+    store_.initializeThreading(*dispatcher_, tls_);
+    if (dedicated) {
+      istio_store_ = std::make_unique<IstioStore>(symbol_table_, tls_, *dispatcher_,
+                                                  std::chrono::seconds(5),
+                                                  std::chrono::milliseconds(0));
+    }
+  }
+  ~StoreBenchmark() {
+    istio_store_.reset();
+    tls_.shutdownGlobalThreading();
+    store_.shutdownThreading();
+    tls_.shutdownThread();
+  }
+
+  void record(size_t code) {
+    // Response codes are added to the pool of each stream.
+    Stats::StatNameDynamicPool stream_pool(symbol_table_);
+    const Stats::StatNameTagVector tags = {{reporter_, destination_},
+                                           {response_code_, stream_pool.add(absl::StrCat(code))}};
+    const uint64_t duration = code % 1000;
+    if (istio_store_) {
+      istio_store_->addCounter(requests_total_, tags, 1);
+      istio_store_->recordValue(request_duration_, Stats::Histogram::Unit::Milliseconds, tags,
+                                duration);
+      return;
+    }
+    Stats::Utility::counterFromStatNames(*store_.rootScope(), {stat_namespace_, requests_total_},
+                                         tags)
+        .add(1);
+    Stats::Utility::histogramFromStatNames(*store_.rootScope(),
+                                           {stat_namespace_, request_duration_},
+                                           Stats::Histogram::Unit::Milliseconds, tags)
+        .recordValue(duration);
+  }
+
+  // Merges the recorded values as the stats flush does.
+  void flush() {
+    if (istio_store_) {
+      istio_store_->merge();
+    } else {
+      store_.mergeHistograms([] {});
+    }
+    dispatcher_->run(Event::Dispatcher::RunType::NonBlock);
+  }
+
+  // Renders the series in the Prometheus format, with the admin formatter
+  // for the Envoy stats.
+  size_t scrape() {
+    if (istio_store_) {
+      IstioStore::Table table(symbol_table_);
+      istio_store_->addTo(table);
+      return IstioStore::render(table).size();
+    }
+    Buffer::OwnedImpl response;
+    Server::PrometheusStatsFormatter::statsAsPrometheus(
+        store_.counters(), store_.gauges(), store_.histograms(), store_.textReadouts(),
+        cluster_manager_, response, params_, custom_namespaces_);
+    return response.length();
+  }
+
+private:
+  Api::ApiPtr api_;
+  Event::DispatcherPtr dispatcher_;
+  Stats::SymbolTableImpl symbol_table_;
+  Stats::AllocatorImpl allocator_;
+  Stats::ThreadLocalStoreImpl store_;
+  ThreadLocal::InstanceImpl tls_;
+  Stats::StatNamePool pool_;
+  const Stats::StatName stat_namespace_;
+  const Stats::StatName requests_total_;
+  const Stats::StatName request_duration_;
+  const Stats::StatName reporter_;
+  const Stats::StatName destination_;
+  const Stats::StatName response_code_;
+  std::unique_ptr<IstioStore> istio_store_;
+  NiceMock<Upstream::MockClusterManager> cluster_manager_;
+  Server::StatsParams params_;
+  Stats::CustomStatNamespacesImpl custom_namespaces_;
+};
+
+} // namespace
+
+// Generates the attributes and records the metrics of a request. The
+// attributegen Wasm plugin is not benchmarked here.
+static void BM_ResponseClass(benchmark::State& state) {
+  stats::PluginConfig proto_config;
+  TestUtility::loadFromYaml(std::string(NativeConfig), proto_config);
+
+  NiceMock<Server::Configuration::MockFactoryContext> context;
+  IstioStatsFilterConfigFactory factory;
+  auto filter_factory = factory.createFilterFactoryFromProto(proto_config, "", context).value();
+
+  NiceMock<Http::MockStreamDecoderFilterCallbacks> callbacks;
+  NiceMock<StreamInfo::MockStreamInfo> stream_info;
+  ON_CALL(callbacks, streamInfo()).WillByDefault(ReturnRef(stream_info));
+  ON_CALL(stream_info, responseCode()).WillByDefault(Return(200));
+  StreamInfo::FilterStateSharedPtr filter_state;
+  ON_CALL(stream_info, filterState()).WillByDefault(ReturnRef(filter_state));
+  ON_CALL(Const(stream_info), filterState())
+      .WillByDefault([&]() -> const StreamInfo::FilterState& { return *filter_state; });
+
+  Http::TestRequestHeaderMapImpl request_headers{{":method", "GET"}, {":path", "/"}};
+  Http::TestResponseHeaderMapImpl response_headers{{":status", "200"}};
+  Http::TestResponseTrailerMapImpl response_trailers;
+  Formatter::HttpFormatterContext log_context(&request_headers, &response_headers,
+                                              &response_trailers);
+  NiceMock<Http::MockFilterChainFactoryCallbacks> chain;
+  Http::StreamFilterSharedPtr filter;
+  AccessLog::InstanceSharedPtr handler;
+  ON_CALL(chain, addStreamFilter(_)).WillByDefault(SaveArg<0>(&filter));
+  ON_CALL(chain, addAccessLogHandler(_)).WillByDefault(SaveArg<0>(&handler));
+  for (auto _ : state) { // NOLINT
+    // Each request has its own filter and filter state.
+    filter_state = std::make_shared<StreamInfo::FilterStateImpl>(
+        StreamInfo::FilterState::LifeSpan::FilterChain);
+    filter_factory(chain);
+    filter->setDecoderFilterCallbacks(callbacks);
+    handler->log(log_context, stream_info);
+  }
+}
+BENCHMARK(BM_ResponseClass);
+
+// Arguments: whether the dedicated store is used and the number of response
+// codes, each with a counter and a histogram series.
+static void BM_StoreMemory(benchmark::State& state) {
+  const bool dedicated = state.range(0);
+  const size_t codes = state.range(1);
+  size_t bytes = 0;
+  for (auto _ : state) { // NOLINT
+    StoreBenchmark bench(dedicated);
+    Stats::TestUtil::MemoryTest memory_test;
+    for (size_t code = 0; code < codes; code++) {
+      bench.record(code);
+    }
+    bench.flush();
+    bytes = memory_test.consumedBytes();
+  }
+  state.counters["bytes_per_series"] = static_cast<double>(bytes) / (2 * codes);
+}
+BENCHMARK(BM_StoreMemory)
+    ->ArgsProduct({{0, 1}, {1000, 10000}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Arguments: whether the dedicated store is used and the number of response
+// codes. Records the metrics of a request on existing series.
+static void BM_StoreRecord(benchmark::State& state) {
+  const size_t codes = state.range(1);
+  StoreBenchmark bench(state.range(0));
+  for (size_t code = 0; code < codes; code++) {
+    bench.record(code);
+  }
+  size_t code = 0;
+  for (auto _ : state) { // NOLINT
+    bench.record(code++ % codes);
+  }
+}
+BENCHMARK(BM_StoreRecord)->ArgsProduct({{0, 1}, {1000, 10000}});
+
+// Arguments: whether the dedicated store is used and the number of response
+// codes. Renders all the series after a flush.
+static void BM_StoreScrape(benchmark::State& state) {
+  const size_t codes = state.range(1);
+  StoreBenchmark bench(state.range(0));
+  for (size_t code = 0; code < codes; code++) {
+    bench.record(code);
+  }
+  bench.flush();
+  size_t bytes = 0;
+  for (auto _ : state) { // NOLINT
+    bytes = bench.scrape();
+  }
+  state.counters["response_bytes"] = static_cast<double>(bytes);
+}
+BENCHMARK(BM_StoreScrape)
+    ->ArgsProduct({{0, 1}, {1000, 10000}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
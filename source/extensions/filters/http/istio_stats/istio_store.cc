@@ -0,0 +1,292 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/filters/http/istio_stats/istio_store.h"
+
+#include <algorithm>
+#include <map>
+
+#include "source/common/common/macros.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "fmt/format.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+namespace {
+
+const std::vector<double>& durationBuckets() {
+  CONSTRUCT_ON_FIRST_USE(std::vector<double>, 0.5, 1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500,
+                         5000, 10000, 30000, 60000, 300000, 600000, 1800000, 3600000);
+}
+
+const std::vector<double>& sizeBuckets() {
+  CONSTRUCT_ON_FIRST_USE(std::vector<double>, 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+                         100000000, 1000000000);
+}
+
+void appendName(std::string& key, Stats::StatName name) {
+  if (name.sizeAndData() == nullptr) {
+    // Encoding of an empty name.
+    key.push_back('\0');
+    return;
+  }
+  key.append(reinterpret_cast<const char*>(name.sizeAndData()), name.size());
+}
+
+template <class Fn> void forEachName(absl::string_view key, Fn fn) {
+  const auto* data = reinterpret_cast<const uint8_t*>(key.data());
+  const auto* end = data + key.size();
+  while (data < end) {
+    const Stats::StatName name(data);
+    fn(name);
+    data += name.size();
+  }
+}
+
+// Replaces the characters not allowed in the metric and label names.
+std::string sanitizeName(std::string name) {
+  for (char& c : name) {
+    if (!absl::ascii_isalnum(c) && c != '_') {
+      c = '_';
+    }
+  }
+  if (!name.empty() && absl::ascii_isdigit(name[0])) {
+    name.insert(0, "_");
+  }
+  return name;
+}
+
+std::string escapeValue(absl::string_view value) {
+  return absl::StrReplaceAll(value, {{"\\", "\\\\"}, {"\"", "\\\""}, {"\n", "\\n"}});
+}
+
+std::string withLabels(absl::string_view labels) {
+  return labels.empty() ? std::string() : absl::StrCat("{", labels, "}");
+}
+
+} // namespace
+
+IstioStore::Series& IstioStore::Table::get(absl::string_view key, Stats::Histogram::Unit unit,
+                                           bool histogram) {
+  auto it = series_.find(key);
+  if (it == series_.end()) {
+    forEachName(key, [this](Stats::StatName name) { symbol_table_.incRefCount(name); });
+    it = series_.try_emplace(key).first;
+    it->second.unit_ = unit;
+    it->second.histogram_ = histogram;
+    if (histogram) {
+      it->second.buckets_.assign(buckets(unit).size() + 1, 0);
+    }
+  }
+  return it->second;
+}
+
+void IstioStore::Table::accumulate(Series& series, const Series& other, MonotonicTime now) {
+  series.value_ += other.value_;
+  series.sum_ += other.sum_;
+  const size_t size = std::min(series.buckets_.size(), other.buckets_.size());
+  for (size_t i = 0; i < size; i++) {
+    series.buckets_[i] += other.buckets_[i];
+  }
+  series.updated_ = std::max({series.updated_, other.updated_, now});
+}
+
+void IstioStore::Table::add(const Table& other, MonotonicTime now) {
+  for (const auto& [key, other_series] : other.series_) {
+    accumulate(get(key, other_series.unit_, other_series.histogram_), other_series, now);
+  }
+}
+
+void IstioStore::Table::drain(Table& into, MonotonicTime now, uint32_t max_idle) {
+  for (auto it = series_.begin(); it != series_.end();) {
+    auto& series = it->second;
+    if (series.value_ == 0) {
+      if (++series.idle_merges_ >= max_idle) {
+        release(it->first);
+        series_.erase(it++);
+        continue;
+      }
+    } else {
+      accumulate(into.get(it->first, series.unit_, series.histogram_), series, now);
+      series.value_ = 0;
+      series.sum_ = 0;
+      std::fill(series.buckets_.begin(), series.buckets_.end(), 0);
+      series.idle_merges_ = 0;
+    }
+    ++it;
+  }
+}
+
+void IstioStore::Table::expire(MonotonicTime before) {
+  for (auto it = series_.begin(); it != series_.end();) {
+    if (it->second.updated_ < before) {
+      release(it->first);
+      series_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void IstioStore::Table::clear() {
+  for (const auto& [key, _] : series_) {
+    release(key);
+  }
+  series_.clear();
+}
+
+void IstioStore::Table::release(absl::string_view key) {
+  forEachName(key, [this](Stats::StatName name) { symbol_table_.free(name); });
+}
+
+const std::vector<double>& IstioStore::buckets(Stats::Histogram::Unit unit) {
+  return unit == Stats::Histogram::Unit::Bytes ? sizeBuckets() : durationBuckets();
+}
+
+std::string IstioStore::render(const Table& table) {
+  struct Family {
+    bool histogram_{false};
+    std::string series_;
+  };
+  // Families are rendered in order, each with a single TYPE line.
+  std::map<std::string, Family> families;
+  std::vector<Stats::StatName> names;
+  for (const auto& [key, series] : table.series()) {
+    names.clear();
+    forEachName(key, [&names](Stats::StatName name) { names.push_back(name); });
+    if (names.empty()) {
+      continue;
+    }
+    const std::string name = sanitizeName(table.symbolTable().toString(names[0]));
+    std::string labels;
+    for (size_t i = 1; i + 1 < names.size(); i += 2) {
+      absl::StrAppend(&labels, labels.empty() ? "" : ",",
+                      sanitizeName(table.symbolTable().toString(names[i])), "=\"",
+                      escapeValue(table.symbolTable().toString(names[i + 1])), "\"");
+    }
+    auto& family = families[name];
+    family.histogram_ = series.histogram_;
+    if (!series.histogram_) {
+      absl::StrAppend(&family.series_, name, withLabels(labels), " ", series.value_, "\n");
+      continue;
+    }
+    const auto& bounds = buckets(series.unit_);
+    const std::string prefix = labels.empty() ? "" : absl::StrCat(labels, ",");
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < bounds.size() && i < series.buckets_.size(); i++) {
+      cumulative += series.buckets_[i];
+      absl::StrAppend(&family.series_, name, "_bucket{", prefix, "le=\"",
+                      fmt::format("{0:.32g}", bounds[i]), "\"} ", cumulative, "\n");
+    }
+    absl::StrAppend(&family.series_, name, "_bucket{", prefix, "le=\"+Inf\"} ", series.value_,
+                    "\n");
+    absl::StrAppend(&family.series_, name, "_sum", withLabels(labels), " ", series.sum_, "\n");
+    absl::StrAppend(&family.series_, name, "_count", withLabels(labels), " ", series.value_,
+                    "\n");
+  }
+  std::string out;
+  for (const auto& [name, family] : families) {
+    absl::StrAppend(&out, "# TYPE ", name, family.histogram_ ? " histogram\n" : " counter\n",
+                    family.series_);
+  }
+  return out;
+}
+
+IstioStore::IstioStore(Stats::SymbolTable& symbol_table, ThreadLocal::SlotAllocator& tls,
+                       Event::Dispatcher& main_dispatcher,
+                       std::chrono::milliseconds merge_interval, std::chrono::milliseconds expiry)
+    : symbol_table_(symbol_table), tls_(tls),
+      state_(std::make_shared<State>(symbol_table, main_dispatcher.timeSource(), expiry)),
+      merge_interval_(merge_interval) {
+  tls_.set([&symbol_table](Event::Dispatcher&) {
+    return std::make_shared<ThreadLocalTable>(symbol_table);
+  });
+  merge_timer_ = main_dispatcher.createTimer([this] {
+    merge();
+    merge_timer_->enableTimer(merge_interval_);
+  });
+  merge_timer_->enableTimer(merge_interval_);
+}
+
+IstioStore::~IstioStore() { merge_timer_->disableTimer(); }
+
+IstioStore::Series& IstioStore::series(Stats::StatName metric,
+                                       const Stats::StatNameTagVector& tags,
+                                       Stats::Histogram::Unit unit, bool histogram) {
+  std::string& key = tls_->key_;
+  key.clear();
+  appendName(key, metric);
+  for (const auto& [name, value] : tags) {
+    appendName(key, name);
+    appendName(key, value);
+  }
+  return tls_->table_.get(key, unit, histogram);
+}
+
+void IstioStore::addCounter(Stats::StatName metric, const Stats::StatNameTagVector& tags,
+                            uint64_t amount) {
+  series(metric, tags, Stats::Histogram::Unit::Unspecified, false).value_ += amount;
+}
+
+void IstioStore::recordValue(Stats::StatName metric, Stats::Histogram::Unit unit,
+                             const Stats::StatNameTagVector& tags, uint64_t value) {
+  auto& histogram = series(metric, tags, unit, true);
+  const auto& bounds = buckets(unit);
+  histogram.buckets_[std::lower_bound(bounds.begin(), bounds.end(), static_cast<double>(value)) -
+                     bounds.begin()]++;
+  histogram.value_++;
+  histogram.sum_ += value;
+}
+
+void IstioStore::merge() {
+  auto state = state_;
+  const auto now = state->time_source_.monotonicTime();
+  tls_.runOnAllThreads(
+      [state, now](OptRef<ThreadLocalTable> tls) {
+        if (!tls.has_value() || tls->table_.size() == 0) {
+          return;
+        }
+        absl::MutexLock lock(&state->mutex_);
+        tls->table_.drain(state->merged_, now, WorkerIdleMerges);
+      },
+      [state] { state->onMerged(); });
+}
+
+void IstioStore::State::onMerged() {
+  if (expiry_.count() > 0) {
+    absl::MutexLock lock(&mutex_);
+    merged_.expire(time_source_.monotonicTime() - expiry_);
+  }
+}
+
+void IstioStore::addTo(Table& table) const {
+  absl::MutexLock lock(&state_->mutex_);
+  table.add(state_->merged_);
+}
+
+size_t IstioStore::size() const {
+  absl::MutexLock lock(&state_->mutex_);
+  return state_->merged_.size();
+}
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,156 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "envoy/common/time.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/stats/histogram.h"
+#include "envoy/stats/symbol_table.h"
+#include "envoy/stats/tag.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+// Counters and histograms of the istio metrics recorded outside of the Envoy
+// stats. Each worker records into its own table, keyed by the encoded metric
+// and tag names, and the deltas of the tables are merged at every merge
+// interval. Worker series stay resident between merges, so that only new keys
+// reference their symbols. Histograms have fixed buckets. The merged series
+// are rendered in the Prometheus text format.
+class IstioStore {
+public:
+  struct Series {
+    Stats::Histogram::Unit unit_{Stats::Histogram::Unit::Unspecified};
+    bool histogram_{false};
+    // Counter value, or sample count of a histogram.
+    uint64_t value_{0};
+    uint64_t sum_{0};
+    // Sample count of each bucket of a histogram, not cumulative. The last
+    // bucket is above all the bounds.
+    std::vector<uint64_t> buckets_;
+    // Time of the last merge updating the series.
+    MonotonicTime updated_;
+    // Consecutive merges without delta, of a worker series.
+    uint32_t idle_merges_{0};
+  };
+
+  // Series keyed by the encoded metric name followed by the encoded names
+  // and values of the tags. The table holds a reference on the symbols of its
+  // keys, so that they outlive the pools of the streams.
+  class Table {
+  public:
+    explicit Table(Stats::SymbolTable& symbol_table) : symbol_table_(symbol_table) {}
+    ~Table() { clear(); }
+
+    // Returns the series of the key, created if missing.
+    Series& get(absl::string_view key, Stats::Histogram::Unit unit, bool histogram);
+    // Adds the values of the series of the other table.
+    void add(const Table& other, MonotonicTime now = {});
+    // Adds the values of the series to the other table and zeroes them. The
+    // series without values for max_idle consecutive drains are removed.
+    void drain(Table& into, MonotonicTime now, uint32_t max_idle);
+    // Removes the series not updated since the time.
+    void expire(MonotonicTime before);
+    void clear();
+
+    size_t size() const { return series_.size(); }
+    Stats::SymbolTable& symbolTable() const { return symbol_table_; }
+    const absl::flat_hash_map<std::string, Series>& series() const { return series_; }
+
+  private:
+    static void accumulate(Series& series, const Series& other, MonotonicTime now);
+    void release(absl::string_view key);
+
+    Stats::SymbolTable& symbol_table_;
+    absl::flat_hash_map<std::string, Series> series_;
+  };
+
+  // Upper bounds of the histogram buckets: the Envoy defaults for durations
+  // and powers of ten for sizes.
+  static const std::vector<double>& buckets(Stats::Histogram::Unit unit);
+
+  // Renders the series of the table in the Prometheus text format, grouped
+  // by metric family.
+  static std::string render(const Table& table);
+
+  // Series not updated during the expiry are dropped, unless it is zero.
+  IstioStore(Stats::SymbolTable& symbol_table, ThreadLocal::SlotAllocator& tls,
+             Event::Dispatcher& main_dispatcher, std::chrono::milliseconds merge_interval,
+             std::chrono::milliseconds expiry);
+  ~IstioStore();
+
+  // Worker threads.
+  void addCounter(Stats::StatName metric, const Stats::StatNameTagVector& tags, uint64_t amount);
+  void recordValue(Stats::StatName metric, Stats::Histogram::Unit unit,
+                   const Stats::StatNameTagVector& tags, uint64_t value);
+
+  // Main thread. Each worker adds the deltas of its table to the merged
+  // series, then the idle merged series are expired. Runs at every merge
+  // interval.
+  void merge();
+
+  // Main thread. Adds the merged series to the table.
+  void addTo(Table& table) const;
+  size_t size() const;
+
+  // Merges without delta after which a worker drops a series.
+  static constexpr uint32_t WorkerIdleMerges = 10;
+
+private:
+  struct ThreadLocalTable : public ThreadLocal::ThreadLocalObject {
+    explicit ThreadLocalTable(Stats::SymbolTable& symbol_table) : table_(symbol_table) {}
+    Table table_;
+    // Reused to encode the keys.
+    std::string key_;
+  };
+
+  // Shared with the merge callbacks, which may complete after the store is
+  // deleted.
+  struct State {
+    State(Stats::SymbolTable& symbol_table, TimeSource& time_source,
+          std::chrono::milliseconds expiry)
+        : merged_(symbol_table), time_source_(time_source), expiry_(expiry) {}
+    void onMerged();
+
+    absl::Mutex mutex_;
+    Table merged_ ABSL_GUARDED_BY(mutex_);
+    TimeSource& time_source_;
+    const std::chrono::milliseconds expiry_;
+  };
+
+  Series& series(Stats::StatName metric, const Stats::StatNameTagVector& tags,
+                 Stats::Histogram::Unit unit, bool histogram);
+
+  Stats::SymbolTable& symbol_table_;
+  ThreadLocal::TypedSlot<ThreadLocalTable> tls_;
+  const std::shared_ptr<State> state_;
+  const std::chrono::milliseconds merge_interval_;
+  Event::TimerPtr merge_timer_;
+};
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,143 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/filters/http/istio_stats/istio_store.h"
+
+#include "source/common/stats/symbol_table.h"
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/thread_local/mocks.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::HasSubstr;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+namespace {
+
+class IstioStoreTest : public testing::Test {
+protected:
+  IstioStoreTest()
+      : pool_(symbol_table_), store_(symbol_table_, tls_, dispatcher_, std::chrono::seconds(5),
+                                     std::chrono::milliseconds(0)) {}
+
+  std::string render() {
+    IstioStore::Table table(symbol_table_);
+    store_.addTo(table);
+    return IstioStore::render(table);
+  }
+
+  Stats::SymbolTableImpl symbol_table_;
+  Stats::StatNamePool pool_;
+  NiceMock<ThreadLocal::MockInstance> tls_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  IstioStore store_;
+};
+
+TEST_F(IstioStoreTest, MergesAndRendersSeries) {
+  const Stats::StatNameTagVector tags = {{pool_.add("reporter"), pool_.add("destination")}};
+  store_.addCounter(pool_.add("istio_requests_total"), tags, 1);
+  store_.addCounter(pool_.add("istio_requests_total"), tags, 2);
+  const auto duration = pool_.add("istio_request_duration_milliseconds");
+  store_.recordValue(duration, Stats::Histogram::Unit::Milliseconds, tags, 7);
+  store_.recordValue(duration, Stats::Histogram::Unit::Milliseconds, tags, 300);
+  EXPECT_EQ(0, store_.size());
+
+  store_.merge();
+  EXPECT_EQ(2, store_.size());
+  const std::string out = render();
+  EXPECT_THAT(out, HasSubstr("# TYPE istio_requests_total counter\n"
+                             "istio_requests_total{reporter=\"destination\"} 3\n"));
+  EXPECT_THAT(out, HasSubstr("# TYPE istio_request_duration_milliseconds histogram\n"));
+  EXPECT_THAT(out, HasSubstr("_bucket{reporter=\"destination\",le=\"5\"} 0\n"));
+  EXPECT_THAT(out, HasSubstr("_bucket{reporter=\"destination\",le=\"10\"} 1\n"));
+  EXPECT_THAT(out, HasSubstr("_bucket{reporter=\"destination\",le=\"500\"} 2\n"));
+  EXPECT_THAT(out, HasSubstr("_bucket{reporter=\"destination\",le=\"3600000\"} 2\n"));
+  EXPECT_THAT(out, HasSubstr("_bucket{reporter=\"destination\",le=\"+Inf\"} 2\n"));
+  EXPECT_THAT(out, HasSubstr("_sum{reporter=\"destination\"} 307\n"));
+  EXPECT_THAT(out, HasSubstr("_count{reporter=\"destination\"} 2\n"));
+
+  // Later merges add to the merged series.
+  store_.addCounter(pool_.add("istio_requests_total"), tags, 4);
+  store_.merge();
+  EXPECT_THAT(render(), HasSubstr("istio_requests_total{reporter=\"destination\"} 7\n"));
+}
+
+TEST_F(IstioStoreTest, KeepsNamesOfStreams) {
+  {
+    // Tag values are added to the pool of each stream.
+    Stats::StatNameDynamicPool stream_pool(symbol_table_);
+    store_.addCounter(pool_.add("istio_requests_total"),
+                      {{pool_.add("response_code"), stream_pool.add("503")}}, 1);
+  }
+  store_.merge();
+  EXPECT_THAT(render(), HasSubstr("istio_requests_total{response_code=\"503\"} 1\n"));
+}
+
+TEST_F(IstioStoreTest, SanitizesNamesAndEscapesValues) {
+  store_.addCounter(pool_.add("istio_custom-count"),
+                    {{pool_.add("source.app"), pool_.add("a\"b\\c")}}, 1);
+  store_.merge();
+  EXPECT_THAT(render(), HasSubstr("istio_custom_count{source_app=\"a\\\"b\\\\c\"} 1\n"));
+}
+
+TEST_F(IstioStoreTest, ExpiresIdleSeries) {
+  IstioStore::Table delta(symbol_table_);
+  delta.get("", Stats::Histogram::Unit::Unspecified, false);
+  IstioStore::Table merged(symbol_table_);
+  merged.add(delta, MonotonicTime(std::chrono::seconds(1)));
+  merged.expire(MonotonicTime(std::chrono::seconds(1)));
+  EXPECT_EQ(1, merged.size());
+  merged.expire(MonotonicTime(std::chrono::seconds(2)));
+  EXPECT_EQ(0, merged.size());
+}
+
+TEST_F(IstioStoreTest, DrainKeepsSeriesUntilIdle) {
+  const auto key = [this] {
+    std::string key;
+    const auto name = pool_.add("istio_requests_total");
+    key.append(reinterpret_cast<const char*>(name.sizeAndData()), name.size());
+    return key;
+  }();
+  IstioStore::Table worker(symbol_table_);
+  IstioStore::Table merged(symbol_table_);
+  worker.get(key, Stats::Histogram::Unit::Unspecified, false).value_ += 2;
+  worker.drain(merged, MonotonicTime(std::chrono::seconds(1)), 2);
+  // The worker series is zeroed, not removed.
+  ASSERT_EQ(1, worker.size());
+  EXPECT_EQ(0, worker.series().begin()->second.value_);
+  EXPECT_EQ(2, merged.series().begin()->second.value_);
+
+  worker.get(key, Stats::Histogram::Unit::Unspecified, false).value_ += 3;
+  worker.drain(merged, MonotonicTime(std::chrono::seconds(2)), 2);
+  EXPECT_EQ(5, merged.series().begin()->second.value_);
+  EXPECT_EQ(MonotonicTime(std::chrono::seconds(2)), merged.series().begin()->second.updated_);
+
+  // Removed after two drains without values.
+  worker.drain(merged, MonotonicTime(std::chrono::seconds(3)), 2);
+  EXPECT_EQ(1, worker.size());
+  worker.drain(merged, MonotonicTime(std::chrono::seconds(4)), 2);
+  EXPECT_EQ(0, worker.size());
+  EXPECT_EQ(5, merged.series().begin()->second.value_);
+}
+
+} // namespace
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -15,7 +15,10 @@
 #include "source/extensions/filters/http/peer_metadata/filter.h"
 
 #include "envoy/registry/registry.h"
+#include "envoy/server/admin.h"
 #include "envoy/server/factory_context.h"
+#include "envoy/thread_local/thread_local.h"
+#include "extensions/common/host_metadata_cache.h"
 #include "extensions/common/metadata_object.h"
 #include "extensions/common/proto_util.h"
 #include "source/common/common/hash.h"
@@ -23,7 +26,11 @@
 #include "source/common/http/header_utility.h"
 #include "source/common/http/utility.h"
 #include "source/common/network/utility.h"
+#include "source/common/protobuf/utility.h"
 #include "source/extensions/filters/common/expr/cel_state.h"
+#include "source/extensions/filters/network/metadata_exchange/metadata_exchange.h"
+
+#include "absl/container/flat_hash_set.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -53,19 +60,45 @@ struct CelPrototypeValues {
 
 using CelPrototypes = ConstSingleton<CelPrototypeValues>;
 
+// Original destination of internal upstream hosts, parsed once per host.
+using InternalAddressCache =
+    Istio::Common::HostMetadataCache<Network::Address::InstanceConstSharedPtr>;
+
 class XDSMethod : public DiscoveryMethod {
 public:
   XDSMethod(bool downstream, Server::Configuration::ServerFactoryContext& factory_context)
       : downstream_(downstream),
-        metadata_provider_(Extensions::Common::WorkloadDiscovery::GetProvider(factory_context)) {}
+        metadata_provider_(Extensions::Common::WorkloadDiscovery::GetProvider(factory_context)),
+        internal_addresses_(factory_context.threadLocal()) {
+    internal_addresses_.set(
+        [](Event::Dispatcher&) { return std::make_shared<InternalAddressCache>(); });
+  }
   absl::optional<PeerInfo> derivePeerInfo(const StreamInfo::StreamInfo&, Http::HeaderMap&,
                                           Context&) const override;
 
 private:
+  static Network::Address::InstanceConstSharedPtr
+  parseInternalAddress(const envoy::config::core::v3::Metadata& metadata);
+
   const bool downstream_;
   Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr metadata_provider_;
+  mutable ThreadLocal::TypedSlot<InternalAddressCache> internal_addresses_;
 };
 
+Network::Address::InstanceConstSharedPtr
+XDSMethod::parseInternalAddress(const envoy::config::core::v3::Metadata& metadata) {
+  const auto& filter_metadata = metadata.filter_metadata();
+  const auto& it = filter_metadata.find("envoy.filters.listener.original_dst");
+  if (it != filter_metadata.end()) {
+    const auto& destination_it = it->second.fields().find("local");
+    if (destination_it != it->second.fields().end()) {
+      return Network::Utility::parseInternetAddressAndPortNoThrow(
+          destination_it->second.string_value(), /*v6only=*/false);
+    }
+  }
+  return nullptr;
+}
+
 absl::optional<PeerInfo> XDSMethod::derivePeerInfo(const StreamInfo::StreamInfo& info,
                                                    Http::HeaderMap&, Context&) const {
   if (!metadata_provider_) {
@@ -84,17 +117,7 @@ absl::optional<PeerInfo> XDSMethod::derivePeerInfo(const StreamInfo::StreamInfo&
           peer_address = upstream_host->address();
           break;
         case Network::Address::Type::EnvoyInternal:
-          if (upstream_host->metadata()) {
-            const auto& filter_metadata = upstream_host->metadata()->filter_metadata();
-            const auto& it = filter_metadata.find("envoy.filters.listener.original_dst");
-            if (it != filter_metadata.end()) {
-              const auto& destination_it = it->second.fields().find("local");
-              if (destination_it != it->second.fields().end()) {
-                peer_address = Network::Utility::parseInternetAddressAndPortNoThrow(
-                    destination_it->second.string_value(), /*v6only=*/false);
-              }
-            }
-          }
+          peer_address = internal_addresses_->get(*upstream_host, parseInternalAddress);
           break;
         default:
           break;
@@ -104,14 +127,159 @@ absl::optional<PeerInfo> XDSMethod::derivePeerInfo(const StreamInfo::StreamInfo&
   }
   const auto metadata_object = metadata_provider_->GetMetadata(peer_address);
   if (metadata_object) {
-    return Istio::Common::convertWorkloadMetadataToFlatNode(metadata_object.value());
+    return metadata_object->flatNode();
   }
   return {};
 }
 
+namespace {
+
+constexpr absl::string_view AdminPath = "/istio/peer_metadata";
+
+// Decodes a peer for the admin handler.
+ProtobufWkt::Value peerValue(absl::string_view flat_node) {
+  ProtobufWkt::Value value;
+  ::Wasm::Common::extractStructFromNodeFlatBuffer(
+      *flatbuffers::GetRoot<::Wasm::Common::FlatNode>(flat_node.data()),
+      value.mutable_struct_value());
+  return value;
+}
+
+// Adds to a counter with a single writer.
+void increment(std::atomic<uint64_t>& counter, uint64_t value = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+} // namespace
+
+// Admin handler reporting the state of the peer metadata caches of all the
+// filter configs, of the TCP metadata exchange configs and of the workload
+// index. It runs on the main thread.
+class PeerMetadataAdmin : public Singleton::Instance {
+public:
+  explicit PeerMetadataAdmin(Server::Configuration::ServerFactoryContext& factory_context)
+      : factory_context_(factory_context), admin_(factory_context.admin()) {
+    if (admin_) {
+      admin_->addHandler(std::string(AdminPath),
+                         "print the peer metadata caches and the workload index "
+                         "(params: peer_id, address)",
+                         MAKE_ADMIN_HANDLER(handler), true, false);
+    }
+  }
+  ~PeerMetadataAdmin() override {
+    if (admin_) {
+      admin_->removeHandler(std::string(AdminPath));
+    }
+  }
+
+  void add(const MXMethod& method) { methods_.insert(&method); }
+  void remove(const MXMethod& method) { methods_.erase(&method); }
+
+private:
+  Http::Code handler(Http::ResponseHeaderMap& response_headers, Buffer::Instance& response,
+                     Server::AdminStream& admin_stream) {
+    const auto params = admin_stream.queryParams();
+    ProtobufWkt::Struct out;
+    auto* mx = (*out.mutable_fields())["mx"].mutable_list_value();
+    const auto peer_id = params.getFirstValue("peer_id").value_or("");
+    for (const auto* method : methods_) {
+      *mx->add_values()->mutable_struct_value() = method->adminState(peer_id);
+    }
+    if (const auto tcp_admin = Tcp::MetadataExchange::getMetadataExchangeAdmin(factory_context_);
+        tcp_admin) {
+      *(*out.mutable_fields())["tcp_mx"].mutable_list_value() = tcp_admin->adminState();
+    }
+    // The provider is resolved on each request, since the workload discovery
+    // extension creates it when the server is initialized, possibly after the
+    // first filter config.
+    const auto provider = Extensions::Common::WorkloadDiscovery::GetProvider(factory_context_);
+    if (provider) {
+      auto& index = *(*out.mutable_fields())["workload_discovery"].mutable_struct_value();
+      if (const auto* stats = provider->stats(); stats) {
+        (*index.mutable_fields())["workloads"].set_number_value(stats->total_.value());
+        (*index.mutable_fields())["index_memory_bytes"].set_number_value(
+            stats->index_memory_bytes_.value());
+        (*index.mutable_fields())["lookup_hit"].set_number_value(stats->lookup_hit_.value());
+        (*index.mutable_fields())["lookup_miss"].set_number_value(stats->lookup_miss_.value());
+        (*index.mutable_fields())["on_demand_requests"].set_number_value(
+            stats->on_demand_requests_.value());
+      }
+      if (const auto address = params.getFirstValue("address"); address.has_value()) {
+        const auto parsed = Network::Utility::parseInternetAddressNoThrow(address.value());
+        if (!parsed) {
+          response.add("invalid address\n");
+          return Http::Code::BadRequest;
+        }
+        const auto workload = provider->peekMetadata(parsed);
+        if (workload) {
+          (*index.mutable_fields())["peer"] = peerValue(workload->flatNode());
+        } else {
+          (*index.mutable_fields())["peer"].set_null_value(ProtobufWkt::NULL_VALUE);
+        }
+      }
+    }
+    response_headers.setReferenceContentType(Http::Headers::get().ContentTypeValues.Json);
+    response.add(MessageUtil::getJsonStringFromMessageOrError(out, true, true));
+    return Http::Code::OK;
+  }
+
+  Server::Configuration::ServerFactoryContext& factory_context_;
+  OptRef<Server::Admin> admin_;
+  absl::flat_hash_set<const MXMethod*> methods_;
+};
+
+SINGLETON_MANAGER_REGISTRATION(peer_metadata_admin)
+
 MXMethod::MXMethod(bool downstream, Server::Configuration::ServerFactoryContext& factory_context)
-    : downstream_(downstream), tls_(factory_context.threadLocal()) {
-  tls_.set([](Event::Dispatcher&) { return std::make_shared<MXCache>(); });
+    : downstream_(downstream), tls_(factory_context.threadLocal()),
+      lookup_self_time_(factory_context.scope(), factory_context.runtime(), "peer_metadata",
+                        "mx_lookup"),
+      admin_(factory_context.singletonManager().getTyped<PeerMetadataAdmin>(
+          SINGLETON_MANAGER_REGISTERED_NAME(peer_metadata_admin),
+          [&factory_context] { return std::make_shared<PeerMetadataAdmin>(factory_context); })) {
+  tls_.set([this](Event::Dispatcher&) {
+    auto cache = std::make_shared<MXCache>();
+    absl::MutexLock lock(&caches_mutex_);
+    caches_.push_back(cache);
+    return cache;
+  });
+  admin_->add(*this);
+}
+
+MXMethod::~MXMethod() { admin_->remove(*this); }
+
+ProtobufWkt::Struct MXMethod::adminState(absl::string_view peer_id) const {
+  ProtobufWkt::Struct out;
+  (*out.mutable_fields())["direction"].set_string_value(downstream_ ? "downstream" : "upstream");
+  (*out.mutable_fields())["max_peer_cache_size"].set_number_value(max_peer_cache_size_);
+  auto* threads = (*out.mutable_fields())["threads"].mutable_list_value();
+  absl::MutexLock caches_lock(&caches_mutex_);
+  for (const auto& weak_cache : caches_) {
+    const auto cache = weak_cache.lock();
+    if (!cache) {
+      continue;
+    }
+    auto& thread = *threads->add_values()->mutable_struct_value();
+    const uint64_t hits = cache->hits_.load(std::memory_order_relaxed);
+    const uint64_t misses = cache->misses_.load(std::memory_order_relaxed);
+    (*thread.mutable_fields())["hits"].set_number_value(hits);
+    (*thread.mutable_fields())["misses"].set_number_value(misses);
+    (*thread.mutable_fields())["hit_rate"].set_number_value(
+        hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0);
+    (*thread.mutable_fields())["evictions"].set_number_value(
+        cache->evictions_.load(std::memory_order_relaxed));
+    absl::MutexLock lock(&cache->mutex_);
+    (*thread.mutable_fields())["size"].set_number_value(cache->cache_.size());
+    if (!peer_id.empty()) {
+      const auto it = cache->cache_.find(peer_id);
+      if (it != cache->cache_.end()) {
+        (*thread.mutable_fields())["peer"] = peerValue(it->second);
+      } else {
+        (*thread.mutable_fields())["peer"].set_null_value(ProtobufWkt::NULL_VALUE);
+      }
+    }
+  }
+  return out;
 }
 
 absl::optional<PeerInfo> MXMethod::derivePeerInfo(const StreamInfo::StreamInfo&,
@@ -142,24 +310,29 @@ void MXMethod::remove(Http::HeaderMap& headers) const {
 absl::optional<PeerInfo> MXMethod::lookup(absl::string_view id, absl::string_view value) const {
   // This code is copied from:
   // https://github.com/istio/proxy/blob/release-1.18/extensions/metadata_exchange/plugin.cc#L116
-  auto& cache = tls_->cache_;
+  const auto self_time = lookup_self_time_.sample();
+  auto& tls = *tls_;
+  auto& cache = tls.cache_;
   if (max_peer_cache_size_ > 0 && !id.empty()) {
     auto it = cache.find(id);
     if (it != cache.end()) {
+      increment(tls.hits_);
       return it->second;
     }
+    increment(tls.misses_);
   }
   const auto bytes = Base64::decodeWithoutPadding(value);
   google::protobuf::Struct metadata;
   if (!metadata.ParseFromString(bytes)) {
     return {};
   }
-  const auto fb = ::Wasm::Common::extractNodeFlatBufferFromStruct(metadata);
-  std::string out(reinterpret_cast<const char*>(fb.data()), fb.size());
+  std::string out = ::Wasm::Common::extractNodeFlatBufferStringFromStruct(metadata);
   if (max_peer_cache_size_ > 0 && !id.empty()) {
+    absl::MutexLock lock(&tls.mutex_);
     // do not let the cache grow beyond max cache size.
     if (static_cast<uint32_t>(cache.size()) > max_peer_cache_size_) {
       cache.erase(cache.begin(), std::next(cache.begin(), max_peer_cache_size_ / 4));
+      increment(tls.evictions_, max_peer_cache_size_ / 4);
     }
     cache.emplace(id, out);
   }
@@ -210,7 +383,10 @@ FilterConfig::FilterConfig(const io::istio::http::peer_metadata::Config& config,
       downstream_propagation_(
           buildPropagationMethods(config.downstream_propagation(), true, factory_context)),
       upstream_propagation_(
-          buildPropagationMethods(config.upstream_propagation(), false, factory_context)) {}
+          buildPropagationMethods(config.upstream_propagation(), false, factory_context)),
+      discover_self_time_(factory_context.serverFactoryContext().scope(),
+                          factory_context.serverFactoryContext().runtime(), "peer_metadata",
+                          "discover") {}
 
 std::vector<DiscoveryMethodPtr> FilterConfig::buildDiscoveryMethods(
     const Protobuf::RepeatedPtrField<io::istio::http::peer_metadata::Config::DiscoveryMethod>&
@@ -269,6 +445,7 @@ void FilterConfig::discoverUpstream(StreamInfo::StreamInfo& info, Http::Response
 
 void FilterConfig::discover(StreamInfo::StreamInfo& info, bool downstream, Http::HeaderMap& headers,
                             Context& ctx) const {
+  const auto self_time = discover_self_time_.sample();
   for (const auto& method : downstream ? downstream_discovery_ : upstream_discovery_) {
     const auto result = method->derivePeerInfo(info, headers, ctx);
     if (result) {
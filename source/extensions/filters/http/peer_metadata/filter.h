@@ -14,12 +14,17 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "source/extensions/filters/http/common/factory_base.h"
 #include "source/extensions/filters/http/common/pass_through_filter.h"
 #include "source/extensions/filters/http/peer_metadata/config.pb.h"
 #include "source/extensions/common/workload_discovery/api.h"
+#include "extensions/common/self_time.h"
 #include "source/common/singleton/const_singleton.h"
 
+#include "absl/synchronization/mutex.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
@@ -51,21 +56,40 @@ public:
 
 using DiscoveryMethodPtr = std::unique_ptr<DiscoveryMethod>;
 
+class PeerMetadataAdmin;
+
 class MXMethod : public DiscoveryMethod {
 public:
   MXMethod(bool downstream, Server::Configuration::ServerFactoryContext& factory_context);
+  ~MXMethod() override;
   absl::optional<PeerInfo> derivePeerInfo(const StreamInfo::StreamInfo&, Http::HeaderMap&,
                                           Context&) const override;
   void remove(Http::HeaderMap&) const override;
 
+  // Main thread. Returns the size and counters of the cache of each thread,
+  // with the cached peer of the ID if not empty.
+  ProtobufWkt::Struct adminState(absl::string_view peer_id) const;
+
 private:
   absl::optional<PeerInfo> lookup(absl::string_view id, absl::string_view value) const;
   const bool downstream_;
   struct MXCache : public ThreadLocal::ThreadLocalObject {
+    // Only the owning thread writes the cache, under the mutex so that the
+    // admin handler can read it. The owning thread reads without the mutex.
+    absl::Mutex mutex_;
     absl::flat_hash_map<std::string, std::string> cache_;
+    // Written by the owning thread only.
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
   };
   mutable ThreadLocal::TypedSlot<MXCache> tls_;
+  // Caches of all threads, for the admin handler.
+  mutable absl::Mutex caches_mutex_;
+  std::vector<std::weak_ptr<MXCache>> caches_ ABSL_GUARDED_BY(caches_mutex_);
   const int64_t max_peer_cache_size_{500};
+  const Istio::Common::SelfTime lookup_self_time_;
+  const std::shared_ptr<PeerMetadataAdmin> admin_;
 };
 
 // Base class for the propagation methods.
@@ -120,6 +144,7 @@ private:
   const std::vector<DiscoveryMethodPtr> upstream_discovery_;
   const std::vector<PropagationMethodPtr> downstream_propagation_;
   const std::vector<PropagationMethodPtr> upstream_propagation_;
+  const Istio::Common::SelfTime discover_self_time_;
 };
 
 using FilterConfigSharedPtr = std::shared_ptr<FilterConfig>;
@@ -24,6 +24,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
+using Envoy::Extensions::Common::WorkloadDiscovery::WorkloadMetadataObjectConstSharedPtr;
 using Istio::Common::WorkloadMetadataObject;
 using testing::HasSubstr;
 using testing::Invoke;
@@ -49,7 +50,7 @@ class MockWorkloadMetadataProvider
 public:
   MockWorkloadMetadataProvider() {}
   ~MockWorkloadMetadataProvider() override {}
-  MOCK_METHOD(std::optional<WorkloadMetadataObject>, GetMetadata,
+  MOCK_METHOD(WorkloadMetadataObjectConstSharedPtr, GetMetadata,
               (const Network::Address::InstanceConstSharedPtr& address));
 };
 
@@ -61,6 +62,9 @@ protected:
     metadata_provider_ = std::make_shared<NiceMock<MockWorkloadMetadataProvider>>();
     ON_CALL(singleton_manager_, get(HasSubstr("workload_metadata_provider"), _, _))
         .WillByDefault(Return(metadata_provider_));
+    ON_CALL(singleton_manager_, get(HasSubstr("peer_metadata_admin"), _, _))
+        .WillByDefault(Invoke(
+            [](const std::string&, Singleton::SingletonFactoryCb cb, bool) { return cb(); }));
   }
   void initialize(const std::string& yaml_config) {
     TestUtility::loadFromYaml(yaml_config, config_);
@@ -119,7 +123,7 @@ TEST_F(PeerMetadataTest, None) {
 }
 
 TEST_F(PeerMetadataTest, DownstreamXDSNone) {
-  EXPECT_CALL(*metadata_provider_, GetMetadata(_)).WillRepeatedly(Return(std::nullopt));
+  EXPECT_CALL(*metadata_provider_, GetMetadata(_)).WillRepeatedly(Return(nullptr));
   initialize(R"EOF(
     downstream_discovery:
       - workload_discovery: {}
@@ -136,9 +140,9 @@ TEST_F(PeerMetadataTest, DownstreamXDS) {
                                    "");
   EXPECT_CALL(*metadata_provider_, GetMetadata(_))
       .WillRepeatedly(Invoke([&](const Network::Address::InstanceConstSharedPtr& address)
-                                 -> std::optional<WorkloadMetadataObject> {
+                                 -> WorkloadMetadataObjectConstSharedPtr {
         if (absl::StartsWith(address->asStringView(), "127.0.0.1")) {
-          return {pod};
+          return std::make_shared<const WorkloadMetadataObject>(pod);
         }
         return {};
       }));
@@ -159,9 +163,9 @@ TEST_F(PeerMetadataTest, UpstreamXDS) {
                                    "");
   EXPECT_CALL(*metadata_provider_, GetMetadata(_))
       .WillRepeatedly(Invoke([&](const Network::Address::InstanceConstSharedPtr& address)
-                                 -> std::optional<WorkloadMetadataObject> {
+                                 -> WorkloadMetadataObjectConstSharedPtr {
         if (absl::StartsWith(address->asStringView(), "10.0.0.1")) {
-          return {pod};
+          return std::make_shared<const WorkloadMetadataObject>(pod);
         }
         return {};
       }));
@@ -196,9 +200,9 @@ TEST_F(PeerMetadataTest, UpstreamXDSInternal) {
                                    "");
   EXPECT_CALL(*metadata_provider_, GetMetadata(_))
       .WillRepeatedly(Invoke([&](const Network::Address::InstanceConstSharedPtr& address)
-                                 -> std::optional<WorkloadMetadataObject> {
+                                 -> WorkloadMetadataObjectConstSharedPtr {
         if (absl::StartsWith(address->asStringView(), "127.0.0.100")) {
-          return {pod};
+          return std::make_shared<const WorkloadMetadataObject>(pod);
         }
         return {};
       }));
@@ -266,9 +270,9 @@ TEST_F(PeerMetadataTest, DownstreamFallbackSecond) {
                                    "");
   EXPECT_CALL(*metadata_provider_, GetMetadata(_))
       .WillRepeatedly(Invoke([&](const Network::Address::InstanceConstSharedPtr& address)
-                                 -> std::optional<WorkloadMetadataObject> {
+                                 -> WorkloadMetadataObjectConstSharedPtr {
         if (absl::StartsWith(address->asStringView(), "127.0.0.1")) { // remote address
-          return {pod};
+          return std::make_shared<const WorkloadMetadataObject>(pod);
         }
         return {};
       }));
@@ -315,6 +319,31 @@ TEST_F(PeerMetadataTest, DownstreamMX) {
   checkShared(false);
 }
 
+TEST_F(PeerMetadataTest, MXAdminState) {
+  MXMethod method(true, context_.server_factory_context_);
+  Context ctx;
+  for (int i = 0; i < 2; i++) {
+    Http::TestRequestHeaderMapImpl headers;
+    headers.setReference(Headers::get().ExchangeMetadataHeaderId, "test-pod");
+    headers.setReference(Headers::get().ExchangeMetadataHeader, SampleIstioHeader);
+    EXPECT_TRUE(method.derivePeerInfo(stream_info_, headers, ctx).has_value());
+  }
+  const auto state = method.adminState("test-pod");
+  EXPECT_EQ("downstream", state.fields().at("direction").string_value());
+  const auto& threads = state.fields().at("threads").list_value();
+  ASSERT_EQ(1, threads.values_size());
+  const auto& thread = threads.values(0).struct_value().fields();
+  EXPECT_EQ(1, thread.at("size").number_value());
+  EXPECT_EQ(1, thread.at("hits").number_value());
+  EXPECT_EQ(1, thread.at("misses").number_value());
+  EXPECT_EQ(0, thread.at("evictions").number_value());
+  EXPECT_EQ("default", thread.at("peer").struct_value().fields().at("NAMESPACE").string_value());
+  const auto missing = method.adminState("other-pod");
+  const auto& missing_thread =
+      missing.fields().at("threads").list_value().values(0).struct_value().fields();
+  EXPECT_TRUE(missing_thread.at("peer").has_null_value());
+}
+
 TEST_F(PeerMetadataTest, UpstreamMX) {
   response_headers_.setReference(Headers::get().ExchangeMetadataHeaderId, "test-pod");
   response_headers_.setReference(Headers::get().ExchangeMetadataHeader, SampleIstioHeader);
@@ -349,9 +378,9 @@ TEST_F(PeerMetadataTest, UpstreamFallbackSecond) {
                                    "");
   EXPECT_CALL(*metadata_provider_, GetMetadata(_))
       .WillRepeatedly(Invoke([&](const Network::Address::InstanceConstSharedPtr& address)
-                                 -> std::optional<WorkloadMetadataObject> {
+                                 -> WorkloadMetadataObjectConstSharedPtr {
         if (absl::StartsWith(address->asStringView(), "10.0.0.1")) { // upstream host address
-          return {pod};
+          return std::make_shared<const WorkloadMetadataObject>(pod);
         }
         return {};
       }));
@@ -372,9 +401,9 @@ TEST_F(PeerMetadataTest, UpstreamFallbackFirstXDS) {
                                    "");
   EXPECT_CALL(*metadata_provider_, GetMetadata(_))
       .WillRepeatedly(Invoke([&](const Network::Address::InstanceConstSharedPtr& address)
-                                 -> std::optional<WorkloadMetadataObject> {
+                                 -> WorkloadMetadataObjectConstSharedPtr {
         if (absl::StartsWith(address->asStringView(), "10.0.0.1")) { // upstream host address
-          return {pod};
+          return std::make_shared<const WorkloadMetadataObject>(pod);
         }
         return {};
       }));
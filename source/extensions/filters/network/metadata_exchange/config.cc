@@ -17,6 +17,7 @@
 
 #include "envoy/network/connection.h"
 #include "envoy/registry/registry.h"
+#include "source/common/protobuf/utility.h"
 #include "source/extensions/filters/network/metadata_exchange/metadata_exchange.h"
 
 namespace Envoy {
@@ -25,6 +26,7 @@ namespace MetadataExchange {
 namespace {
 
 static constexpr char StatPrefix[] = "metadata_exchange.";
+static constexpr uint32_t DefaultMaxFrameSize = 64 * 1024;
 
 Network::FilterFactoryCb createFilterFactoryHelper(
     const envoy::tcp::metadataexchange::config::MetadataExchange& proto_config,
@@ -33,6 +35,8 @@ Network::FilterFactoryCb createFilterFactoryHelper(
 
   MetadataExchangeConfigSharedPtr filter_config(std::make_shared<MetadataExchangeConfig>(
       StatPrefix, proto_config.protocol(), filter_direction, proto_config.enable_discovery(),
+      PROTOBUF_GET_WRAPPED_OR_DEFAULT(proto_config, max_frame_size, DefaultMaxFrameSize),
+      std::chrono::milliseconds(PROTOBUF_GET_MS_OR_DEFAULT(proto_config, frame_read_timeout, 0)),
       context, context.scope()));
   return [filter_config, &context](Network::FilterManager& filter_manager) -> void {
     filter_manager.addFilter(
@@ -73,15 +73,59 @@ bool serializeToStringDeterministic(const google::protobuf::Struct& metadata,
 
 } // namespace
 
+SINGLETON_MANAGER_REGISTRATION(metadata_exchange_admin)
+
+MetadataExchangeAdminSharedPtr
+getMetadataExchangeAdmin(Server::Configuration::ServerFactoryContext& factory_context) {
+  return factory_context.singletonManager().getTyped<MetadataExchangeAdmin>(
+      SINGLETON_MANAGER_REGISTERED_NAME(metadata_exchange_admin),
+      [] { return std::make_shared<MetadataExchangeAdmin>(); });
+}
+
+ProtobufWkt::ListValue MetadataExchangeAdmin::adminState() const {
+  ProtobufWkt::ListValue out;
+  for (const auto* config : configs_) {
+    auto& state = *out.add_values()->mutable_struct_value();
+    (*state.mutable_fields())["stat_prefix"].set_string_value(config->stat_prefix_);
+    (*state.mutable_fields())["protocol"].set_string_value(config->protocol_);
+    (*state.mutable_fields())["direction"].set_string_value(
+        config->filter_direction_ == FilterDirection::Downstream ? "downstream" : "upstream");
+    (*state.mutable_fields())["discovery"].set_bool_value(config->metadata_provider_ != nullptr);
+    (*state.mutable_fields())["max_frame_size"].set_number_value(config->max_frame_size_);
+    (*state.mutable_fields())["frame_read_timeout_ms"].set_number_value(
+        config->frame_read_timeout_.count());
+    auto& counters = *(*state.mutable_fields())["counters"].mutable_struct_value();
+#define ADD_COUNTER(name)                                                                          \
+  (*counters.mutable_fields())[#name].set_number_value(config->stats_.name##_.value());
+    ALL_METADATA_EXCHANGE_STATS(ADD_COUNTER)
+#undef ADD_COUNTER
+  }
+  return out;
+}
+
 MetadataExchangeConfig::MetadataExchangeConfig(
     const std::string& stat_prefix, const std::string& protocol,
-    const FilterDirection filter_direction, bool enable_discovery,
+    const FilterDirection filter_direction, bool enable_discovery, uint32_t max_frame_size,
+    std::chrono::milliseconds frame_read_timeout,
     Server::Configuration::ServerFactoryContext& factory_context, Stats::Scope& scope)
     : scope_(scope), stat_prefix_(stat_prefix), protocol_(protocol),
-      filter_direction_(filter_direction), stats_(generateStats(stat_prefix, scope)) {
+      filter_direction_(filter_direction), max_frame_size_(max_frame_size),
+      frame_read_timeout_(frame_read_timeout), stats_(generateStats(stat_prefix, scope)),
+      read_proxy_data_self_time_(factory_context.scope(), factory_context.runtime(),
+                                 "metadata_exchange", "read_proxy_data"),
+      admin_(getMetadataExchangeAdmin(factory_context)) {
   if (enable_discovery) {
     metadata_provider_ = Extensions::Common::WorkloadDiscovery::GetProvider(factory_context);
   }
+  if (admin_) {
+    admin_->add(*this);
+  }
+}
+
+MetadataExchangeConfig::~MetadataExchangeConfig() {
+  if (admin_) {
+    admin_->remove(*this);
+  }
 }
 
 Network::FilterStatus MetadataExchangeFilter::onData(Buffer::Instance& data, bool end_stream) {
@@ -91,31 +135,29 @@ Network::FilterStatus MetadataExchangeFilter::onData(Buffer::Instance& data, boo
   case Done:
     // No work needed if connection state is Done or Invalid.
     return Network::FilterStatus::Continue;
+  case Aborted:
+    // The connection is closing, do not pass the remaining bytes along.
+    data.drain(data.length());
+    return Network::FilterStatus::StopIteration;
   case ConnProtocolNotRead: {
     // If Alpn protocol is not the expected one, then return.
     // Else find and write node metadata.
-    if (read_callbacks_->connection().nextProtocol() != config_->protocol_) {
-      ENVOY_LOG(trace, "Alpn Protocol Not Found. Expected {}, Got {}", config_->protocol_,
-                read_callbacks_->connection().nextProtocol());
-      setMetadataNotFoundFilterState();
-      conn_state_ = Invalid;
-      config_->stats().alpn_protocol_not_found_.inc();
+    if (!checkAlpnProtocol()) {
       return Network::FilterStatus::Continue;
     }
-    conn_state_ = WriteMetadata;
-    config_->stats().alpn_protocol_found_.inc();
     FALLTHRU;
   }
   case WriteMetadata: {
-    // TODO(gargnupur): Try to move this just after alpn protocol is
-    // determined and first onData is called in Downstream filter.
-    // If downstream filter, write metadata.
-    // Otherwise, go ahead and try to read initial header and proxy data.
-    writeNodeMetadata();
+    // Only reached if the connected event was not raised, e.g. without TLS.
+    buildNodeMetadata();
     FALLTHRU;
   }
   case ReadingInitialHeader:
   case NeedMoreDataInitialHeader: {
+    // The peer frame arrived before any application write, send the local
+    // frame on its own. Then go ahead and try to read initial header and
+    // proxy data.
+    writeNodeMetadata();
     tryReadInitialProxyHeader(data);
     if (conn_state_ == NeedMoreDataInitialHeader) {
       if (end_stream) {
@@ -123,7 +165,7 @@ Network::FilterStatus MetadataExchangeFilter::onData(Buffer::Instance& data, boo
         // Since this plugin would expect additional headers, but none is forthcoming,
         // do not block the tcp_proxy downstream of us from draining the buffer.
         ENVOY_LOG(debug, "Upstream closed early, aborting istio-peer-exchange");
-        conn_state_ = Invalid;
+        stopReading(Invalid);
         return Network::FilterStatus::Continue;
       }
       return Network::FilterStatus::StopIteration;
@@ -131,6 +173,10 @@ Network::FilterStatus MetadataExchangeFilter::onData(Buffer::Instance& data, boo
     if (conn_state_ == Invalid) {
       return Network::FilterStatus::Continue;
     }
+    if (conn_state_ == Aborted) {
+      data.drain(data.length());
+      return Network::FilterStatus::StopIteration;
+    }
     FALLTHRU;
   }
   case ReadingProxyHeader:
@@ -145,7 +191,7 @@ Network::FilterStatus MetadataExchangeFilter::onData(Buffer::Instance& data, boo
     FALLTHRU;
   }
   default:
-    conn_state_ = Done;
+    stopReading(Done);
     return Network::FilterStatus::Continue;
   }
 
@@ -156,44 +202,68 @@ Network::FilterStatus MetadataExchangeFilter::onNewConnection() {
   return Network::FilterStatus::Continue;
 }
 
-Network::FilterStatus MetadataExchangeFilter::onWrite(Buffer::Instance&, bool) {
+Network::FilterStatus MetadataExchangeFilter::onWrite(Buffer::Instance& data, bool) {
   switch (conn_state_) {
   case Invalid:
   case Done:
-    // No work needed if connection state is Done or Invalid.
+  case Aborted:
+    // No work needed if connection state is Done, Invalid or Aborted.
     return Network::FilterStatus::Continue;
   case ConnProtocolNotRead: {
-    if (read_callbacks_->connection().nextProtocol() != config_->protocol_) {
-      ENVOY_LOG(trace, "Alpn Protocol Not Found. Expected {}, Got {}", config_->protocol_,
-                read_callbacks_->connection().nextProtocol());
-      setMetadataNotFoundFilterState();
-      conn_state_ = Invalid;
-      config_->stats().alpn_protocol_not_found_.inc();
+    if (!checkAlpnProtocol()) {
       return Network::FilterStatus::Continue;
-    } else {
-      conn_state_ = WriteMetadata;
-      config_->stats().alpn_protocol_found_.inc();
     }
     FALLTHRU;
   }
   case WriteMetadata: {
-    // TODO(gargnupur): Try to move this just after alpn protocol is
-    // determined and first onWrite is called in Upstream filter.
-    writeNodeMetadata();
+    buildNodeMetadata();
     FALLTHRU;
   }
   case ReadingInitialHeader:
   case ReadingProxyHeader:
   case NeedMoreDataInitialHeader:
   case NeedMoreDataProxyHeader:
-    // These are to be handled in Reading Pipeline.
+    // Coalesce the metadata frame with the first application bytes. Reading
+    // is handled in the read pipeline.
+    writeNodeMetadata(&data);
     return Network::FilterStatus::Continue;
   }
 
   return Network::FilterStatus::Continue;
 }
 
-void MetadataExchangeFilter::writeNodeMetadata() {
+void MetadataExchangeFilter::onEvent(Network::ConnectionEvent event) {
+  // The ALPN protocol is known as soon as the TLS handshake completes. Build
+  // the metadata frame right away, it goes out with the first application
+  // write, or on its own if the peer frame arrives first.
+  if (event != Network::ConnectionEvent::Connected || conn_state_ != ConnProtocolNotRead) {
+    return;
+  }
+  if (checkAlpnProtocol()) {
+    buildNodeMetadata();
+  }
+}
+
+bool MetadataExchangeFilter::checkAlpnProtocol() {
+  if (read_callbacks_->connection().nextProtocol() != config_->protocol_) {
+    ENVOY_LOG(trace, "Alpn Protocol Not Found. Expected {}, Got {}", config_->protocol_,
+              read_callbacks_->connection().nextProtocol());
+    setMetadataNotFoundFilterState();
+    conn_state_ = Invalid;
+    config_->stats().alpn_protocol_not_found_.inc();
+    return false;
+  }
+  conn_state_ = WriteMetadata;
+  config_->stats().alpn_protocol_found_.inc();
+  if (config_->frame_read_timeout_.count() > 0) {
+    frame_read_timer_ = read_callbacks_->connection().dispatcher().createTimer(
+        [this]() { onFrameReadTimeout(); });
+    frame_read_timer_->enableTimer(config_->frame_read_timeout_);
+  }
+  return true;
+}
+
+void MetadataExchangeFilter::buildNodeMetadata() {
   if (conn_state_ != WriteMetadata) {
     return;
   }
@@ -212,14 +282,25 @@ void MetadataExchangeFilter::writeNodeMetadata() {
     std::string serialized_data;
     serializeToStringDeterministic(data, &serialized_data);
     *metadata_any_value.mutable_value() = serialized_data;
-    std::unique_ptr<::Envoy::Buffer::OwnedImpl> buf = constructProxyHeaderData(metadata_any_value);
-    write_callbacks_->injectWriteDataToFilterChain(*buf, false);
-    config_->stats().metadata_added_.inc();
+    pending_frame_ = constructProxyHeaderData(metadata_any_value);
   }
 
   conn_state_ = ReadingInitialHeader;
 }
 
+void MetadataExchangeFilter::writeNodeMetadata(Buffer::Instance* application_data) {
+  if (pending_frame_ == nullptr) {
+    return;
+  }
+  if (application_data != nullptr) {
+    application_data->prepend(*pending_frame_);
+  } else {
+    write_callbacks_->injectWriteDataToFilterChain(*pending_frame_, false);
+  }
+  pending_frame_.reset();
+  config_->stats().metadata_added_.inc();
+}
+
 void MetadataExchangeFilter::tryReadInitialProxyHeader(Buffer::Instance& data) {
   if (conn_state_ != ReadingInitialHeader && conn_state_ != NeedMoreDataInitialHeader) {
     return;
@@ -239,10 +320,17 @@ void MetadataExchangeFilter::tryReadInitialProxyHeader(Buffer::Instance& data) {
     setMetadataNotFoundFilterState();
     ENVOY_LOG(warn, "Incorrect istio-peer-exchange ALPN magic. Peer missing TCP "
                     "MetadataExchange filter.");
-    conn_state_ = Invalid;
+    stopReading(Invalid);
     return;
   }
   proxy_data_length_ = absl::gntohl(initial_header.data_size);
+  if (proxy_data_length_ > config_->max_frame_size_) {
+    config_->stats().metadata_too_large_.inc();
+    ENVOY_LOG(debug, "istio-peer-exchange metadata size {} exceeds the limit of {} bytes",
+              proxy_data_length_, config_->max_frame_size_);
+    abortExchange();
+    return;
+  }
   // Drain the initial header length bytes read.
   data.drain(initial_header_length);
   conn_state_ = ReadingProxyHeader;
@@ -252,6 +340,7 @@ void MetadataExchangeFilter::tryReadProxyData(Buffer::Instance& data) {
   if (conn_state_ != ReadingProxyHeader && conn_state_ != NeedMoreDataProxyHeader) {
     return;
   }
+  const auto self_time = config_->read_proxy_data_self_time_.sample();
   if (data.length() < proxy_data_length_) {
     // Not enough data to read. Wait for it to come.
     ENVOY_LOG(debug, "Alpn Protocol matched. Waiting to read more metadata.");
@@ -265,7 +354,7 @@ void MetadataExchangeFilter::tryReadProxyData(Buffer::Instance& data) {
     config_->stats().header_not_found_.inc();
     setMetadataNotFoundFilterState();
     ENVOY_LOG(warn, "Alpn protocol matched. Magic matched. Metadata Not found.");
-    conn_state_ = Invalid;
+    stopReading(Invalid);
     return;
   }
   data.drain(proxy_data_length_);
@@ -275,10 +364,8 @@ void MetadataExchangeFilter::tryReadProxyData(Buffer::Instance& data) {
       Envoy::MessageUtil::anyConvert<Envoy::ProtobufWkt::Struct>(proxy_data);
   auto key_metadata_it = value_struct.fields().find(ExchangeMetadataHeader);
   if (key_metadata_it != value_struct.fields().end()) {
-    const auto fb =
-        ::Wasm::Common::extractNodeFlatBufferFromStruct(key_metadata_it->second.struct_value());
-    std::string out(reinterpret_cast<const char*>(fb.data()), fb.size());
-    updatePeer(out);
+    updatePeer(::Wasm::Common::extractNodeFlatBufferStringFromStruct(
+        key_metadata_it->second.struct_value()));
   }
   const auto key_metadata_id_it = value_struct.fields().find(ExchangeMetadataHeaderId);
   if (key_metadata_id_it != value_struct.fields().end()) {
@@ -332,7 +419,7 @@ void MetadataExchangeFilter::setMetadataNotFoundFilterState() {
     ENVOY_LOG(debug, "Look up metadata based on peer address {}", peer_address->asString());
     const auto metadata_object = config_->metadata_provider_->GetMetadata(peer_address);
     if (metadata_object) {
-      updatePeer(Istio::Common::convertWorkloadMetadataToFlatNode(metadata_object.value()));
+      updatePeer(metadata_object->flatNode());
       updatePeerId(config_->filter_direction_ == FilterDirection::Downstream
                        ? kDownstreamMetadataIdKey
                        : kUpstreamMetadataIdKey,
@@ -344,6 +431,37 @@ void MetadataExchangeFilter::setMetadataNotFoundFilterState() {
   updatePeerId(kMetadataNotFoundValue, kMetadataNotFoundValue);
 }
 
+void MetadataExchangeFilter::stopReading(ConnState state) {
+  if (frame_read_timer_ != nullptr) {
+    frame_read_timer_->disableTimer();
+    frame_read_timer_.reset();
+  }
+  conn_state_ = state;
+}
+
+void MetadataExchangeFilter::abortExchange() {
+  setMetadataNotFoundFilterState();
+  stopReading(Aborted);
+  read_callbacks_->connection().close(Network::ConnectionCloseType::NoFlush);
+}
+
+void MetadataExchangeFilter::onFrameReadTimeout() {
+  switch (conn_state_) {
+  case WriteMetadata:
+  case ReadingInitialHeader:
+  case ReadingProxyHeader:
+  case NeedMoreDataInitialHeader:
+  case NeedMoreDataProxyHeader:
+    config_->stats().metadata_read_timeout_.inc();
+    ENVOY_LOG(debug, "Timed out reading istio-peer-exchange metadata after {}ms",
+              config_->frame_read_timeout_.count());
+    abortExchange();
+    break;
+  default:
+    break;
+  }
+}
+
 } // namespace MetadataExchange
 } // namespace Tcp
 } // namespace Envoy
@@ -15,17 +15,23 @@
 
 #pragma once
 
+#include <chrono>
 #include <string>
 
+#include "absl/container/flat_hash_set.h"
+#include "envoy/event/timer.h"
 #include "envoy/local_info/local_info.h"
 #include "envoy/network/filter.h"
 #include "envoy/runtime/runtime.h"
+#include "envoy/singleton/instance.h"
 #include "envoy/stats/scope.h"
 #include "envoy/stats/stats_macros.h"
 #include "envoy/stream_info/filter_state.h"
 #include "extensions/common/node_info_bfbs_generated.h"
 #include "extensions/common/proto_util.h"
 #include "extensions/common/metadata_object.h"
+#include "extensions/common/self_time.h"
+#include "source/common/buffer/buffer_impl.h"
 #include "source/common/common/stl_helpers.h"
 #include "source/common/protobuf/protobuf.h"
 #include "source/extensions/filters/common/expr/cel_state.h"
@@ -46,7 +52,9 @@ using ::Envoy::Extensions::Filters::Common::Expr::CelStatePrototype;
   COUNTER(alpn_protocol_found)                                                                     \
   COUNTER(initial_header_not_found)                                                                \
   COUNTER(header_not_found)                                                                        \
-  COUNTER(metadata_added)
+  COUNTER(metadata_added)                                                                          \
+  COUNTER(metadata_too_large)                                                                      \
+  COUNTER(metadata_read_timeout)
 
 /**
  * Struct definition for all MetadataExchange stats. @see stats_macros.h
@@ -61,6 +69,29 @@ struct MetadataExchangeStats {
  */
 enum class FilterDirection { Downstream, Upstream };
 
+class MetadataExchangeConfig;
+
+/**
+ * Filter configs of the server, reported by the peer metadata admin handler.
+ * Configs are added and removed on the main thread.
+ */
+class MetadataExchangeAdmin : public Singleton::Instance {
+public:
+  void add(const MetadataExchangeConfig& config) { configs_.insert(&config); }
+  void remove(const MetadataExchangeConfig& config) { configs_.erase(&config); }
+
+  // Settings and decoding counters of each filter config.
+  ProtobufWkt::ListValue adminState() const;
+
+private:
+  absl::flat_hash_set<const MetadataExchangeConfig*> configs_;
+};
+
+using MetadataExchangeAdminSharedPtr = std::shared_ptr<MetadataExchangeAdmin>;
+
+MetadataExchangeAdminSharedPtr
+getMetadataExchangeAdmin(Server::Configuration::ServerFactoryContext& factory_context);
+
 /**
  * Configuration for the MetadataExchange filter.
  */
@@ -68,8 +99,10 @@ class MetadataExchangeConfig {
 public:
   MetadataExchangeConfig(const std::string& stat_prefix, const std::string& protocol,
                          const FilterDirection filter_direction, bool enable_discovery,
+                         uint32_t max_frame_size, std::chrono::milliseconds frame_read_timeout,
                          Server::Configuration::ServerFactoryContext& factory_context,
                          Stats::Scope& scope);
+  ~MetadataExchangeConfig();
 
   const MetadataExchangeStats& stats() { return stats_; }
 
@@ -81,10 +114,18 @@ public:
   const std::string protocol_;
   // Direction of filter.
   const FilterDirection filter_direction_;
+  // Maximum size of the peer metadata frame.
+  const uint32_t max_frame_size_;
+  // Deadline for reading the peer metadata frame, disabled if zero.
+  const std::chrono::milliseconds frame_read_timeout_;
   // Set if WDS is enabled.
   Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr metadata_provider_;
   // Stats for MetadataExchange Filter.
   MetadataExchangeStats stats_;
+  // Sampled self-time of reading the peer metadata.
+  const Istio::Common::SelfTime read_proxy_data_self_time_;
+  // Reports the config in the peer metadata admin handler.
+  const MetadataExchangeAdminSharedPtr admin_;
 
   static const CelStatePrototype& nodeInfoPrototype() {
     static const CelStatePrototype* const prototype = new CelStatePrototype(
@@ -105,6 +146,7 @@ using MetadataExchangeConfigSharedPtr = std::shared_ptr<MetadataExchangeConfig>;
  * A MetadataExchange filter instance. One per connection.
  */
 class MetadataExchangeFilter : public Network::Filter,
+                               public Network::ConnectionCallbacks,
                                protected Logger::Loggable<Logger::Id::filter> {
 public:
   MetadataExchangeFilter(MetadataExchangeConfigSharedPtr config,
@@ -117,17 +159,44 @@ public:
   Network::FilterStatus onWrite(Buffer::Instance& data, bool end_stream) override;
   void initializeReadFilterCallbacks(Network::ReadFilterCallbacks& callbacks) override {
     read_callbacks_ = &callbacks;
-    // read_callbacks_->connection().addConnectionCallbacks(*this);
+    read_callbacks_->connection().addConnectionCallbacks(*this);
   }
   void initializeWriteFilterCallbacks(Network::WriteFilterCallbacks& callbacks) override {
     write_callbacks_ = &callbacks;
   }
 
+  // Network::ConnectionCallbacks
+  void onEvent(Network::ConnectionEvent event) override;
+  void onAboveWriteBufferHighWatermark() override {}
+  void onBelowWriteBufferLowWatermark() override {}
+
 private:
-  // Writes node metadata in write pipeline of the filter chain.
-  // Also, sets node metadata in Dynamic Metadata to be available for subsequent
-  // filters.
-  void writeNodeMetadata();
+  // Captures the state machine of what is going on in the filter.
+  enum ConnState {
+    ConnProtocolNotRead,       // Connection Protocol has not been read yet
+    WriteMetadata,             // Write node metadata
+    ReadingInitialHeader,      // MetadataExchangeInitialHeader is being read
+    ReadingProxyHeader,        // Proxy Header is being read
+    NeedMoreDataInitialHeader, // Need more data to be read
+    NeedMoreDataProxyHeader,   // Need more data to be read
+    Done,                      // Alpn Protocol Found and all the read is done
+    Invalid,                   // Invalid state, all operations fail
+    Aborted,                   // Exchange aborted and connection closed
+  };
+
+  // Checks the negotiated ALPN protocol and moves the connection state to
+  // either WriteMetadata or Invalid. Returns true if the protocol matched.
+  bool checkAlpnProtocol();
+
+  // Builds the node metadata frame, kept until it is written, and moves to
+  // reading the peer frame.
+  void buildNodeMetadata();
+
+  // Writes the built node metadata frame, if not written yet. If application
+  // data is provided, the frame is prepended to it so that the metadata goes
+  // out with the first application bytes in a single write. Otherwise it is
+  // injected in the write pipeline of the filter chain on its own.
+  void writeNodeMetadata(Buffer::Instance* application_data = nullptr);
 
   // Tries to read inital proxy header in the data bytes.
   void tryReadInitialProxyHeader(Buffer::Instance& data);
@@ -149,6 +218,16 @@ private:
   // Helper function to set filterstate when no client mxc found.
   void setMetadataNotFoundFilterState();
 
+  // Leaves the reading states for a final one. The frame read deadline no
+  // longer applies.
+  void stopReading(ConnState state);
+
+  // Gives up on the exchange and closes the connection.
+  void abortExchange();
+
+  // Invoked when the peer metadata frame is not read in time.
+  void onFrameReadTimeout();
+
   // Config for MetadataExchange filter.
   MetadataExchangeConfigSharedPtr config_;
   // LocalInfo instance.
@@ -159,6 +238,10 @@ private:
   Network::WriteFilterCallbacks* write_callbacks_{};
   // Stores the length of proxy data that contains node metadata.
   uint64_t proxy_data_length_{0};
+  // Deadline for reading the peer metadata frame.
+  Event::TimerPtr frame_read_timer_;
+  // Node metadata frame built but not written yet.
+  std::unique_ptr<Buffer::OwnedImpl> pending_frame_;
 
   const std::string ExchangeMetadataHeader = "x-envoy-peer-metadata";
   const std::string ExchangeMetadataHeaderId = "x-envoy-peer-metadata-id";
@@ -166,17 +249,8 @@ private:
   // Type url of google::protobug::struct.
   const std::string StructTypeUrl = "type.googleapis.com/google.protobuf.Struct";
 
-  // Captures the state machine of what is going on in the filter.
-  enum {
-    ConnProtocolNotRead,       // Connection Protocol has not been read yet
-    WriteMetadata,             // Write node metadata
-    ReadingInitialHeader,      // MetadataExchangeInitialHeader is being read
-    ReadingProxyHeader,        // Proxy Header is being read
-    NeedMoreDataInitialHeader, // Need more data to be read
-    NeedMoreDataProxyHeader,   // Need more data to be read
-    Done,                      // Alpn Protocol Found and all the read is done
-    Invalid,                   // Invalid state, all operations fail
-  } conn_state_;
+  // State of the connection.
+  ConnState conn_state_;
 };
 
 } // namespace MetadataExchange
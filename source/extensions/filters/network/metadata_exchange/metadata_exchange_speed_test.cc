@@ -0,0 +1,346 @@
+/* Copyright Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+
+#include "absl/strings/match.h"
+#include "benchmark/benchmark.h"
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/stats/isolated_store_impl.h"
+#include "source/common/stream_info/filter_state_impl.h"
+#include "source/extensions/filters/network/metadata_exchange/metadata_exchange.h"
+#include "source/extensions/filters/network/metadata_exchange/metadata_exchange_initial_header.h"
+#include "test/common/stats/stat_test_utility.h"
+#include "test/mocks/local_info/mocks.h"
+#include "test/mocks/network/mocks.h"
+#include "test/mocks/server/server_factory_context.h"
+#include "test/mocks/stream_info/mocks.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+using testing::ReturnRef;
+
+namespace Envoy {
+namespace Tcp {
+namespace MetadataExchange {
+namespace {
+
+constexpr absl::string_view Protocol = "mx-protocol";
+constexpr absl::string_view Request = "GET / HTTP/1.1\r\nhost: productpage\r\n\r\n";
+constexpr absl::string_view Response = "HTTP/1.1 200 OK\r\ncontent-length: 0\r\n\r\n";
+// One-way network delay of a flight, about half of an in-zone round trip.
+constexpr std::chrono::microseconds OneWayDelay(250);
+
+// One side of a simulated TCP metadata exchange connection. Every write that
+// reaches the wire is kept as a separate record, e.g. a TLS record.
+class Peer {
+public:
+  Peer(FilterDirection direction, const envoy::config::core::v3::Node& node) {
+    config_ = std::make_shared<MetadataExchangeConfig>(
+        "mx.", std::string(Protocol), direction, false, 64 * 1024, std::chrono::milliseconds(0),
+        context_, *store_.rootScope());
+    ON_CALL(local_info_, node()).WillByDefault(ReturnRef(node));
+    ON_CALL(read_callbacks_.connection_, nextProtocol())
+        .WillByDefault(Return(std::string(Protocol)));
+    // Filters are replaced on every connection, do not keep the callbacks.
+    ON_CALL(read_callbacks_.connection_, addConnectionCallbacks(_)).WillByDefault(Return());
+    ON_CALL(read_callbacks_.connection_, streamInfo()).WillByDefault(ReturnRef(stream_info_));
+    ON_CALL(write_callbacks_, injectWriteDataToFilterChain(_, _))
+        .WillByDefault(Invoke([this](Buffer::Instance& data, bool) {
+          records_.push_back(data.toString());
+          data.drain(data.length());
+        }));
+  }
+
+  void newConnection() {
+    filter_ = std::make_unique<MetadataExchangeFilter>(config_, local_info_);
+    filter_->initializeReadFilterCallbacks(read_callbacks_);
+    filter_->initializeWriteFilterCallbacks(write_callbacks_);
+    filter_->onNewConnection();
+  }
+
+  // Application write through the filter chain.
+  void write(absl::string_view bytes) {
+    Buffer::OwnedImpl data(bytes);
+    filter_->onWrite(data, false);
+    records_.push_back(data.toString());
+  }
+
+  // Delivers the records written by the peer one read at a time, accumulating
+  // them the same way the connection read buffer does. Returns the number of
+  // reads until application bytes are released to the next filter, or 0.
+  uint64_t readFrom(Peer& peer) {
+    Buffer::OwnedImpl buffer;
+    uint64_t reads = 0;
+    for (const auto& record : peer.records_) {
+      buffer.add(record);
+      reads++;
+      if (filter_->onData(buffer, false) == Network::FilterStatus::Continue &&
+          buffer.length() > 0) {
+        peer.records_.clear();
+        return reads;
+      }
+    }
+    peer.records_.clear();
+    return 0;
+  }
+
+  NiceMock<Server::Configuration::MockServerFactoryContext> context_;
+  Stats::IsolatedStoreImpl store_;
+  MetadataExchangeConfigSharedPtr config_;
+  NiceMock<LocalInfo::MockLocalInfo> local_info_;
+  NiceMock<Network::MockReadFilterCallbacks> read_callbacks_;
+  NiceMock<Network::MockWriteFilterCallbacks> write_callbacks_;
+  NiceMock<StreamInfo::MockStreamInfo> stream_info_;
+  std::unique_ptr<MetadataExchangeFilter> filter_;
+  std::vector<std::string> records_;
+};
+
+envoy::config::core::v3::Node makeNode(absl::string_view name) {
+  envoy::config::core::v3::Node node;
+  node.set_id(absl::StrCat("sidecar~10.0.0.1~", name, ".default~default.svc.cluster.local"));
+  auto& fields = *node.mutable_metadata()->mutable_fields();
+  fields["NAME"].set_string_value(std::string(name));
+  fields["NAMESPACE"].set_string_value("default");
+  fields["CLUSTER_ID"].set_string_value("Kubernetes");
+  fields["WORKLOAD_NAME"].set_string_value(std::string(name));
+  fields["OWNER"].set_string_value(
+      absl::StrCat("kubernetes://apis/apps/v1/namespaces/default/deployments/", name));
+  auto& labels = *fields["LABELS"].mutable_struct_value()->mutable_fields();
+  labels["app"].set_string_value(std::string(name));
+  labels["version"].set_string_value("v1");
+  labels["service.istio.io/canonical-name"].set_string_value(std::string(name));
+  labels["service.istio.io/canonical-revision"].set_string_value("v1");
+  return node;
+}
+
+// Measures a client-first request/response exchange between an upstream
+// (client) and a downstream (server) filter. The number of records each side
+// reads before the first application byte is released is the number of
+// flights it waits for when the records are sent separately. The reported
+// time is the time to the first response byte: the processing time of the
+// filters plus OneWayDelay for each of these flights.
+//
+// Arg 0: 1 to raise the connected event on both sides, as after a TLS
+// handshake, 0 to write the metadata lazily from the first read or write.
+static void BM_MetadataExchangeTimeToFirstByte(benchmark::State& state) {
+  const bool connected_event = state.range(0) == 1;
+  const auto client_node = makeNode("productpage-v1");
+  const auto server_node = makeNode("ratings-v1");
+  Peer client(FilterDirection::Upstream, client_node);
+  Peer server(FilterDirection::Downstream, server_node);
+
+  uint64_t server_reads = 0;
+  uint64_t client_reads = 0;
+  for (auto _ : state) {
+    const auto start = std::chrono::steady_clock::now();
+    client.newConnection();
+    server.newConnection();
+    if (connected_event) {
+      client.filter_->onEvent(Network::ConnectionEvent::Connected);
+      server.filter_->onEvent(Network::ConnectionEvent::Connected);
+    }
+    client.write(Request);
+    const uint64_t request_reads = server.readFrom(client);
+    server.write(Response);
+    const uint64_t response_reads = client.readFrom(server);
+    if (request_reads == 0 || response_reads == 0) {
+      state.SkipWithError("application bytes were not released");
+      return;
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start + (request_reads + response_reads) * OneWayDelay;
+    state.SetIterationTime(elapsed.count());
+    server_reads += request_reads;
+    client_reads += response_reads;
+  }
+  state.counters["server_reads_to_first_byte"] =
+      benchmark::Counter(server_reads, benchmark::Counter::kAvgIterations);
+  state.counters["client_reads_to_first_byte"] =
+      benchmark::Counter(client_reads, benchmark::Counter::kAvgIterations);
+  state.counters["connections_per_second"] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_MetadataExchangeTimeToFirstByte)
+    ->Arg(0)
+    ->Arg(1)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+// Workload discovery with a single workload behind every address.
+class FakeWorkloadMetadataProvider
+    : public Extensions::Common::WorkloadDiscovery::WorkloadMetadataProvider,
+      public Singleton::Instance {
+public:
+  Extensions::Common::WorkloadDiscovery::WorkloadMetadataObjectConstSharedPtr
+  GetMetadata(const Network::Address::InstanceConstSharedPtr&) override {
+    return workload_;
+  }
+
+private:
+  const Extensions::Common::WorkloadDiscovery::WorkloadMetadataObjectConstSharedPtr workload_{
+      std::make_shared<const Istio::Common::WorkloadMetadataObject>(
+          "productpage-v1-84975bc778-pxz2w", "Kubernetes", "default", "productpage-v1",
+          "productpage", "v1", "productpage", "v1", Istio::Common::WorkloadType::Deployment,
+          "spiffe://cluster.local/ns/default/sa/productpage")};
+};
+
+class FakeSingletonManager : public Singleton::Manager {
+public:
+  Singleton::InstanceSharedPtr get(const std::string& name, Singleton::SingletonFactoryCb,
+                                   bool) override {
+    if (absl::StrContains(name, "workload_metadata_provider")) {
+      return provider_;
+    }
+    return nullptr;
+  }
+
+private:
+  Singleton::InstanceSharedPtr provider_{std::make_shared<FakeWorkloadMetadataProvider>()};
+};
+
+// Server side of a downstream connection.
+struct Connection {
+  explicit Connection(absl::string_view protocol) {
+    ON_CALL(read_callbacks_.connection_, nextProtocol())
+        .WillByDefault(Return(std::string(protocol)));
+    ON_CALL(read_callbacks_.connection_, addConnectionCallbacks(_)).WillByDefault(Return());
+    ON_CALL(read_callbacks_.connection_, streamInfo()).WillByDefault(ReturnRef(stream_info_));
+    ON_CALL(write_callbacks_, injectWriteDataToFilterChain(_, _))
+        .WillByDefault(
+            Invoke([](Buffer::Instance& data, bool) { data.drain(data.length()); }));
+  }
+
+  NiceMock<Network::MockReadFilterCallbacks> read_callbacks_;
+  NiceMock<Network::MockWriteFilterCallbacks> write_callbacks_;
+  NiceMock<StreamInfo::MockStreamInfo> stream_info_;
+  std::unique_ptr<MetadataExchangeFilter> filter_;
+};
+
+// Splits the bytes written by the client into the reads and slices that the
+// server receives.
+std::vector<std::vector<std::string>> fragment(absl::string_view wire, int64_t mode) {
+  constexpr size_t header_size = sizeof(MetadataExchangeInitialHeader);
+  constexpr size_t slice_size = 64;
+  switch (mode) {
+  case 1:
+    // Initial header split across two reads.
+    return {{std::string(wire.substr(0, header_size / 2))},
+            {std::string(wire.substr(header_size / 2))}};
+  case 2: {
+    // Payload split across two reads, the second one made of small slices.
+    const size_t split = header_size + (wire.size() - header_size - Request.size()) / 2;
+    std::vector<std::vector<std::string>> reads{{std::string(wire.substr(0, split))}, {}};
+    for (size_t offset = split; offset < wire.size(); offset += slice_size) {
+      reads[1].emplace_back(wire.substr(offset, slice_size));
+    }
+    return reads;
+  }
+  case 3:
+    // Peer without metadata exchange.
+    return {{std::string(Request)}};
+  default:
+    return {{std::string(wire)}};
+  }
+}
+
+// Measures the server side of the connection setup: onNewConnection, the
+// metadata frame delivered in fragmented reads and the first response write.
+// kConnections connections are kept open at once so that the bytes each of
+// them retains can be measured (requires tcmalloc, 0 otherwise).
+//
+// Arg 0: 0 for a single read, 1 for the initial header split across reads, 2
+// for the payload split across reads and slices, 3 for a peer that does not
+// negotiate the metadata exchange protocol.
+// Arg 1: 1 to enable workload discovery, 0 otherwise.
+static void BM_MetadataExchangeHandshake(benchmark::State& state) {
+  constexpr size_t kConnections = 128;
+  const int64_t mode = state.range(0);
+  const bool enable_discovery = state.range(1) == 1;
+
+  const auto client_node = makeNode("productpage-v1");
+  Peer client(FilterDirection::Upstream, client_node);
+  client.newConnection();
+  client.write(Request);
+  const auto reads = fragment(client.records_.front(), mode);
+  // Fragments do not own their bytes and are reused by every connection.
+  std::vector<std::vector<std::unique_ptr<Buffer::BufferFragmentImpl>>> fragments;
+  for (const auto& read : reads) {
+    auto& slices = fragments.emplace_back();
+    for (const auto& slice : read) {
+      slices.push_back(
+          std::make_unique<Buffer::BufferFragmentImpl>(slice.data(), slice.size(), nullptr));
+    }
+  }
+
+  const auto server_node = makeNode("ratings-v1");
+  NiceMock<Server::Configuration::MockServerFactoryContext> context;
+  FakeSingletonManager singleton_manager;
+  ON_CALL(context, singletonManager()).WillByDefault(ReturnRef(singleton_manager));
+  Stats::IsolatedStoreImpl store;
+  auto config = std::make_shared<MetadataExchangeConfig>(
+      "mx.", std::string(Protocol), FilterDirection::Downstream, enable_discovery, 64 * 1024,
+      std::chrono::milliseconds(0), context, *store.rootScope());
+  NiceMock<LocalInfo::MockLocalInfo> local_info;
+  ON_CALL(local_info, node()).WillByDefault(ReturnRef(server_node));
+
+  std::vector<std::unique_ptr<Connection>> connections;
+  for (size_t i = 0; i < kConnections; i++) {
+    connections.push_back(std::make_unique<Connection>(mode == 3 ? "" : Protocol));
+  }
+
+  uint64_t bytes = 0;
+  for (auto _ : state) {
+    Stats::TestUtil::MemoryTest memory_test;
+    for (auto& connection : connections) {
+      connection->filter_ = std::make_unique<MetadataExchangeFilter>(config, local_info);
+      auto& filter = *connection->filter_;
+      filter.initializeReadFilterCallbacks(connection->read_callbacks_);
+      filter.initializeWriteFilterCallbacks(connection->write_callbacks_);
+      filter.onNewConnection();
+      Buffer::OwnedImpl buffer;
+      for (const auto& slices : fragments) {
+        for (const auto& slice : slices) {
+          buffer.addBufferFragment(*slice);
+        }
+        filter.onData(buffer, false);
+      }
+      if (buffer.toString() != Request) {
+        state.SkipWithError("application bytes were not released");
+        return;
+      }
+      Buffer::OwnedImpl response(Response);
+      filter.onWrite(response, false);
+    }
+    bytes += memory_test.consumedBytes();
+    for (auto& connection : connections) {
+      connection->filter_.reset();
+      connection->stream_info_.filter_state_ = std::make_shared<StreamInfo::FilterStateImpl>(
+          StreamInfo::FilterState::LifeSpan::Connection);
+    }
+  }
+  state.counters["connections_per_second"] =
+      benchmark::Counter(state.iterations() * kConnections, benchmark::Counter::kIsRate);
+  state.counters["bytes_per_connection"] =
+      benchmark::Counter(bytes / kConnections, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_MetadataExchangeHandshake)->ArgsProduct({{0, 1, 2, 3}, {0, 1}});
+
+} // namespace
+} // namespace MetadataExchange
+} // namespace Tcp
+} // namespace Envoy
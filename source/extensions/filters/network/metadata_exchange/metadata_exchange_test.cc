@@ -15,18 +15,21 @@
 
 #include "source/extensions/filters/network/metadata_exchange/metadata_exchange.h"
 
+#include "absl/strings/match.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/util/message_differencer.h"
 #include "gtest/gtest.h"
 #include "source/common/buffer/buffer_impl.h"
 #include "source/common/protobuf/protobuf.h"
 #include "source/extensions/filters/network/metadata_exchange/metadata_exchange_initial_header.h"
+#include "test/mocks/event/mocks.h"
 #include "test/mocks/local_info/mocks.h"
 #include "test/mocks/network/mocks.h"
 #include "test/mocks/protobuf/mocks.h"
 #include "test/mocks/server/server_factory_context.h"
 
 using ::google::protobuf::util::MessageDifferencer;
+using testing::_;
 using testing::NiceMock;
 using testing::Return;
 using testing::ReturnRef;
@@ -56,9 +59,11 @@ class MetadataExchangeFilterTest : public testing::Test {
 public:
   MetadataExchangeFilterTest() { ENVOY_LOG_MISC(info, "test"); }
 
-  void initialize() {
+  void initialize(uint32_t max_frame_size = 64 * 1024,
+                  std::chrono::milliseconds frame_read_timeout = std::chrono::milliseconds(0)) {
     config_ = std::make_shared<MetadataExchangeConfig>(
-        stat_prefix_, "istio2", FilterDirection::Downstream, false, context_, *scope_.rootScope());
+        stat_prefix_, "istio2", FilterDirection::Downstream, false, max_frame_size,
+        frame_read_timeout, context_, *scope_.rootScope());
     filter_ = std::make_unique<MetadataExchangeFilter>(config_, local_info_);
     filter_->initializeReadFilterCallbacks(read_filter_callbacks_);
     filter_->initializeWriteFilterCallbacks(write_filter_callbacks_);
@@ -127,6 +132,168 @@ TEST_F(MetadataExchangeFilterTest, MetadataExchangeNotFound) {
   EXPECT_EQ(1UL, config_->stats().alpn_protocol_not_found_.value());
 }
 
+TEST_F(MetadataExchangeFilterTest, MetadataExchangeAdminState) {
+  initialize();
+
+  EXPECT_CALL(read_filter_callbacks_.connection_, nextProtocol()).WillRepeatedly(Return("istio"));
+
+  ::Envoy::Buffer::OwnedImpl data{};
+  EXPECT_EQ(Envoy::Network::FilterStatus::Continue, filter_->onData(data, false));
+  const auto state = getMetadataExchangeAdmin(context_)->adminState();
+  ASSERT_EQ(1, state.values_size());
+  const auto& fields = state.values(0).struct_value().fields();
+  EXPECT_EQ("istio2", fields.at("protocol").string_value());
+  EXPECT_EQ("downstream", fields.at("direction").string_value());
+  EXPECT_FALSE(fields.at("discovery").bool_value());
+  EXPECT_EQ(64 * 1024, fields.at("max_frame_size").number_value());
+  const auto& counters = fields.at("counters").struct_value().fields();
+  EXPECT_EQ(1, counters.at("alpn_protocol_not_found").number_value());
+  EXPECT_EQ(0, counters.at("metadata_added").number_value());
+
+  filter_.reset();
+  config_.reset();
+  EXPECT_EQ(0, getMetadataExchangeAdmin(context_)->adminState().values_size());
+}
+
+TEST_F(MetadataExchangeFilterTest, MetadataExchangeWrittenOnConnected) {
+  initialize();
+
+  EXPECT_CALL(read_filter_callbacks_.connection_, nextProtocol()).WillRepeatedly(Return("istio2"));
+  EXPECT_CALL(write_filter_callbacks_, injectWriteDataToFilterChain(_, _)).Times(0);
+  filter_->onEvent(Network::ConnectionEvent::Connected);
+  EXPECT_EQ(1UL, config_->stats().alpn_protocol_found_.value());
+  EXPECT_EQ(0UL, config_->stats().metadata_added_.value());
+
+  // The frame built on the connected event goes out with the first
+  // application bytes, and only with them.
+  ::Envoy::Buffer::OwnedImpl data{"hello"};
+  EXPECT_EQ(Envoy::Network::FilterStatus::Continue, filter_->onWrite(data, false));
+  EXPECT_GT(data.length(), sizeof(MetadataExchangeInitialHeader) + 5);
+  EXPECT_TRUE(absl::EndsWith(data.toString(), "hello"));
+  EXPECT_EQ(1UL, config_->stats().metadata_added_.value());
+
+  ::Envoy::Buffer::OwnedImpl more{"world"};
+  EXPECT_EQ(Envoy::Network::FilterStatus::Continue, filter_->onWrite(more, false));
+  EXPECT_EQ(more.toString(), "world");
+  EXPECT_EQ(1UL, config_->stats().metadata_added_.value());
+}
+
+TEST_F(MetadataExchangeFilterTest, MetadataExchangeInjectedOnPeerFrame) {
+  initialize();
+  initializeStructValues();
+
+  EXPECT_CALL(read_filter_callbacks_.connection_, nextProtocol()).WillRepeatedly(Return("istio2"));
+  filter_->onEvent(Network::ConnectionEvent::Connected);
+
+  // Nothing was written when the peer frame arrives, the frame goes out on
+  // its own.
+  EXPECT_CALL(write_filter_callbacks_, injectWriteDataToFilterChain(_, false));
+  ::Envoy::Buffer::OwnedImpl data;
+  MetadataExchangeInitialHeader initial_header;
+  Envoy::ProtobufWkt::Any productpage_any_value;
+  productpage_any_value.set_type_url("type.googleapis.com/google.protobuf.Struct");
+  *productpage_any_value.mutable_value() = productpage_value_.SerializeAsString();
+  ConstructProxyHeaderData(data, productpage_any_value, &initial_header);
+  data.add("world");
+  EXPECT_EQ(Envoy::Network::FilterStatus::Continue, filter_->onData(data, false));
+  EXPECT_EQ(data.toString(), "world");
+  EXPECT_EQ(1UL, config_->stats().metadata_added_.value());
+
+  ::Envoy::Buffer::OwnedImpl response{"hello"};
+  EXPECT_EQ(Envoy::Network::FilterStatus::Continue, filter_->onWrite(response, false));
+  EXPECT_EQ(response.toString(), "hello");
+  EXPECT_EQ(1UL, config_->stats().metadata_added_.value());
+}
+
+TEST_F(MetadataExchangeFilterTest, MetadataExchangeCoalescedWithFirstWrite) {
+  initialize();
+
+  EXPECT_CALL(read_filter_callbacks_.connection_, nextProtocol()).WillRepeatedly(Return("istio2"));
+  EXPECT_CALL(write_filter_callbacks_, injectWriteDataToFilterChain(_, _)).Times(0);
+
+  ::Envoy::Buffer::OwnedImpl data{"hello"};
+  EXPECT_EQ(Envoy::Network::FilterStatus::Continue, filter_->onWrite(data, false));
+
+  MetadataExchangeInitialHeader initial_header;
+  ASSERT_GT(data.length(), sizeof(MetadataExchangeInitialHeader));
+  data.copyOut(0, sizeof(MetadataExchangeInitialHeader), &initial_header);
+  EXPECT_EQ(MetadataExchangeInitialHeader::magic_number, absl::gntohl(initial_header.magic));
+  EXPECT_EQ(data.length(),
+            sizeof(MetadataExchangeInitialHeader) + absl::gntohl(initial_header.data_size) + 5);
+  EXPECT_TRUE(absl::EndsWith(data.toString(), "hello"));
+  EXPECT_EQ(1UL, config_->stats().metadata_added_.value());
+}
+
+TEST_F(MetadataExchangeFilterTest, MetadataExchangeNotFoundOnConnected) {
+  initialize();
+
+  EXPECT_CALL(read_filter_callbacks_.connection_, nextProtocol()).WillRepeatedly(Return("istio"));
+  EXPECT_CALL(write_filter_callbacks_, injectWriteDataToFilterChain(_, _)).Times(0);
+  filter_->onEvent(Network::ConnectionEvent::Connected);
+  EXPECT_EQ(1UL, config_->stats().alpn_protocol_not_found_.value());
+
+  ::Envoy::Buffer::OwnedImpl data{"hello"};
+  EXPECT_EQ(Envoy::Network::FilterStatus::Continue, filter_->onData(data, false));
+  EXPECT_EQ(data.toString(), "hello");
+  EXPECT_EQ(1UL, config_->stats().alpn_protocol_not_found_.value());
+}
+
+TEST_F(MetadataExchangeFilterTest, MetadataExchangeFrameTooLarge) {
+  initialize(16);
+  initializeStructValues();
+
+  EXPECT_CALL(read_filter_callbacks_.connection_, nextProtocol()).WillRepeatedly(Return("istio2"));
+  EXPECT_CALL(read_filter_callbacks_.connection_, close(Network::ConnectionCloseType::NoFlush));
+
+  ::Envoy::Buffer::OwnedImpl data;
+  MetadataExchangeInitialHeader initial_header;
+  Envoy::ProtobufWkt::Any productpage_any_value;
+  productpage_any_value.set_type_url("type.googleapis.com/google.protobuf.Struct");
+  *productpage_any_value.mutable_value() = productpage_value_.SerializeAsString();
+  ConstructProxyHeaderData(data, productpage_any_value, &initial_header);
+  data.add("world");
+
+  EXPECT_EQ(Envoy::Network::FilterStatus::StopIteration, filter_->onData(data, false));
+  EXPECT_EQ(0UL, data.length());
+  EXPECT_EQ(1UL, config_->stats().metadata_too_large_.value());
+
+  // Bytes arriving before the connection is closed are dropped.
+  ::Envoy::Buffer::OwnedImpl more{"more"};
+  EXPECT_EQ(Envoy::Network::FilterStatus::StopIteration, filter_->onData(more, false));
+  EXPECT_EQ(0UL, more.length());
+}
+
+TEST_F(MetadataExchangeFilterTest, MetadataExchangeFrameReadTimeout) {
+  auto* timer = new NiceMock<Event::MockTimer>(&read_filter_callbacks_.connection_.dispatcher_);
+  EXPECT_CALL(*timer, enableTimer(std::chrono::milliseconds(100), _));
+  initialize(64 * 1024, std::chrono::milliseconds(100));
+
+  EXPECT_CALL(read_filter_callbacks_.connection_, nextProtocol()).WillRepeatedly(Return("istio2"));
+  EXPECT_CALL(read_filter_callbacks_.connection_, close(Network::ConnectionCloseType::NoFlush));
+
+  // Only part of the initial header arrives before the deadline.
+  ::Envoy::Buffer::OwnedImpl data{"ab"};
+  EXPECT_EQ(Envoy::Network::FilterStatus::StopIteration, filter_->onData(data, false));
+  timer->invokeCallback();
+  EXPECT_EQ(1UL, config_->stats().metadata_read_timeout_.value());
+}
+
+TEST_F(MetadataExchangeFilterTest, MetadataExchangeInvalidFrameStopsReadTimer) {
+  auto* timer = new NiceMock<Event::MockTimer>(&read_filter_callbacks_.connection_.dispatcher_);
+  EXPECT_CALL(*timer, enableTimer(std::chrono::milliseconds(100), _));
+  initialize(64 * 1024, std::chrono::milliseconds(100));
+
+  EXPECT_CALL(read_filter_callbacks_.connection_, nextProtocol()).WillRepeatedly(Return("istio2"));
+  EXPECT_CALL(read_filter_callbacks_.connection_, close(_)).Times(0);
+  EXPECT_CALL(*timer, disableTimer());
+
+  // The peer does not speak the exchange, the connection goes on without it.
+  ::Envoy::Buffer::OwnedImpl data{"GET / HTTP/1.1\r\n\r\n"};
+  EXPECT_EQ(Envoy::Network::FilterStatus::Continue, filter_->onData(data, false));
+  EXPECT_EQ(1UL, config_->stats().initial_header_not_found_.value());
+  EXPECT_EQ(0UL, config_->stats().metadata_read_timeout_.value());
+}
+
 } // namespace MetadataExchange
 } // namespace Tcp
 } // namespace Envoy
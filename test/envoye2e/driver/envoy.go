@@ -15,6 +15,7 @@
 package driver
 
 import (
+	"bytes"
 	"encoding/json"
 	"errors"
 	"fmt"
@@ -25,6 +26,7 @@ import (
 	"os/exec"
 	"path/filepath"
 	"regexp"
+	"strconv"
 	"strings"
 	"time"
 
@@ -175,6 +177,35 @@ func (e *Envoy) Cleanup() {
 	}
 }
 
+// ClockTicks is the unit of the CPU times in /proc, USER_HZ on Linux.
+const ClockTicks = 100
+
+// CPUTime returns the user and system CPU time consumed by the Envoy process.
+func (e *Envoy) CPUTime() (time.Duration, error) {
+	if e.cmd == nil || e.cmd.Process == nil {
+		return 0, errors.New("envoy is not running")
+	}
+	stat, err := os.ReadFile(fmt.Sprintf("/proc/%d/stat", e.cmd.Process.Pid))
+	if err != nil {
+		return 0, err
+	}
+	// The command name may contain spaces, the fields follow its closing parenthesis.
+	fields := strings.Fields(string(stat[bytes.LastIndexByte(stat, ')')+1:]))
+	if len(fields) < 13 {
+		return 0, fmt.Errorf("unexpected process stat %q", stat)
+	}
+	var ticks int64
+	// utime and stime, fields 14 and 15 of the stat line.
+	for _, field := range fields[11:13] {
+		value, err := strconv.ParseInt(field, 10, 64)
+		if err != nil {
+			return 0, err
+		}
+		ticks += value
+	}
+	return time.Duration(ticks) * time.Second / ClockTicks, nil
+}
+
 func getAdminPortAndNode(bootstrap string) (port uint32, node string, err error) {
 	pb := &bootstrapv3.Bootstrap{}
 	if err = ReadYAML(bootstrap, pb); err != nil {
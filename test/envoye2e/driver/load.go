@@ -0,0 +1,362 @@
+// Copyright Istio Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package driver
+
+import (
+	"bufio"
+	"context"
+	"fmt"
+	"io"
+	"log"
+	"net"
+	"net/http"
+	"sort"
+	"sync"
+	"time"
+
+	"google.golang.org/grpc"
+	"google.golang.org/grpc/codes"
+	"google.golang.org/grpc/credentials/insecure"
+	"google.golang.org/grpc/status"
+
+	"istio.io/proxy/test/envoye2e/env/grpc_echo"
+)
+
+// LoadProtocol is the kind of traffic sent by the Load step.
+type LoadProtocol int
+
+const (
+	// LoadHTTP sends HTTP/1.1 GET requests.
+	LoadHTTP LoadProtocol = iota
+	// LoadGRPC sends unary gRPC echo calls, requires the GrpcServer backend.
+	LoadGRPC
+	// LoadTCP sends lines over long-lived connections, requires the TCPServer
+	// backend, preferably quiet.
+	LoadTCP
+)
+
+func (l LoadProtocol) String() string {
+	switch l {
+	case LoadGRPC:
+		return "grpc"
+	case LoadTCP:
+		return "tcp"
+	default:
+		return "http"
+	}
+}
+
+// Load sends requests through the client proxy for a fixed duration and
+// reports the achieved throughput, the latency percentiles and the CPU time
+// of the proxies per request.
+type Load struct {
+	Protocol LoadProtocol
+	// Duration of the load.
+	Duration time.Duration
+	// RPS is the target request rate over all connections, with latencies
+	// measured from the scheduled send times. Requests are sent back to back
+	// if zero.
+	RPS int
+	// Concurrency is the number of connections, each with one request in flight.
+	// Defaults to 1.
+	Concurrency int
+	// Envoys are the proxies whose CPU time is reported.
+	Envoys []*Envoy
+	// Report receives the results if set.
+	Report *LoadReport
+}
+
+// LoadReport summarizes a Load run.
+type LoadReport struct {
+	Protocol  LoadProtocol
+	Requests  int
+	Errors    int
+	Elapsed   time.Duration
+	RPS       float64
+	Latencies map[int]time.Duration
+	// CPUPerRequest is the CPU time of each proxy, in the order of
+	// Load.Envoys, divided by the number of requests.
+	CPUPerRequest []time.Duration
+}
+
+// LoadPercentiles are the latency percentiles reported by the Load step.
+var LoadPercentiles = []int{50, 90, 99, 100}
+
+const (
+	// LoadCallTimeout bounds each request of the Load step.
+	LoadCallTimeout = 10 * time.Second
+	// LoadErrorBackoff is the initial delay after a failed request sent back
+	// to back, doubled up to LoadMaxErrorBackoff while the requests fail.
+	LoadErrorBackoff    = 10 * time.Millisecond
+	LoadMaxErrorBackoff = time.Second
+)
+
+func (r *LoadReport) String() string {
+	out := fmt.Sprintf("%s: %d requests, %d errors in %v, %.1f rps", r.Protocol, r.Requests,
+		r.Errors, r.Elapsed.Round(time.Millisecond), r.RPS)
+	for _, p := range LoadPercentiles {
+		out += fmt.Sprintf(", p%d %v", p, r.Latencies[p])
+	}
+	for i, cpu := range r.CPUPerRequest {
+		out += fmt.Sprintf(", proxy %d cpu/request %v", i, cpu)
+	}
+	return out
+}
+
+var _ Step = &Load{}
+
+// loadClient sends one request of a connection.
+type loadClient interface {
+	call() error
+	close()
+}
+
+func (l *Load) Run(p *Params) error {
+	concurrency := l.Concurrency
+	if concurrency < 1 {
+		concurrency = 1
+	}
+	clients := make([]loadClient, 0, concurrency)
+	defer func() {
+		for _, c := range clients {
+			c.close()
+		}
+	}()
+	for i := 0; i < concurrency; i++ {
+		c, err := l.newClient(p)
+		if err != nil {
+			return err
+		}
+		clients = append(clients, c)
+	}
+	cpuBefore, err := l.cpuTimes()
+	if err != nil {
+		return err
+	}
+
+	var interval time.Duration
+	if l.RPS > 0 {
+		interval = time.Duration(concurrency) * time.Second / time.Duration(l.RPS)
+	}
+	var (
+		mu        sync.Mutex
+		latencies []time.Duration
+		errors    int
+		wg        sync.WaitGroup
+	)
+	start := time.Now()
+	deadline := start.Add(l.Duration)
+	for _, c := range clients {
+		wg.Add(1)
+		go func(c loadClient) {
+			defer wg.Done()
+			var own []time.Duration
+			failed := 0
+			backoff := LoadErrorBackoff
+			next := time.Now()
+			for next.Before(deadline) {
+				// At a target rate, the latency is measured from the scheduled
+				// time, so that a slow request delaying the next ones counts.
+				begin := next
+				if interval > 0 {
+					time.Sleep(time.Until(next))
+					next = next.Add(interval)
+				} else {
+					begin = time.Now()
+				}
+				if err := c.call(); err != nil {
+					failed++
+					// Requests sent back to back back off while they fail.
+					if interval == 0 {
+						time.Sleep(backoff)
+						if backoff *= 2; backoff > LoadMaxErrorBackoff {
+							backoff = LoadMaxErrorBackoff
+						}
+					}
+				} else {
+					backoff = LoadErrorBackoff
+					own = append(own, time.Since(begin))
+				}
+				if interval == 0 {
+					next = time.Now()
+				}
+			}
+			mu.Lock()
+			latencies = append(latencies, own...)
+			errors += failed
+			mu.Unlock()
+		}(c)
+	}
+	wg.Wait()
+	elapsed := time.Since(start)
+
+	cpuAfter, err := l.cpuTimes()
+	if err != nil {
+		return err
+	}
+	report := &LoadReport{
+		Protocol:  l.Protocol,
+		Requests:  len(latencies),
+		Errors:    errors,
+		Elapsed:   elapsed,
+		RPS:       float64(len(latencies)) / elapsed.Seconds(),
+		Latencies: make(map[int]time.Duration),
+	}
+	sort.Slice(latencies, func(i, j int) bool { return latencies[i] < latencies[j] })
+	for _, p := range LoadPercentiles {
+		if len(latencies) > 0 {
+			report.Latencies[p] = latencies[(len(latencies)-1)*p/100]
+		}
+	}
+	for i := range cpuAfter {
+		if report.Requests > 0 {
+			report.CPUPerRequest = append(report.CPUPerRequest,
+				(cpuAfter[i]-cpuBefore[i])/time.Duration(report.Requests))
+		}
+	}
+	log.Printf("load: %v", report)
+	if l.Report != nil {
+		*l.Report = *report
+	}
+	if report.Requests == 0 {
+		return fmt.Errorf("no successful %s requests, %d errors", l.Protocol, errors)
+	}
+	return nil
+}
+
+func (l *Load) Cleanup() {}
+
+func (l *Load) cpuTimes() ([]time.Duration, error) {
+	out := make([]time.Duration, 0, len(l.Envoys))
+	for _, e := range l.Envoys {
+		cpu, err := e.CPUTime()
+		if err != nil {
+			return nil, err
+		}
+		out = append(out, cpu)
+	}
+	return out, nil
+}
+
+func (l *Load) newClient(p *Params) (loadClient, error) {
+	address := fmt.Sprintf("127.0.0.1:%d", p.Ports.ClientPort)
+	switch l.Protocol {
+	case LoadGRPC:
+		conn, err := grpc.Dial(address, grpc.WithTransportCredentials(insecure.NewCredentials()), grpc.WithBlock())
+		if err != nil {
+			return nil, fmt.Errorf("could not establish client connection to gRPC server: %v", err)
+		}
+		return &grpcLoadClient{conn: conn, client: grpc_echo.NewEchoClient(conn)}, nil
+	case LoadTCP:
+		c := &tcpLoadClient{address: address}
+		if err := c.connect(); err != nil {
+			return nil, err
+		}
+		return c, nil
+	default:
+		// Each client keeps its own connection.
+		return &httpLoadClient{
+			url: "http://" + address,
+			client: &http.Client{
+				Transport: &http.Transport{MaxIdleConnsPerHost: 1},
+				Timeout:   LoadCallTimeout,
+			},
+		}, nil
+	}
+}
+
+type httpLoadClient struct {
+	url    string
+	client *http.Client
+}
+
+func (c *httpLoadClient) call() error {
+	resp, err := c.client.Get(c.url)
+	if err != nil {
+		return err
+	}
+	defer resp.Body.Close()
+	if _, err := io.Copy(io.Discard, resp.Body); err != nil {
+		return err
+	}
+	if resp.StatusCode != http.StatusOK {
+		return fmt.Errorf("unexpected status %d", resp.StatusCode)
+	}
+	return nil
+}
+
+func (c *httpLoadClient) close() {
+	c.client.CloseIdleConnections()
+}
+
+type grpcLoadClient struct {
+	conn   *grpc.ClientConn
+	client grpc_echo.EchoClient
+}
+
+func (c *grpcLoadClient) call() error {
+	ctx, cancel := context.WithTimeout(context.Background(), LoadCallTimeout)
+	defer cancel()
+	_, err := c.client.Echo(ctx, &grpc_echo.EchoRequest{ReturnStatus: status.New(codes.OK, "").Proto()})
+	return err
+}
+
+func (c *grpcLoadClient) close() {
+	c.conn.Close()
+}
+
+// tcpLoadClient reconnects after an error, the connection is left in an
+// unknown state.
+type tcpLoadClient struct {
+	address string
+	conn    net.Conn
+	reader  *bufio.Reader
+}
+
+func (c *tcpLoadClient) connect() error {
+	conn, err := net.Dial("tcp", c.address)
+	if err != nil {
+		return fmt.Errorf("failed to connect to tcp server: %v", err)
+	}
+	c.conn = conn
+	c.reader = bufio.NewReader(conn)
+	return nil
+}
+
+func (c *tcpLoadClient) call() error {
+	if c.conn == nil {
+		if err := c.connect(); err != nil {
+			return err
+		}
+	}
+	err := c.conn.SetDeadline(time.Now().Add(LoadCallTimeout))
+	if err == nil {
+		_, err = fmt.Fprintf(c.conn, "load\n")
+	}
+	if err == nil {
+		_, err = c.reader.ReadString('\n')
+	}
+	if err != nil {
+		c.close()
+	}
+	return err
+}
+
+func (c *tcpLoadClient) close() {
+	if c.conn != nil {
+		c.conn.Close()
+		c.conn = nil
+	}
+}
@@ -0,0 +1,75 @@
+// Copyright Istio Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package driver
+
+import (
+	"encoding/json"
+	"fmt"
+	"log"
+	"strings"
+
+	"github.com/prometheus/common/expfmt"
+
+	"istio.io/proxy/test/envoye2e/env"
+)
+
+// MemorySnapshot is the memory usage of a proxy at a point in time.
+type MemorySnapshot struct {
+	// Allocated is the heap memory in use, in bytes.
+	Allocated uint64 `json:"allocated,string"`
+	// HeapSize is the heap memory reserved from the system, in bytes.
+	HeapSize uint64 `json:"heap_size,string"`
+	// Series is the number of time series of each Prometheus metric family.
+	Series map[string]int `json:"-"`
+}
+
+// Memory reads the heap usage from the admin /memory endpoint and counts the
+// Prometheus series of the proxy.
+type Memory struct {
+	AdminPort uint16
+	// Snapshot receives the readings.
+	Snapshot *MemorySnapshot
+}
+
+var _ Step = &Memory{}
+
+func (m *Memory) Run(p *Params) error {
+	_, body, err := env.HTTPGet(fmt.Sprintf("http://127.0.0.1:%d/memory", m.AdminPort))
+	if err != nil {
+		return err
+	}
+	snapshot := MemorySnapshot{}
+	if err := json.Unmarshal([]byte(body), &snapshot); err != nil {
+		return fmt.Errorf("failed to parse memory %q: %v", body, err)
+	}
+	_, body, err = env.HTTPGet(fmt.Sprintf("http://127.0.0.1:%d/stats/prometheus", m.AdminPort))
+	if err != nil {
+		return err
+	}
+	metrics, err := (&expfmt.TextParser{}).TextToMetricFamilies(strings.NewReader(body))
+	if err != nil {
+		return err
+	}
+	snapshot.Series = make(map[string]int, len(metrics))
+	for name, metric := range metrics {
+		snapshot.Series[name] = len(metric.GetMetric())
+	}
+	log.Printf("memory of proxy at admin port %d: allocated %d, heap size %d, istio_requests_total series %d",
+		m.AdminPort, snapshot.Allocated, snapshot.HeapSize, snapshot.Series["istio_requests_total"])
+	*m.Snapshot = snapshot
+	return nil
+}
+
+func (m *Memory) Cleanup() {}
@@ -31,7 +31,9 @@ import (
 
 type Stats struct {
 	AdminPort uint16
-	Matchers  map[string]StatMatcher
+	// Path of the admin endpoint, /stats/prometheus by default.
+	Path     string
+	Matchers map[string]StatMatcher
 }
 
 type StatMatcher interface {
@@ -41,9 +43,13 @@ type StatMatcher interface {
 var _ Step = &Stats{}
 
 func (s *Stats) Run(p *Params) error {
+	path := s.Path
+	if path == "" {
+		path = "/stats/prometheus"
+	}
 	var metrics map[string]*dto.MetricFamily
 	for i := 0; i < 15; i++ {
-		_, body, err := env.HTTPGet(fmt.Sprintf("http://127.0.0.1:%d/stats/prometheus", s.AdminPort))
+		_, body, err := env.HTTPGet(fmt.Sprintf("http://127.0.0.1:%d%s", s.AdminPort, path))
 		if err != nil {
 			return err
 		}
@@ -149,6 +155,28 @@ func (me *PartialStat) Matches(params *Params, that *dto.MetricFamily) error {
 
 var _ StatMatcher = &PartialStat{}
 
+// HistogramCount matches if the series of the histogram have the sample
+// count in total.
+type HistogramCount struct {
+	Count uint64
+}
+
+func (h *HistogramCount) Matches(_ *Params, that *dto.MetricFamily) error {
+	if that.GetType() != dto.MetricType_HISTOGRAM {
+		return fmt.Errorf("metric %s is not a histogram", that.GetName())
+	}
+	var count uint64
+	for _, metric := range that.Metric {
+		count += metric.GetHistogram().GetSampleCount()
+	}
+	if count != h.Count {
+		return fmt.Errorf("got %d samples, want %d", count, h.Count)
+	}
+	return nil
+}
+
+var _ StatMatcher = &HistogramCount{}
+
 type MissingStat struct {
 	Metric string
 }
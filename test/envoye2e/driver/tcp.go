@@ -28,6 +28,8 @@ import (
 type TCPServer struct {
 	lis    net.Listener
 	Prefix string
+	// Quiet disables the logging of each request, for the Load step.
+	Quiet bool
 }
 
 var _ Step = &TCPServer{}
@@ -57,7 +59,7 @@ func (t *TCPServer) serve() {
 		}
 
 		// pass an accepted connection to a handler goroutine
-		go handleConnection(conn, t.Prefix)
+		go handleConnection(conn, t.Prefix, t.Quiet)
 	}
 }
 
@@ -86,7 +88,7 @@ func waitForTCPServer(port uint16) error {
 	return errors.New("timeout waiting for TCP server to be ready")
 }
 
-func handleConnection(conn net.Conn, prefix string) {
+func handleConnection(conn net.Conn, prefix string, quiet bool) {
 	defer conn.Close()
 	reader := bufio.NewReader(conn)
 	for {
@@ -98,11 +100,15 @@ func handleConnection(conn net.Conn, prefix string) {
 			}
 			return
 		}
-		log.Printf("request: %s", bytes)
+		if !quiet {
+			log.Printf("request: %s", bytes)
+		}
 
 		// prepend prefix and send as response
 		line := fmt.Sprintf("%s %s", prefix, bytes)
-		log.Printf("response: %s", line)
+		if !quiet {
+			log.Printf("response: %s", line)
+		}
 		_, _ = conn.Write([]byte(line))
 	}
 }
@@ -98,9 +98,14 @@ func (x *XDS) Run(p *Params) error {
 
 type NamedWorkload struct {
 	*workloadapi.Workload
+	// Name overrides the resource name, which defaults to the uid.
+	Name string
 }
 
 func (nw *NamedWorkload) GetName() string {
+	if nw.Name != "" {
+		return nw.Name
+	}
 	return nw.Uid
 }
 
@@ -211,6 +216,9 @@ type WorkloadMetadata struct {
 
 type UpdateWorkloadMetadata struct {
 	Workloads []WorkloadMetadata
+	// OnDemand names the workloads by address, as requested by proxies with
+	// on-demand workload discovery.
+	OnDemand bool
 }
 
 var _ Step = &UpdateWorkloadMetadata{}
@@ -228,7 +236,10 @@ func (u *UpdateWorkloadMetadata) Run(p *Params) error {
 		}
 		log.Printf("updating metadata for %q\n", wl.Address)
 		out.Addresses = [][]byte{ip.AsSlice()}
-		namedWorkload := &NamedWorkload{out}
+		namedWorkload := &NamedWorkload{Workload: out}
+		if u.OnDemand {
+			namedWorkload.Name = "/" + ip.String()
+		}
 		err = p.Config.Workloads.UpdateResource(namedWorkload.GetName(), namedWorkload)
 		if err != nil {
 			return err
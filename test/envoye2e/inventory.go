@@ -23,6 +23,7 @@ var ProxyE2ETests = &env.TestInventory{}
 func init() {
 	ProxyE2ETests.Tests = append(ProxyE2ETests.Tests, []string{
 		"TestAttributeGen",
+		"TestAttributeGenNative",
 		"TestBasicFlow",
 		"TestBasicHTTP",
 		"TestBasicHTTPGateway",
@@ -50,6 +51,9 @@ func init() {
 		"TestStatsPayload/UseHostHeader/",
 		"TestStatsParserRegression",
 		"TestStatsExpiry",
+		"TestStatsMetricMatch",
+		"TestStatsBypass",
+		"TestStatsDedicatedStore",
 		"TestTCPMetadataExchange/false",
 		"TestTCPMetadataExchange/true",
 		"TestTCPMetadataExchangeNoAlpn",
@@ -57,5 +61,17 @@ func init() {
 		"TestOtelPayload",
 		"TestTCPMetadataNotFoundReporting",
 		"TestStatsDestinationServiceNamespacePrecedence",
+		"TestLoad/http/default/mx",
+		"TestLoad/http/default/wds",
+		"TestLoad/http/customized/mx",
+		"TestLoad/http/customized/wds",
+		"TestLoad/grpc/default/mx",
+		"TestLoad/grpc/default/wds",
+		"TestLoad/grpc/customized/mx",
+		"TestLoad/grpc/customized/wds",
+		"TestLoad/tcp/default/mx",
+		"TestLoad/tcp/default/wds",
+		"TestStatsMemoryGrowth/norotation",
+		"TestStatsMemoryGrowth/rotation",
 	}...)
 }
@@ -0,0 +1,189 @@
+// Copyright Istio Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package client
+
+import (
+	"os"
+	"strconv"
+	"strings"
+	"testing"
+	"time"
+
+	"istio.io/proxy/test/envoye2e"
+	"istio.io/proxy/test/envoye2e/driver"
+	"istio.io/proxy/test/envoye2e/env"
+)
+
+// LoadWorkloads are the client and server proxies, as discovered by WDS.
+var LoadWorkloads = []driver.WorkloadMetadata{{
+	Address: "127.0.0.1",
+	Metadata: `
+namespace: default
+workload_name: productpage-v1
+workload_type: DEPLOYMENT
+canonical_name: productpage-v1
+canonical_revision: version-1
+cluster_id: client-cluster
+uid: //v1/pod/default/productpage
+`,
+}, {
+	Address: "127.0.0.2",
+	Metadata: `
+namespace: default
+workload_name: ratings-v1
+workload_type: DEPLOYMENT
+canonical_name: ratings
+canonical_revision: version-1
+cluster_id: server-cluster
+uid: //v1/pod/default/ratings
+`,
+}}
+
+var LoadCases = []struct {
+	Protocol     driver.LoadProtocol
+	Stats        string
+	ClientConfig string
+}{
+	{Protocol: driver.LoadHTTP, Stats: "default", ClientConfig: "testdata/stats/client_config.yaml"},
+	{Protocol: driver.LoadHTTP, Stats: "customized", ClientConfig: "testdata/stats/client_config_customized.yaml.tmpl"},
+	{Protocol: driver.LoadGRPC, Stats: "default", ClientConfig: "testdata/stats/client_config.yaml"},
+	{Protocol: driver.LoadGRPC, Stats: "customized", ClientConfig: "testdata/stats/client_config_customized.yaml.tmpl"},
+	// The TCP stats filter is not configurable.
+	{Protocol: driver.LoadTCP, Stats: "default"},
+}
+
+// TestLoad reports the throughput and the proxy CPU time per request for
+// each protocol, stats config and peer discovery. It runs only if LOAD_TEST
+// is set, e.g. LOAD_TEST=1 LOAD_RPS=1000 LOAD_CONCURRENCY=8.
+func TestLoad(t *testing.T) {
+	if os.Getenv("LOAD_TEST") == "" {
+		t.Skip("LOAD_TEST is not set")
+	}
+	env.SkipTSanASan(t)
+	rps, concurrency, duration := 0, 4, 30*time.Second
+	if v := os.Getenv("LOAD_RPS"); v != "" {
+		rps = mustAtoi(t, v)
+	}
+	if v := os.Getenv("LOAD_CONCURRENCY"); v != "" {
+		concurrency = mustAtoi(t, v)
+	}
+	if v := os.Getenv("LOAD_DURATION"); v != "" {
+		var err error
+		if duration, err = time.ParseDuration(v); err != nil {
+			t.Fatal(err)
+		}
+	}
+	var reports []string
+	for _, loadCase := range LoadCases {
+		for _, discovery := range []string{"mx", "wds"} {
+			name := strings.Join([]string{loadCase.Protocol.String(), loadCase.Stats, discovery}, "/")
+			t.Run(name, func(t *testing.T) {
+				report := &driver.LoadReport{}
+				runLoad(t, loadCase.Protocol, loadCase.ClientConfig, discovery == "wds", &driver.Load{
+					Protocol:    loadCase.Protocol,
+					Duration:    duration,
+					RPS:         rps,
+					Concurrency: concurrency,
+					Report:      report,
+				})
+				reports = append(reports, name+": "+report.String())
+			})
+		}
+	}
+	t.Logf("load reports:\n%s", strings.Join(reports, "\n"))
+}
+
+func mustAtoi(t *testing.T, v string) int {
+	t.Helper()
+	n, err := strconv.Atoi(v)
+	if err != nil {
+		t.Fatal(err)
+	}
+	return n
+}
+
+func runLoad(t *testing.T, protocol driver.LoadProtocol, clientConfig string, wds bool, load *driver.Load) {
+	t.Helper()
+	params := driver.NewTestParams(t, map[string]string{
+		"StatsConfig": driver.LoadTestData("testdata/bootstrap/stats.yaml.tmpl"),
+	}, envoye2e.ProxyE2ETests)
+	params.Vars["ClientMetadata"] = params.LoadTestData("testdata/client_node_metadata.json.tmpl")
+	params.Vars["ServerMetadata"] = params.LoadTestData("testdata/server_node_metadata.json.tmpl")
+	if wds {
+		params.Vars["EnableMetadataDiscovery"] = "true"
+	}
+
+	var backend driver.Step
+	var clientListener, serverListener string
+	var clientCluster, serverCluster []string
+	switch protocol {
+	case driver.LoadTCP:
+		params.Vars["DisableDirectResponse"] = "true"
+		if wds {
+			params.Vars["AlpnProtocol"] = "disabled"
+		} else {
+			params.Vars["AlpnProtocol"] = "mx-protocol"
+		}
+		params.Vars["ServerNetworkFilters"] = params.LoadTestData("testdata/filters/server_mx_network_filter.yaml.tmpl") + "\n" +
+			params.LoadTestData("testdata/filters/server_stats_network_filter.yaml.tmpl")
+		params.Vars["ClientUpstreamFilters"] = params.LoadTestData("testdata/filters/client_mx_network_filter.yaml.tmpl")
+		params.Vars["ClientNetworkFilters"] = params.LoadTestData("testdata/filters/client_stats_network_filter.yaml.tmpl")
+		params.Vars["ClientClusterTLSContext"] = params.LoadTestData("testdata/transport_socket/client.yaml.tmpl")
+		params.Vars["ServerListenerTLSContext"] = params.LoadTestData("testdata/transport_socket/server.yaml.tmpl")
+		clientCluster = []string{params.LoadTestData("testdata/cluster/tcp_client.yaml.tmpl")}
+		serverCluster = []string{params.LoadTestData("testdata/cluster/tcp_server.yaml.tmpl")}
+		clientListener = params.LoadTestData("testdata/listener/tcp_client.yaml.tmpl")
+		serverListener = params.LoadTestData("testdata/listener/tcp_server.yaml.tmpl")
+		backend = &driver.TCPServer{Prefix: "hello", Quiet: true}
+	default:
+		params.Vars["StatsFilterClientConfig"] = driver.LoadTestJSON(clientConfig)
+		params.Vars["StatsFilterServerConfig"] = driver.LoadTestJSON("testdata/stats/server_config.yaml")
+		peer := "mx_native"
+		if wds {
+			peer = "wds"
+		}
+		params.Vars["ServerHTTPFilters"] = driver.LoadTestData("testdata/filters/"+peer+"_inbound.yaml.tmpl") + "\n" +
+			driver.LoadTestData("testdata/filters/stats_inbound.yaml.tmpl")
+		params.Vars["ClientHTTPFilters"] = driver.LoadTestData("testdata/filters/"+peer+"_outbound.yaml.tmpl") + "\n" +
+			driver.LoadTestData("testdata/filters/stats_outbound.yaml.tmpl")
+		clientListener = params.LoadTestData("testdata/listener/client.yaml.tmpl")
+		serverListener = params.LoadTestData("testdata/listener/server.yaml.tmpl")
+		if protocol == driver.LoadGRPC {
+			params.Vars["DisableDirectResponse"] = "true"
+			params.Vars["UsingGrpcBackend"] = "true"
+			backend = &driver.GrpcServer{}
+		}
+	}
+
+	client := &driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/client.yaml.tmpl")}
+	server := &driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/server.yaml.tmpl")}
+	load.Envoys = []*driver.Envoy{client, server}
+	steps := []driver.Step{
+		&driver.XDS{},
+		&driver.Update{Node: "client", Version: "0", Clusters: clientCluster, Listeners: []string{clientListener}},
+		&driver.Update{Node: "server", Version: "0", Clusters: serverCluster, Listeners: []string{serverListener}},
+		&driver.UpdateWorkloadMetadata{Workloads: LoadWorkloads},
+		server,
+		client,
+		&driver.Sleep{Duration: 1 * time.Second},
+	}
+	if backend != nil {
+		steps = append(steps, backend)
+	}
+	steps = append(steps, load)
+	if err := (&driver.Scenario{Steps: steps}).Run(params); err != nil {
+		t.Fatal(err)
+	}
+}
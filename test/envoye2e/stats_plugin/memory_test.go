@@ -0,0 +1,190 @@
+// Copyright Istio Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package client
+
+import (
+	"encoding/base64"
+	"fmt"
+	"os"
+	"testing"
+	"time"
+
+	"google.golang.org/protobuf/proto"
+	"google.golang.org/protobuf/types/known/structpb"
+
+	"istio.io/proxy/test/envoye2e"
+	"istio.io/proxy/test/envoye2e/driver"
+	"istio.io/proxy/test/envoye2e/env"
+)
+
+const (
+	// MemoryPeers is the default number of distinct peers and hosts, override with MEMORY_PEERS.
+	MemoryPeers = 200
+	// MemoryPerPeer bounds the heap growth of a proxy per distinct peer or host.
+	MemoryPerPeer = 64 * 1024
+	// MemoryExtraSeries allows for the series recorded before the distinct peers.
+	MemoryExtraSeries = 4
+	// MemoryReleasedFraction is the part of the heap growth that must be released after rotation.
+	MemoryReleasedFraction = 0.5
+)
+
+// encodePeer returns the exchanged metadata of a distinct client workload.
+func encodePeer(t *testing.T, i int) string {
+	t.Helper()
+	workload := fmt.Sprintf("client-%d", i)
+	pb, err := structpb.NewStruct(map[string]interface{}{
+		"NAME":          fmt.Sprintf("%s-84975bc778-%d", workload, i),
+		"NAMESPACE":     "default",
+		"CLUSTER_ID":    "client-cluster",
+		"WORKLOAD_NAME": workload,
+		"LABELS": map[string]interface{}{
+			"app":                                 workload,
+			"service.istio.io/canonical-name":     workload,
+			"service.istio.io/canonical-revision": "v1",
+		},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	bytes, err := proto.Marshal(pb)
+	if err != nil {
+		t.Fatal(err)
+	}
+	return base64.RawStdEncoding.EncodeToString(bytes)
+}
+
+func checkMemory(t *testing.T, proxy string, before, after *driver.MemorySnapshot, peers, maxSeries int) driver.Step {
+	return driver.StepFunction(func(_ *driver.Params) error {
+		growth := int64(after.Allocated) - int64(before.Allocated)
+		t.Logf("%s proxy: heap growth %d bytes, %d bytes per peer, istio_requests_total series %d",
+			proxy, growth, growth/int64(peers), after.Series["istio_requests_total"])
+		if growth > int64(peers)*MemoryPerPeer {
+			return fmt.Errorf("%s proxy heap grew by %d bytes for %d peers, want at most %d per peer",
+				proxy, growth, peers, MemoryPerPeer)
+		}
+		if series := after.Series["istio_requests_total"]; series > maxSeries {
+			return fmt.Errorf("%s proxy has %d istio_requests_total series, want at most %d", proxy, series, maxSeries)
+		}
+		return nil
+	})
+}
+
+func checkReleased(t *testing.T, proxy string, before, peak, after *driver.MemorySnapshot, maxSeries int) driver.Step {
+	return driver.StepFunction(func(_ *driver.Params) error {
+		growth := int64(peak.Allocated) - int64(before.Allocated)
+		released := int64(peak.Allocated) - int64(after.Allocated)
+		t.Logf("%s proxy: heap released %d of %d bytes grown, istio_requests_total series %d",
+			proxy, released, growth, after.Series["istio_requests_total"])
+		if growth <= 0 {
+			return fmt.Errorf("%s proxy heap did not grow before rotation", proxy)
+		}
+		if float64(released) < float64(growth)*MemoryReleasedFraction {
+			return fmt.Errorf("%s proxy released %d of %d bytes grown, want at least %.0f%%",
+				proxy, released, growth, MemoryReleasedFraction*100)
+		}
+		if series := after.Series["istio_requests_total"]; series > maxSeries {
+			return fmt.Errorf("%s proxy has %d istio_requests_total series, want at most %d", proxy, series, maxSeries)
+		}
+		return nil
+	})
+}
+
+// TestStatsMemoryGrowth sends requests from distinct peers to the server proxy
+// and to distinct hosts through the client proxy, and bounds the heap growth
+// and the series count per peer. With rotation, the series must be dropped
+// and most of the heap growth released once the peers go away.
+func TestStatsMemoryGrowth(t *testing.T) {
+	env.SkipTSanASan(t)
+	peers := MemoryPeers
+	if v := os.Getenv("MEMORY_PEERS"); v != "" {
+		peers = mustAtoi(t, v)
+	}
+	for _, rotation := range []bool{false, true} {
+		name := "norotation"
+		clientConfig, serverConfig := "testdata/stats/client_config.yaml", "testdata/stats/server_config.yaml"
+		if rotation {
+			name = "rotation"
+			clientConfig, serverConfig = "testdata/stats/client_config_expiry.yaml", "testdata/stats/server_config_expiry.yaml"
+		}
+		t.Run(name, func(t *testing.T) {
+			params := driver.NewTestParams(t, map[string]string{
+				"StatsConfig":             driver.LoadTestData("testdata/bootstrap/stats.yaml.tmpl"),
+				"StatsFilterClientConfig": driver.LoadTestJSON(clientConfig),
+				"StatsFilterServerConfig": driver.LoadTestJSON(serverConfig),
+				"ServerClusterName":       "host_header",
+			}, envoye2e.ProxyE2ETests)
+			params.Vars["ClientMetadata"] = params.LoadTestData("testdata/client_node_metadata.json.tmpl")
+			params.Vars["ServerMetadata"] = params.LoadTestData("testdata/server_node_metadata.json.tmpl")
+			enableStats(t, params.Vars)
+
+			var clientBefore, clientAfter, clientRotated driver.MemorySnapshot
+			var serverBefore, serverAfter, serverRotated driver.MemorySnapshot
+			steps := []driver.Step{
+				&driver.XDS{},
+				&driver.Update{
+					Node:      "client",
+					Version:   "0",
+					Clusters:  []string{params.LoadTestData("testdata/cluster/server.yaml.tmpl")},
+					Listeners: []string{params.LoadTestData("testdata/listener/client.yaml.tmpl")},
+				},
+				&driver.Update{Node: "server", Version: "0", Listeners: []string{params.LoadTestData("testdata/listener/server.yaml.tmpl")}},
+				&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/server.yaml.tmpl")},
+				&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/client.yaml.tmpl")},
+				&driver.Sleep{Duration: 1 * time.Second},
+				// Warm up the filters and the stats scopes before the first reading.
+				&driver.HTTPCall{Port: params.Ports.ClientPort, Body: "hello, world!"},
+				&driver.Memory{AdminPort: params.Ports.ClientAdmin, Snapshot: &clientBefore},
+				&driver.Memory{AdminPort: params.Ports.ServerAdmin, Snapshot: &serverBefore},
+			}
+			for i := 0; i < peers; i++ {
+				steps = append(steps,
+					&driver.HTTPCall{
+						Port:      params.Ports.ClientPort,
+						Authority: fmt.Sprintf("svc-%d.default.svc.cluster.local", i),
+						Body:      "hello, world!",
+					},
+					&driver.HTTPCall{
+						IP:   "127.0.0.2",
+						Port: params.Ports.ServerPort,
+						Body: "hello, world!",
+						RequestHeaders: map[string]string{
+							"x-envoy-peer-metadata-id": fmt.Sprintf("sidecar~10.0.0.%d~client-%d.default~default.svc.cluster.local", i%256, i),
+							"x-envoy-peer-metadata":    encodePeer(t, i),
+						},
+					})
+			}
+			steps = append(steps,
+				&driver.Memory{AdminPort: params.Ports.ClientAdmin, Snapshot: &clientAfter},
+				&driver.Memory{AdminPort: params.Ports.ServerAdmin, Snapshot: &serverAfter},
+				checkMemory(t, "client", &clientBefore, &clientAfter, peers, peers+MemoryExtraSeries),
+				checkMemory(t, "server", &serverBefore, &serverAfter, peers, peers+MemoryExtraSeries),
+			)
+			if rotation {
+				// Past the rotation and the graceful deletion intervals, the
+				// series of the peers are gone and their memory is released.
+				steps = append(steps,
+					&driver.Sleep{Duration: 4 * time.Second},
+					&driver.Memory{AdminPort: params.Ports.ClientAdmin, Snapshot: &clientRotated},
+					&driver.Memory{AdminPort: params.Ports.ServerAdmin, Snapshot: &serverRotated},
+					checkReleased(t, "client", &clientBefore, &clientAfter, &clientRotated, MemoryExtraSeries),
+					checkReleased(t, "server", &serverBefore, &serverAfter, &serverRotated, MemoryExtraSeries),
+				)
+			}
+			if err := (&driver.Scenario{Steps: steps}).Run(params); err != nil {
+				t.Fatal(err)
+			}
+		})
+	}
+}
@@ -415,6 +415,42 @@ func TestAttributeGen(t *testing.T) {
 	}
 }
 
+// TestAttributeGenNative generates the attributes of TestAttributeGen in the
+// stats filter instead of the Wasm plugin and expects the same metrics.
+func TestAttributeGenNative(t *testing.T) {
+	params := driver.NewTestParams(t, map[string]string{
+		"RequestCount":            "10",
+		"StatsFilterClientConfig": driver.LoadTestJSON("testdata/stats/client_config.yaml"),
+		"StatsFilterServerConfig": driver.LoadTestJSON("testdata/stats/request_classification_native_config.yaml"),
+		"ResponseCodeClass":       "2xx",
+	}, envoye2e.ProxyE2ETests)
+	params.Vars["ClientMetadata"] = params.LoadTestData("testdata/client_node_metadata.json.tmpl")
+	params.Vars["ServerMetadata"] = params.LoadTestData("testdata/server_node_metadata.json.tmpl")
+	enableStats(t, params.Vars)
+	if err := (&driver.Scenario{
+		Steps: []driver.Step{
+			&driver.XDS{},
+			&driver.Update{Node: "client", Version: "0", Listeners: []string{params.LoadTestData("testdata/listener/client.yaml.tmpl")}},
+			&driver.Update{Node: "server", Version: "0", Listeners: []string{params.LoadTestData("testdata/listener/server.yaml.tmpl")}},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/server.yaml.tmpl")},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/client.yaml.tmpl")},
+			&driver.Sleep{Duration: 1 * time.Second},
+			&driver.Repeat{
+				N: 10,
+				Step: &driver.HTTPCall{
+					Port: params.Ports.ClientPort,
+					Body: "hello, world!",
+				},
+			},
+			&driver.Stats{AdminPort: params.Ports.ServerAdmin, Matchers: map[string]driver.StatMatcher{
+				"istio_requests_total": &driver.ExactStat{Metric: "testdata/metric/server_request_total.yaml.tmpl"},
+			}},
+		},
+	}).Run(params); err != nil {
+		t.Fatal(err)
+	}
+}
+
 func TestStatsParserRegression(t *testing.T) {
 	env.SkipTSan(t)
 	// This is a regression test for https://github.com/envoyproxy/envoy-wasm/issues/497
@@ -768,6 +804,166 @@ func TestStatsExpiry(t *testing.T) {
 	}
 }
 
+// TestStatsMetricMatch records the request duration only for the requests
+// other than GET, so that only the POST calls of the test record it.
+func TestStatsMetricMatch(t *testing.T) {
+	params := driver.NewTestParams(t, map[string]string{
+		"RequestCount":            "15",
+		"StatsConfig":             driver.LoadTestData("testdata/bootstrap/stats.yaml.tmpl"),
+		"StatsFilterClientConfig": driver.LoadTestJSON("testdata/stats/client_config.yaml"),
+		"StatsFilterServerConfig": driver.LoadTestJSON("testdata/stats/server_config_match.yaml"),
+	}, envoye2e.ProxyE2ETests)
+	params.Vars["ClientMetadata"] = params.LoadTestData("testdata/client_node_metadata.json.tmpl")
+	params.Vars["ServerMetadata"] = params.LoadTestData("testdata/server_node_metadata.json.tmpl")
+	enableStats(t, params.Vars)
+	if err := (&driver.Scenario{
+		Steps: []driver.Step{
+			&driver.XDS{},
+			&driver.Update{Node: "client", Version: "0", Listeners: []string{params.LoadTestData("testdata/listener/client.yaml.tmpl")}},
+			&driver.Update{Node: "server", Version: "0", Listeners: []string{params.LoadTestData("testdata/listener/server.yaml.tmpl")}},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/server.yaml.tmpl")},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/client.yaml.tmpl")},
+			&driver.Sleep{Duration: 1 * time.Second},
+			&driver.Repeat{
+				N: 10,
+				Step: &driver.HTTPCall{
+					Port: params.Ports.ClientPort,
+					Body: "hello, world!",
+				},
+			},
+			&driver.Repeat{
+				N: 5,
+				Step: &driver.HTTPCall{
+					Port:   params.Ports.ClientPort,
+					Method: "POST",
+					Body:   "hello, world!",
+				},
+			},
+			&driver.Stats{AdminPort: params.Ports.ServerAdmin, Matchers: map[string]driver.StatMatcher{
+				"istio_requests_total":                &driver.ExactStat{Metric: "testdata/metric/server_request_total.yaml.tmpl"},
+				"istio_request_duration_milliseconds": &driver.HistogramCount{Count: 5},
+			}},
+		},
+	}).Run(params); err != nil {
+		t.Fatal(err)
+	}
+}
+
+// TestStatsBypass sends probes along the regular requests and expects only
+// the regular requests in the server metrics, and the probes in the bypass
+// counter.
+func TestStatsBypass(t *testing.T) {
+	params := driver.NewTestParams(t, map[string]string{
+		"RequestCount":            "10",
+		"StatsConfig":             driver.LoadTestData("testdata/bootstrap/stats.yaml.tmpl"),
+		"StatsFilterClientConfig": driver.LoadTestJSON("testdata/stats/client_config.yaml"),
+		"StatsFilterServerConfig": driver.LoadTestJSON("testdata/stats/server_config_bypass.yaml"),
+	}, envoye2e.ProxyE2ETests)
+	params.Vars["ClientMetadata"] = params.LoadTestData("testdata/client_node_metadata.json.tmpl")
+	params.Vars["ServerMetadata"] = params.LoadTestData("testdata/server_node_metadata.json.tmpl")
+	enableStats(t, params.Vars)
+	if err := (&driver.Scenario{
+		Steps: []driver.Step{
+			&driver.XDS{},
+			&driver.Update{Node: "client", Version: "0", Listeners: []string{params.LoadTestData("testdata/listener/client.yaml.tmpl")}},
+			&driver.Update{Node: "server", Version: "0", Listeners: []string{params.LoadTestData("testdata/listener/server.yaml.tmpl")}},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/server.yaml.tmpl")},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/client.yaml.tmpl")},
+			&driver.Sleep{Duration: 1 * time.Second},
+			&driver.Repeat{
+				N: 10,
+				Step: &driver.HTTPCall{
+					Port: params.Ports.ClientPort,
+					Body: "hello, world!",
+				},
+			},
+			&driver.Repeat{
+				N: 5,
+				Step: &driver.HTTPCall{
+					Port:           params.Ports.ClientPort,
+					Body:           "hello, world!",
+					RequestHeaders: map[string]string{"User-Agent": "kube-probe/1.30"},
+				},
+			},
+			&driver.Repeat{
+				N: 5,
+				Step: &driver.HTTPCall{
+					Port: params.Ports.ClientPort,
+					Path: "/healthz",
+					Body: "hello, world!",
+				},
+			},
+			&driver.Stats{AdminPort: params.Ports.ServerAdmin, Matchers: map[string]driver.StatMatcher{
+				"istio_requests_total":                &driver.ExactStat{Metric: "testdata/metric/server_request_total.yaml.tmpl"},
+				"envoy_istio_stats_bypassed_requests": &driver.ExactStat{Metric: "testdata/metric/server_bypassed_requests.yaml"},
+			}},
+		},
+	}).Run(params); err != nil {
+		t.Fatal(err)
+	}
+}
+
+// TestStatsDedicatedStore records the server metrics in the dedicated store,
+// which are served by /istio/stats/prometheus instead of /stats/prometheus.
+// The series survive an update of the filter config.
+func TestStatsDedicatedStore(t *testing.T) {
+	params := driver.NewTestParams(t, map[string]string{
+		"RequestCount":            "10",
+		"StatsConfig":             driver.LoadTestData("testdata/bootstrap/stats.yaml.tmpl"),
+		"StatsFilterClientConfig": driver.LoadTestJSON("testdata/stats/client_config.yaml"),
+		"StatsFilterServerConfig": driver.LoadTestJSON("testdata/stats/server_config_dedicated.yaml"),
+	}, envoye2e.ProxyE2ETests)
+	params.Vars["ClientMetadata"] = params.LoadTestData("testdata/client_node_metadata.json.tmpl")
+	params.Vars["ServerMetadata"] = params.LoadTestData("testdata/server_node_metadata.json.tmpl")
+	enableStats(t, params.Vars)
+	serverListener := params.LoadTestData("testdata/listener/server.yaml.tmpl")
+	// The same listener with another filter config, which replaces the filter
+	// configs of the server.
+	params.Vars["StatsFilterServerConfig"] = driver.LoadTestJSON("testdata/stats/server_config_dedicated_update.yaml")
+	updatedServerListener := params.LoadTestData("testdata/listener/server.yaml.tmpl")
+	if err := (&driver.Scenario{
+		Steps: []driver.Step{
+			&driver.XDS{},
+			&driver.Update{Node: "client", Version: "0", Listeners: []string{params.LoadTestData("testdata/listener/client.yaml.tmpl")}},
+			&driver.Update{Node: "server", Version: "0", Listeners: []string{serverListener}},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/server.yaml.tmpl")},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/client.yaml.tmpl")},
+			&driver.Sleep{Duration: 1 * time.Second},
+			&driver.Repeat{
+				N: 10,
+				Step: &driver.HTTPCall{
+					Port: params.Ports.ClientPort,
+					Body: "hello, world!",
+				},
+			},
+			&driver.Stats{AdminPort: params.Ports.ServerAdmin, Path: "/istio/stats/prometheus", Matchers: map[string]driver.StatMatcher{
+				"istio_requests_total": &driver.ExactStat{Metric: "testdata/metric/server_request_total.yaml.tmpl"},
+			}},
+			&driver.Stats{AdminPort: params.Ports.ServerAdmin, Matchers: map[string]driver.StatMatcher{
+				"istio_requests_total": &driver.MissingStat{Metric: "istio_requests_total"},
+			}},
+			&driver.Update{Node: "server", Version: "1", Listeners: []string{updatedServerListener}},
+			&driver.Sleep{Duration: 1 * time.Second},
+			&driver.Repeat{
+				N: 10,
+				Step: &driver.HTTPCall{
+					Port: params.Ports.ClientPort,
+					Body: "hello, world!",
+				},
+			},
+			driver.StepFunction(func(p *driver.Params) error {
+				p.Vars["RequestCount"] = "20"
+				return nil
+			}),
+			&driver.Stats{AdminPort: params.Ports.ServerAdmin, Path: "/istio/stats/prometheus", Matchers: map[string]driver.StatMatcher{
+				"istio_requests_total": &driver.ExactStat{Metric: "testdata/metric/server_request_total.yaml.tmpl"},
+			}},
+		},
+	}).Run(params); err != nil {
+		t.Fatal(err)
+	}
+}
+
 func TestStatsDestinationServiceNamespacePrecedence(t *testing.T) {
 	clientStats := map[string]driver.StatMatcher{
 		"istio_requests_total": &driver.ExactStat{Metric: "testdata/metric/client_request_total_cluster_metadata_precedence.yaml.tmpl"},
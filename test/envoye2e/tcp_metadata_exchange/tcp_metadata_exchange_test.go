@@ -261,3 +261,74 @@ uid: //v1/pod/default/productpage
 		t.Fatal(err)
 	}
 }
+
+func TestTCPMetadataDiscoveryOnDemand(t *testing.T) {
+	params := driver.NewTestParams(t, map[string]string{
+		"DisableDirectResponse":           "true",
+		"AlpnProtocol":                    "disabled",
+		"EnableMetadataDiscovery":         "true",
+		"EnableOnDemandMetadataDiscovery": "true",
+		"StatsConfig":                     driver.LoadTestData("testdata/bootstrap/stats.yaml.tmpl"),
+	}, envoye2e.ProxyE2ETests)
+	params.Vars["ClientMetadata"] = params.LoadTestData("testdata/client_node_metadata.json.tmpl")
+	params.Vars["ServerMetadata"] = params.LoadTestData("testdata/server_node_metadata.json.tmpl")
+	params.Vars["ServerNetworkFilters"] = params.LoadTestData("testdata/filters/server_mx_network_filter.yaml.tmpl") + "\n" +
+		params.LoadTestData("testdata/filters/server_stats_network_filter.yaml.tmpl")
+	params.Vars["ClientUpstreamFilters"] = params.LoadTestData("testdata/filters/client_mx_network_filter.yaml.tmpl")
+	params.Vars["ClientNetworkFilters"] = params.LoadTestData("testdata/filters/client_stats_network_filter.yaml.tmpl")
+
+	if err := (&driver.Scenario{
+		Steps: []driver.Step{
+			&driver.XDS{},
+			&driver.Update{
+				Node:      "client",
+				Version:   "0",
+				Clusters:  []string{params.LoadTestData("testdata/cluster/tcp_client.yaml.tmpl")},
+				Listeners: []string{params.LoadTestData("testdata/listener/tcp_client.yaml.tmpl")},
+			},
+			&driver.Update{
+				Node:      "server",
+				Version:   "0",
+				Clusters:  []string{params.LoadTestData("testdata/cluster/tcp_server.yaml.tmpl")},
+				Listeners: []string{params.LoadTestData("testdata/listener/tcp_server.yaml.tmpl")},
+			},
+			// Only the client workload is looked up by the server.
+			&driver.UpdateWorkloadMetadata{OnDemand: true, Workloads: []driver.WorkloadMetadata{{
+				Address: "127.0.0.1",
+				Metadata: `
+namespace: default
+workload_name: productpage-v1
+workload_type: DEPLOYMENT
+canonical_name: productpage-v1
+canonical_revision: version-1
+cluster_id: client-cluster
+uid: //v1/pod/default/productpage
+`}, {
+				Address: "10.0.0.1",
+				Metadata: `
+namespace: default
+workload_name: reviews-v1
+workload_type: DEPLOYMENT
+canonical_name: reviews
+canonical_revision: version-1
+cluster_id: server-cluster
+uid: //v1/pod/default/reviews
+`},
+			}},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/client.yaml.tmpl")},
+			&driver.Envoy{Bootstrap: params.LoadTestData("testdata/bootstrap/server.yaml.tmpl")},
+			&driver.Sleep{Duration: 1 * time.Second},
+			&driver.TCPServer{Prefix: "hello"},
+			&driver.Repeat{
+				N:    10,
+				Step: &driver.TCPConnection{},
+			},
+			&driver.Sleep{Duration: 1 * time.Second},
+			&driver.Stats{AdminPort: params.Ports.ServerAdmin, Matchers: map[string]driver.StatMatcher{
+				"envoy_workload_discovery_total": &driver.ExactStat{Metric: "testdata/metric/tcp_server_workload_discovery_total.yaml.tmpl"},
+			}},
+		},
+	}).Run(params); err != nil {
+		t.Fatal(err)
+	}
+}
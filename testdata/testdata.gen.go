@@ -146,6 +146,9 @@ bootstrap_extensions:
     value:
       config_source:
         ads: {}
+      {{- if eq .Vars.EnableOnDemandMetadataDiscovery "true" }}
+      on_demand: {}
+      {{- end }}
 {{- end }}
 `)
 
@@ -403,6 +406,9 @@ bootstrap_extensions:
     value:
       config_source:
         ads: {}
+      {{- if eq .Vars.EnableOnDemandMetadataDiscovery "true" }}
+      on_demand: {}
+      {{- end }}
 {{- end }}
 `)
 